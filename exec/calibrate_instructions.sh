@@ -0,0 +1,55 @@
+#!/bin/bash
+#
+# 本脚本用于测量评测机每秒执行的指令数，评测系统按指令数评测时用它将时间限制换算成指令数限制
+# 不同型号的 CPU 每秒执行的指令数不同，每台评测机都需要单独测量，更换硬件后需要重新测量
+# 测量时评测机应处于空闲状态，结果输出到标准输出，传给评测系统的 --instruction-rate 参数或 INSTRUCTIONRATE 环境变量
+# 用法： $0 <judgehostuser> [cpuset] [轮数]
+
+error() { echo "$*" 1>&2; exit 1; }
+
+[ $# -ge 1 ] || error "judge host username required"
+
+JUDGEHOSTUSER=$1
+CPUSET=${2:-0}
+ROUNDS=${3:-5}
+RUNGUARD=${RUNGUARD:-$(dirname "$0")/../runguard/bin/runguard}
+[ -x "$RUNGUARD" ] || error "runguard does not exist"
+
+TMPDIR=$(mktemp -d)
+chmod 755 "$TMPDIR"
+trap 'rm -rf "$TMPDIR"' EXIT
+
+# 参考程序混合了整数运算、分支和随机内存访问，接近一般算法题程序的指令组成
+cat > "$TMPDIR/reference.c" <<'PROGRAM'
+#include <stdio.h>
+#include <stdlib.h>
+#define N (1 << 22)
+static unsigned a[N];
+int main(void) {
+    unsigned x = 12345, sum = 0;
+    for (int i = 0; i < N; ++i) a[i] = x = x * 1103515245 + 12345;
+    for (int round = 0; round < 40; ++round)
+        for (int i = 0; i < N; ++i) {
+            unsigned j = a[i] & (N - 1);
+            if (a[j] & 1) sum += a[j] >> 3; else sum ^= a[i];
+            a[i] = sum + j;
+        }
+    printf("%u\n", sum);
+    return 0;
+}
+PROGRAM
+gcc -O2 -o "$TMPDIR/reference" "$TMPDIR/reference.c" || error "unable to compile reference program"
+
+RATES=()
+for ((i = 0; i < ROUNDS; ++i)); do
+    "$RUNGUARD" --user "$JUDGEHOSTUSER" --cpuset "$CPUSET" --count-instructions \
+        --standard-output-file /dev/null --out-meta "$TMPDIR/meta" -- "$TMPDIR/reference" \
+        || error "runguard failed"
+    INSTRUCTIONS=$(grep '^instructions: ' "$TMPDIR/meta" | sed 's/instructions: //')
+    USERTIME=$(grep '^user-time: ' "$TMPDIR/meta" | sed 's/user-time: //')
+    [ -n "$INSTRUCTIONS" ] || error "instruction counter is not supported on this machine"
+    RATES+=("$(awk -v n="$INSTRUCTIONS" -v t="$USERTIME" 'BEGIN { printf "%.0f\n", n / t }')")
+done
+
+# 取中位数，避免个别轮次受到干扰
+printf "%s\n" "${RATES[@]}" | sort -n | awk '{ rate[NR] = $1 } END { print rate[int((NR + 1) / 2)] }'
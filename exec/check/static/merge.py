@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+import json
+import os
+import sys
+
+'''
+合并每个翻译单元的 oclint 结果，生成和直接对所有源文件运行 oclint 相同格式的 oclint.json
+
+用法：
+  merge.py <compile dir> <output json> <oclint json>...
+      合并多个 oclint 结果，结果中的相对路径会被还原为 <compile dir> 下的路径
+  merge.py --relative <compile dir> <output json> <oclint json>
+      将 oclint 结果中 <compile dir> 下的路径改写为相对路径，用于写入缓存
+'''
+
+
+def rewrite_paths(result, rewrite):
+    for violation in result.get("violation", []):
+        if "path" in violation:
+            violation["path"] = rewrite(violation["path"])
+
+
+def merge(results):
+    merged = None
+    priorities = {}
+    for result in results:
+        if merged is None:
+            merged = dict(result)
+            merged["summary"] = {}
+            merged["violation"] = []
+        for key, value in result.get("summary", {}).items():
+            if key == "numberOfViolationsWithPriority":
+                for item in value:
+                    priorities[item["priority"]] = priorities.get(item["priority"], 0) + item["number"]
+            elif isinstance(value, (int, float)) and not isinstance(value, bool):
+                merged["summary"][key] = merged["summary"].get(key, 0) + value
+            else:
+                merged["summary"].setdefault(key, value)
+        merged["violation"] += result.get("violation", [])
+    if merged is None:  # 没有需要分析的源文件
+        merged = {"summary": {"numberOfFiles": 0, "numberOfFilesWithViolations": 0}, "violation": []}
+    merged["summary"]["numberOfViolationsWithPriority"] = [
+        {"number": number, "priority": priority} for priority, number in sorted(priorities.items())]
+    return merged
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    relative = len(args) > 0 and args[0] == '--relative'
+    if relative:
+        args = args[1:]
+    if len(args) < 2 or (relative and len(args) != 3):
+        print("Usage: {0} [--relative] [compile dir] [output json file] [oclint result json files...]".format(sys.argv[0]))
+        sys.exit(2)
+
+    compile_dir = args[0]
+    try:
+        results = []
+        for file_name in args[2:]:
+            with open(file_name, 'r') as json_file:
+                results.append(json.load(json_file))
+
+        if relative:
+            result = results[0]
+            rewrite_paths(result, lambda path: os.path.relpath(path, compile_dir) if os.path.isabs(path) else path)
+        else:
+            result = merge(results)
+            rewrite_paths(result, lambda path: path if os.path.isabs(path) else os.path.join(compile_dir, path))
+
+        with open(args[1], 'w') as output_file:
+            json.dump(result, output_file)
+    except (ValueError, KeyError, TypeError) as e:
+        sys.stderr.write('Internal error: unable to merge oclint results: {0}\n'.format(e))
+        sys.exit(1)
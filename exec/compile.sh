@@ -28,6 +28,8 @@
 #   $SCRIPTFILELIMIT 编译脚本输出限制
 #   $E_COMPILER_ERROR 编译失败返回码
 #   $E_INTERNAL_ERROR 内部错误返回码
+#   $SANITIZE 可选，非空时额外编译一个启用该 sanitizer 的可执行文件 run.asan，
+#             供 sanitizer 运行脚本进行内存检查
 
 set -e
 trap error EXIT
@@ -43,7 +45,6 @@ cleanexit ()
 
 . "$JUDGE_UTILS/utils.sh" # runcheck
 . "$JUDGE_UTILS/logging.sh" # logmsg, error
-. "$JUDGE_UTILS/chroot_setup.sh" # chroot_setup
 . "$JUDGE_UTILS/runguard.sh" # read_metadata
 
 CPUSET=""
@@ -64,7 +65,7 @@ shift $((OPTIND-1))
 [ "$1" == "--" ] && shift
 
 if [ -n "$CPUSET" ]; then
-    CPUSET_OPT="--cpuset $CPUSET"
+    CPUSET_OPT="--cpuset $CPUSET --reuse-cgroup"
 fi
 
 LOGLEVEL=$LOG_DEBUG
@@ -92,11 +93,6 @@ fi
 cd "$WORKDIR"
 RUNDIR="$WORKDIR/run-compile"
 
-[ -d "$RUNDIR/merged/judge" ] && force_umount "$RUNDIR/merged/judge" || /bin/true
-[ -d "$RUNDIR/merged/compile" ] && force_umount "$RUNDIR/merged/compile" || /bin/true
-[ -d "$RUNDIR/merged" ] && chroot_stop "$CHROOTDIR" "$RUNDIR/merged"
-[ -d "$RUNDIR/merged" ] && force_umount "$RUNDIR/merged" || /bin/true
-
 mkdir -p "$WORKDIR/compile"
 $GAINROOT chmod -R 777 "$WORKDIR/compile"
 $GAINROOT chown -R "$RUNUSER" "$WORKDIR/compile"
@@ -122,17 +118,17 @@ chmod -R +x "$COMPILE_SCRIPT"
 mkdir -p "$RUNDIR/work"; chmod 777 "$RUNDIR/work"
 mkdir -p "$RUNDIR/work/judge"; chmod 777 "$RUNDIR/work/judge"
 mkdir -p "$RUNDIR/work/compile"; chmod 777 "$RUNDIR/work/compile"
-mkdir -p "$RUNDIR/merged"; chmod 777 "$RUNDIR/merged"
 mkdir -p "$RUNDIR/ofs"; chmod 777 "$RUNDIR/ofs"
-$GAINROOT mount -t overlay overlay -olowerdir="$CHROOTDIR",upperdir="$RUNDIR/work",workdir="$RUNDIR/ofs" "$RUNDIR/merged"
-$GAINROOT mount --bind "$WORKDIR/compile" "$RUNDIR/merged/judge"
-$GAINROOT mount --bind -o ro "$COMPILE_SCRIPT" "$RUNDIR/merged/compile"
-
-chroot_start "$CHROOTDIR" "$RUNDIR/merged"
+# 和 standard 评测脚本一样由 runguard 在编译器的挂载命名空间中挂载，运行结束后由内核自动卸载
+SANDBOX_OPT=(
+    --overlay "/:lowerdir=$CHROOTDIR,upperdir=$RUNDIR/work,workdir=$RUNDIR/ofs"
+    --bind "$WORKDIR/compile:/judge"
+    --bind-ro "$COMPILE_SCRIPT:/compile"
+)
 
 # 调用 runguard 来执行编译命令
 runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT -c \
-        --root "$RUNDIR/merged" \
+        "${SANDBOX_OPT[@]}" \
         --work /judge \
         --user "$RUNUSER" \
         --group "$RUNGROUP" \
@@ -144,12 +140,23 @@ runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT -c \
         $ENVIRONMENT_VARS -- \
         "/compile/run" run "$@"
 
-chroot_stop "$CHROOTDIR" "$RUNDIR/merged"
+# 内存检查需要的 sanitizer 版本单独编译，选手程序编译失败时没有必要再编译
+if [ -n "$SANITIZE" ] && [ -x "$WORKDIR/compile/run" ]; then
+    runcheck $GAINROOT "$RUNGUARD" ${DEBUG:+-v} $CPUSET_OPT -c \
+            "${SANDBOX_OPT[@]}" \
+            --work /judge \
+            --user "$RUNUSER" \
+            --group "$RUNGROUP" \
+            --memory-limit "$SCRIPTMEMLIMIT" \
+            --cpu-time "$SCRIPTTIMELIMIT" \
+            --standard-output-file compile-sanitizer.tmp \
+            --standard-error-file compile-sanitizer.tmp \
+            --out-meta compile-sanitizer.meta \
+            $ENVIRONMENT_VARS -V "SANITIZE=$SANITIZE" -- \
+            "/compile/run" run.asan "$@"
+fi
 
-# 删除挂载点，因为我们已经确保有用的数据在 $WORKDIR/compile 中，因此删除挂载点即可。
-force_umount "$RUNDIR/merged/judge"
-force_umount "$RUNDIR/merged/compile"
-force_umount "$RUNDIR/merged"
+# 有用的数据都已经在 $WORKDIR/compile 中，沙箱的挂载点随 runguard 退出自动卸载，只需要删除 overlayfs 的文件夹
 rm -rf "$RUNDIR"
 
 $GAINROOT chown -R "$(id -un):" "$WORKDIR/compile"
@@ -195,5 +202,15 @@ if [ ! -f run ] || [ ! -x run ]; then
     cleanexit ${E_COMPILER_ERROR:--1}
 fi
 
+# sanitizer 版本编译失败时不影响普通测试点，删除 run.asan 后由评测客户端将内存检查的测试点标记为失败，
+# 编译器输出保留在 compile-sanitizer.tmp 中
+if [ -n "$SANITIZE" ]; then
+    if [ ! -s compile-sanitizer.meta ] || [ ! -x run.asan ] || ! grep -q '^exitcode: 0$' compile-sanitizer.meta; then
+        echo "Sanitizer build failed, memory check test cases will not run."
+        rm -f run.asan
+        touch compile-sanitizer.tmp
+    fi
+fi
+
 cat compile.tmp
 cleanexit 0
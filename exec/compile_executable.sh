@@ -51,7 +51,7 @@ shift $((OPTIND-1))
 [ "$1" == "--" ] && shift
 
 if [ -n "$CPUSET" ]; then
-    CPUSET_OPT="-P $CPUSET"
+    CPUSET_OPT="-P $CPUSET --reuse-cgroup"
 fi
 
 LOGLEVEL=$LOG_DEBUG
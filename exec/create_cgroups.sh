@@ -11,6 +11,26 @@ error() { echo "$*" 1>&2; exit 1; }
 JUDGEHOSTUSER=$1; shift
 CGROUPBASE=/sys/fs/cgroup
 
+# cgroup v2（unified hierarchy）：所有控制器挂载在同一个目录下，runguard 直接读写 cgroupfs，
+# 只需要创建 judger 并为它的子 cgroup 开启需要的控制器
+if [ "$(stat -fc %T $CGROUPBASE)" == "cgroup2fs" ]; then
+    for i in cpu cpuset memory pids; do
+        if ! grep -qw $i $CGROUPBASE/cgroup.controllers; then
+            error "Error: cgroup v2 controller $i is not available. Unable to continue."
+        fi
+    done
+
+    echo "+cpu +cpuset +memory +pids" > $CGROUPBASE/cgroup.subtree_control
+    mkdir -p $CGROUPBASE/judger
+    echo "+cpu +cpuset +memory +pids" > $CGROUPBASE/judger/cgroup.subtree_control
+
+    if [ ! -f $CGROUPBASE/judger/memory.swap.max ]; then
+        echo "Warning: memory.swap.max is missing, add 'swapaccount=1' to GRUB_CMDLINE_LINUX_DEFAULT to disable swap for judged programs" >&2
+    fi
+    chown -R $JUDGEHOSTUSER $CGROUPBASE/judger
+    exit 0
+fi
+
 for i in cpuset memory; do
     mkdir -p $CGROUPBASE/$i
     if [ ! -d $CGROUPBASE/$i/ ]; then
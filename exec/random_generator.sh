@@ -70,7 +70,7 @@ shift $((OPTIND-1))
 [ "$1" == "--" ] && shift
 
 if [ -n "$CPUSET" ]; then
-    CPUSET_OPT="-P $CPUSET"
+    CPUSET_OPT="-P $CPUSET --reuse-cgroup"
 fi
 
 MEMLIMIT_OPT=""
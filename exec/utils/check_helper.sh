@@ -24,6 +24,14 @@
 #   SCRIPTMEMLIMIT  比较脚本运行内存限制
 #   SCRIPTTIMELIMIT 比较脚本执行时间
 #   SCRIPTFILELIMIT 比较脚本输出限制
+#
+# 可选环境变量：
+#   CACHEDIR        题目的缓存文件夹，检查脚本可以在这里缓存和提交无关的中间结果
+#   INSTRUCTIONRATE 评测机每秒执行的指令数（由 exec/calibrate_instructions.sh 测得），
+#                   设置后选手程序按指令数判断是否超时
+#   TIMELINEINTERVAL 选手程序资源使用的采样间隔（毫秒），设置后 runguard 将时间线写入 program.timeline
+#   RUNGUARD_SUPERVISOR 常驻的 runguard supervisor 的 socket，设置后 runguard 将运行请求转发给 supervisor
+#   COMPARECPUSET   比较程序使用的 CPU 集合（超线程兄弟核心），不设置时和选手程序使用相同的核心
 
 set -e
 trap 'cleanup ; error' EXIT
@@ -59,7 +67,7 @@ OPTINT=1
 while getopts "n:w" opt; do
     case $opt in
         n)
-            OPTSET="$OPTARG"
+            CPUSET="$OPTARG"
             ;;
         w)
             OPTTIME="--wall-time"
@@ -75,7 +83,12 @@ shift $((OPTIND-1))
 
 CPUSET_OPT=""
 if [ -n "$CPUSET" ]; then
-    CPUSET_OPT="-P $CPUSET"
+    CPUSET_OPT="-P $CPUSET --reuse-cgroup"
+fi
+
+COMPARE_CPUSET_OPT="$CPUSET_OPT"
+if [ -n "$COMPARECPUSET" ]; then
+    COMPARE_CPUSET_OPT="-P $COMPARECPUSET --reuse-cgroup"
 fi
 
 MEMLIMIT_OPT=""
@@ -115,6 +128,29 @@ COMPARE_SCRIPT="$1"; shift
 SOURCE_FILES="$1"; shift
 ASSIST_FILES="$1"; shift
 
+# 将 %d:%d 格式的时间限制的两部分都乘上 $2
+scale_timelimit ()
+{
+    awk -v limit="$1" -v factor="$2" 'BEGIN {
+        n = split(limit, parts, ":")
+        if (n < 2) parts[2] = parts[1]
+        printf "%.10g:%.10g\n", parts[1] * factor, parts[2] * factor
+    }'
+}
+
+# 按指令数评测时，满载下不稳定的 CPU 时间和墙上时间只用来防止选手程序阻塞，放宽为原来的 3 倍
+INSTRUCTION_OPT=""
+PROG_TIMELIMIT="$TIMELIMIT"
+if [ -n "$INSTRUCTIONRATE" ]; then
+    INSTRUCTION_OPT="--instruction-limit $(scale_timelimit "$TIMELIMIT" "$INSTRUCTIONRATE")"
+    PROG_TIMELIMIT=$(scale_timelimit "$TIMELIMIT" 3)
+fi
+
+TIMELINE_OPT=""
+if [ -n "$TIMELINEINTERVAL" ]; then
+    TIMELINE_OPT="--timeline program.timeline --timeline-interval $TIMELINEINTERVAL"
+fi
+
 if [ ! -d "$WORKDIR" ] || [ ! -w "$WORKDIR" ] || [ ! -x "$WORKDIR" ]; then
     error "Working directory does not exist: $WORKDIR"
 fi
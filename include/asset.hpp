@@ -1,7 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <memory>
+#include <utility>
+#include <vector>
+#include "common/compression.hpp"
 
 namespace judge {
 
@@ -54,6 +58,11 @@ struct text_asset : public asset {
 
 /**
  * @brief 从远程下载的资源文件（只支持 GET 请求下载）
+ * 下载的文件保存在 blob_store 中，目标文件夹中的文件是它的拷贝，参见 fetch_assets 的 shared 参数
+ *
+ * 远程文件可以压缩传输，压缩格式由 URL 的后缀决定：
+ * 1. URL 以 .zst、.gz、.xz 结尾而 name 没有这个后缀时，边下载边解压，保存为 name；
+ * 2. URL 以 .tar、.tar.gz、.tgz、.tar.zst、.tar.xz 结尾时是数据包，解压到目标文件夹中，name 为数据包的文件名。
  */
 struct remote_asset : public asset {
     std::string url;
@@ -61,9 +70,33 @@ struct remote_asset : public asset {
     remote_asset(const std::string &name, const std::string &url_get);
 
     void fetch(const std::filesystem::path &dir) override;
+
+    /**
+     * @brief 需要边下载边解压的压缩格式，不需要解压时为 NONE
+     */
+    compression encoding() const;
+
+    /**
+     * @brief 是否是需要解压到目标文件夹中的数据包
+     */
+    bool is_archive() const;
 };
 
 typedef std::shared_ptr<asset> asset_ptr;
 typedef std::unique_ptr<asset> asset_uptr;
 
+/**
+ * @brief 获取一组资源文件，其中的远程文件通过 downloader 复用连接同时下载
+ * 比如一组测试数据的所有输入输出文件，避免逐个下载时每个文件都要重新建立连接
+ * @param assets 资源文件，以及要下载到的目录
+ * @param keep_compressed 为真时压缩的远程文件和数据包不解压，以 name 加上压缩后缀（数据包为 name）保存，
+ *        由调用方在使用前通过 decompress_file、extract_archive 解压
+ * @param shared 为真时远程文件是指向 blob_store 的硬链接，只能用于评测过程中只读的文件夹（如标准测试数据），
+ *        否则拷贝到目标文件夹
+ * @param cancelled 不为空时，该标志被置位后放弃还没有完成的下载，参见 downloader::download
+ * @return keep_compressed 为真时保存为压缩文件的路径
+ * @note 该函数会抛出异常，此时其余的文件也已经获取完毕或者放弃
+ */
+std::vector<std::filesystem::path> fetch_assets(const std::vector<std::pair<asset *, std::filesystem::path>> &assets, bool keep_compressed = false, bool shared = false, const std::atomic<bool> *cancelled = nullptr);
+
 }  // namespace judge
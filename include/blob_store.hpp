@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+#include "downloader.hpp"
+
+namespace judge {
+
+/**
+ * @brief 按内容寻址的远程资源文件存储，所有题目共用
+ * 远程文件下载后以内容的 SHA-256 命名保存一份，题目的标准测试数据文件夹中的文件只是指向它的硬链接，
+ * 因此不同题目中相同的输入输出数据只在磁盘上保存一次。其他文件夹（如编译文件夹）会被评测脚本修改权限和所有者，
+ * 甚至被选手程序写入，这些文件夹中的文件是拷贝。
+ * 每个 URL 记录了上次下载得到的文件和服务器给出的 ETag、Last-Modified，
+ * 题目更新后缓存文件夹被清空，重新获取文件时只发送条件请求，服务器确认文件没有修改时直接链接已有的文件，
+ * 因此修改了题目的一个文件只会重新下载这一个文件。
+ *
+ * root (CACHE_DIR/.blobs)
+ * ├── objects
+ * │   └── 3f // SHA-256 的前两位
+ * │       └── 3fa1... // 以文件内容的 SHA-256 命名的文件
+ * ├── urls
+ * │   └── 9c
+ * │       └── 9c2e... // 以 URL 的 SHA-256 命名，依次记录文件内容的 SHA-256、ETag、Last-Modified、URL
+ * │                   // 边下载边解压的 URL 保存的是解压后的内容，和不解压时分开记录
+ * ├── tmp // 正在下载的文件，下载完成后移动到 objects
+ * └── .lock // 获取文件时持有共享锁，回收不再使用的文件时持有独占锁
+ *
+ * @note objects 中的文件一旦写入就不再修改，通过硬链接使用这些文件时不能原地修改文件内容，
+ *       写入可能是硬链接的文件前必须先删除该文件
+ */
+struct blob_store {
+    /**
+     * @brief URL 对应的文件
+     */
+    struct url_entry {
+        /**
+         * @brief 文件内容的 SHA-256，十六进制小写
+         */
+        std::string hash;
+
+        cache_validators validators;
+    };
+
+    /**
+     * @brief 要获取的一个远程文件
+     */
+    struct request {
+        std::string url;
+
+        /**
+         * @brief 要保存到的路径
+         */
+        std::filesystem::path target;
+
+        /**
+         * @brief 不为 NONE 时边下载边解压，保存解压后的内容
+         */
+        compression decode = compression::NONE;
+
+        /**
+         * @brief 为真时 target 硬链接到存储中的文件，否则拷贝
+         * 只有评测过程中对选手程序和评测脚本只读的文件夹（如标准测试数据）才能使用硬链接，
+         * 否则对 target 的 chmod、chown 或写入会修改所有题目共用的文件
+         */
+        bool shared = false;
+    };
+
+    explicit blob_store(const std::filesystem::path &root);
+
+    /**
+     * @brief 位于 CACHE_DIR/.blobs 的全局存储
+     */
+    static blob_store &global();
+
+    /**
+     * @brief 查找 URL 上次下载得到的文件
+     * @param decode 下载时是否解压，参见 request::decode
+     * @return 有记录且对应的文件仍然存在时返回真
+     */
+    bool lookup(const std::string &url, url_entry &entry, compression decode = compression::NONE) const;
+
+    /**
+     * @brief 记录 URL 对应的文件，覆盖之前的记录
+     */
+    void record(const std::string &url, const url_entry &entry, compression decode = compression::NONE);
+
+    /**
+     * @brief 将文件移动到存储中，已经有相同内容的文件时删除该文件
+     * @param file 必须和存储位于同一个文件系统，一般是 temp_path 返回的路径
+     * @return 文件内容的 SHA-256
+     */
+    std::string put(const std::filesystem::path &file);
+
+    std::filesystem::path blob_path(const std::string &hash) const;
+
+    /**
+     * @brief 获得一个不重复的临时文件路径，用于下载
+     */
+    std::filesystem::path temp_path() const;
+
+    /**
+     * @brief 获取一组远程文件并链接或拷贝到指定路径
+     * 有记录的 URL 发送条件请求，服务器返回 304 时不重新下载
+     * @param engine 下载引擎
+     * @param files 要获取的文件
+     * @param cancelled 不为空时，该标志被置位后放弃还没有完成的下载，参见 downloader::download
+     * @throw network_error 任意一个文件下载失败或者被放弃，此时其余的下载也已经结束
+     */
+    void fetch(downloader &engine, const std::vector<request> &files, const std::atomic<bool> *cancelled = nullptr);
+
+    /**
+     * @brief 将存储中的文件硬链接到 target，无法硬链接时（如超过硬链接数上限）拷贝
+     */
+    static void link(const std::filesystem::path &blob, const std::filesystem::path &target);
+
+    /**
+     * @brief 将存储中的文件拷贝到 target，拷贝得到的文件可以被修改
+     */
+    static void copy(const std::filesystem::path &blob, const std::filesystem::path &target);
+
+    /**
+     * @brief 回收不再使用的文件
+     * 删除没有硬链接指向、且最后一个硬链接被删除超过 grace 的文件，以及下载中断残留的临时文件和指向已删除文件的 URL 记录。
+     * 题目更新时缓存文件夹被清空，grace 保证重新获取文件时没有修改的文件仍然存在。
+     * @param interval 距离上一次回收不足 interval 时直接返回
+     * @param grace 文件不再使用后至少保留的时间
+     * @return 真如果执行了回收
+     * @note 有其他 worker 或评测进程正在获取文件时跳过本次回收
+     */
+    bool collect(std::chrono::seconds interval, std::chrono::seconds grace);
+
+private:
+    std::filesystem::path root;
+
+    /**
+     * @brief 下一次允许回收的时间，以 steady_clock 的秒数计
+     */
+    std::atomic<std::int64_t> next_collect = 0;
+};
+
+/**
+ * @brief 计算文件内容的 SHA-256
+ * @return 十六进制小写的 SHA-256
+ */
+std::string sha256_file(const std::filesystem::path &file);
+
+}  // namespace judge
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace judge {
+
+/**
+ * @brief 远程文件的压缩格式，由 URL 的后缀决定
+ */
+enum class compression {
+    NONE,
+    GZIP,  // .gz
+    ZSTD,  // .zst
+    XZ     // .xz
+};
+
+/**
+ * @brief 根据 URL 或文件名的后缀判断压缩格式，忽略 URL 的查询字符串
+ */
+compression compression_of(const std::string &url);
+
+/**
+ * @brief 压缩格式对应的文件后缀，如 ".zst"，NONE 返回空字符串
+ */
+std::string compression_suffix(compression type);
+
+/**
+ * @brief 判断 URL 或文件名是否是测试数据包，即 .tar、.tar.gz、.tgz、.tar.zst、.tar.xz
+ */
+bool is_archive(const std::string &url);
+
+/**
+ * @brief 流式解压器，输入可以任意切分，解压出的数据立即写入文件，不在内存中保存完整的文件
+ */
+struct decompressor {
+    virtual ~decompressor() = default;
+
+    /**
+     * @brief 解压一段压缩数据并写入 out
+     * @throw judge_exception 压缩数据格式错误或者写入失败
+     */
+    virtual void write(const void *data, size_t size, FILE *out) = 0;
+
+    /**
+     * @brief 压缩数据已经全部输入
+     * @throw judge_exception 压缩数据不完整
+     */
+    virtual void finish() = 0;
+};
+
+/**
+ * @brief 创建对应压缩格式的流式解压器
+ * @param type 不能为 NONE
+ */
+std::unique_ptr<decompressor> make_decompressor(compression type);
+
+/**
+ * @brief 将压缩文件流式解压到 to
+ * @throw judge_exception 解压失败
+ */
+void decompress_file(const std::filesystem::path &from, const std::filesystem::path &to, compression type);
+
+/**
+ * @brief 将测试数据包解压到文件夹中
+ * 只解压普通文件和文件夹，数据包中包含链接、设备文件或者会解压到 dir 之外的路径时拒绝解压
+ * @throw judge_exception 解压失败或者数据包不安全
+ */
+void extract_archive(const std::filesystem::path &archive, const std::filesystem::path &dir);
+
+}  // namespace judge
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+namespace judge {
+
+/**
+ * @brief 查询 CPU 核心所在的 NUMA 节点
+ * 拓扑来自 /sys/devices/system/cpu/cpu<N>/node<M>，和 runguard 设置 cpuset.mems 时使用的相同
+ * @return 节点编号，内核没有开启 NUMA 支持时返回 0，即所有核心都属于同一个节点
+ */
+int numa_node_of_cpu(std::size_t cpu);
+
+/**
+ * @brief 让当前线程优先从指定的 NUMA 节点分配内存
+ * 线程写入的页缓存（包括拷贝到 DATA_DIR 的测试数据）也会分配在该节点上，
+ * 节点内存不足时仍可以从其他节点分配。设置失败时只记录日志
+ */
+void prefer_numa_node(int node);
+
+/**
+ * @brief 让当前线程分配的内存轮流分布在所有在线的 NUMA 节点上
+ * 用于后台线程写入的、之后可能被任意节点的 worker 读取的数据（如预取的测试数据的页缓存），
+ * 避免这些数据集中在一个节点上。只有一个节点或者设置失败时不做任何事
+ */
+void interleave_numa_nodes();
+
+}  // namespace judge
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace judge {
+
+/**
+ * @brief 超线程（SMT）兄弟核心的使用策略
+ * 同一物理核心上的两个逻辑核心同时运行选手程序时，运行时间会波动 20%~40%，
+ * 临界的测试点可能在 Accepted 和 Time Limit Exceeded 之间来回变化
+ */
+enum class smt_policy {
+    ALL,        // 每个逻辑核心一个 worker，不考虑超线程
+    EXCLUSIVE,  // 每个物理核心一个 worker，兄弟核心保持空闲
+    SHARED      // 每个物理核心一个 worker，兄弟核心只用于编译、比较等对运行时间不敏感的任务
+};
+
+/**
+ * @brief 查询 CPU 核心的超线程兄弟核心，不包括 cpu 本身
+ * 来自 /sys/devices/system/cpu/cpu<N>/topology/thread_siblings_list，没有开启超线程时为空
+ */
+std::set<std::size_t> smt_siblings_of_cpu(std::size_t cpu);
+
+/**
+ * @brief 按照策略从 --cores 中选出运行 worker 的核心
+ * 同一物理核心上编号最小的逻辑核心运行 worker。SHARED 策略下同时登记 worker 的兄弟核心，
+ * 供 auxiliary_cpuset 使用；不在 cores 中的兄弟核心不会被使用。必须在启动 worker 之前调用
+ */
+std::vector<std::size_t> select_worker_cores(const std::set<unsigned> &cores, smt_policy policy);
+
+/**
+ * @brief 对运行时间不敏感的任务（编译、比较、生成随机数据）应该使用的 CPU 核心
+ * SHARED 策略下返回 execcpuset 中核心的兄弟核心，其他情况返回 execcpuset 本身
+ * @param execcpuset 评测任务分配到的核心，如 "0,2"
+ */
+std::string auxiliary_cpuset(const std::string &execcpuset);
+
+}  // namespace judge
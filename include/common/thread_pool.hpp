@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "common/concurrent_queue.hpp"
+
+namespace judge {
+
+/**
+ * @brief 固定线程数的线程池，任务按提交的顺序执行
+ * 用于把阻塞的 IO（如下载测试数据）移出评测 worker，worker 的核心只用来运行选手程序
+ */
+struct thread_pool {
+    /**
+     * @param threads 线程数，至少为 1
+     * @param init 每个线程开始执行任务之前调用，如设置线程的内存分配策略
+     */
+    explicit thread_pool(std::size_t threads, std::function<void()> init = {});
+
+    /**
+     * @brief 执行完队列中已有的任务后结束所有线程
+     */
+    ~thread_pool();
+
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    /**
+     * @brief 提交一个任务
+     * @return 任务结束时就绪，任务抛出的异常由 get() 重新抛出
+     */
+    std::future<void> submit(std::function<void()> task);
+
+private:
+    void loop(std::function<void()> init);
+
+    // 空任务表示线程应当退出
+    concurrent_queue<std::shared_ptr<std::packaged_task<void()>>> tasks;
+    std::vector<std::thread> threads;
+};
+
+}  // namespace judge
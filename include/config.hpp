@@ -31,6 +31,26 @@ extern int SCRIPT_TIME_LIMIT;
 
 extern int SCRIPT_FILE_LIMIT;
 
+/**
+ * @brief 下载远程资源文件（如测试数据）的最大并发连接数，参见 downloader
+ */
+extern int DOWNLOAD_CONCURRENCY;
+
+/**
+ * @brief 下载远程资源文件失败后的重试次数
+ */
+extern int DOWNLOAD_RETRIES;
+
+/**
+ * @brief 下载远程资源文件时建立连接或者传输停滞的超时时间，单位为秒
+ */
+extern int DOWNLOAD_TIMEOUT;
+
+/**
+ * @brief 在后台预取标准测试数据的线程数，为 0 时不预取，测试点评测时才下载测试数据
+ */
+extern int PREFETCH_THREADS;
+
 /**
  * @brief 存放 executable 的路径，为项目根目录下的 exec 文件夹
  * 这个只是用来在无法查找到服务器提供的 executable 时的 fallback
@@ -71,6 +91,7 @@ extern std::filesystem::path EXEC_DIR;
  * │       │   │   └── output // 当前测试数据组的输出数据文件夹
  * │       │   └── ...
  * │       ├── compare // 比较器
+ * │       ├── oclint // 静态测试对每个源文件的分析结果，以文件内容、头文件和规则配置的哈希值命名
  * │       ├── random // 随机数据生成器的缓存目录（代码和可执行文件）
  * │       └── random_data // 随机输入输出数据的缓存目录
  * │           ├── 0 // 第 0 组随机测试数据，该文件夹内的测试数据可以被随机复用
@@ -80,12 +101,14 @@ extern std::filesystem::path EXEC_DIR;
  * │           │   ├── 1 // 该组测试数据生成并缓存的第 1 组测试数据
  * │           │   │   ├── input // 当前测试数据组的输入数据文件夹
  * │           │   │   └── output // 当前测试数据组的输出数据文件夹
- * │           │   └── ...
+ * │           │   ├── ...
+ * │           │   └── .slots // 每组缓存数据的生成状态，参见 random_data_slots
  * │           ├── 1 // 第 1 组随机测试数据
  * │           │   └── ...
  * │           └── ...
  * ├── moj
- * └── mcourse
+ * ├── mcourse
+ * └── .blobs // 所有题目共用的远程文件存储，标准测试数据是指向其中文件的硬链接，参见 blob_store
  */
 extern std::filesystem::path CACHE_DIR;
 
@@ -107,6 +130,12 @@ extern std::filesystem::path DATA_DIR;
  */
 extern bool USE_DATA_DIR;
 
+/**
+ * @brief 是否将压缩传输的标准测试数据以压缩的形式保存在 CACHE_DIR 中
+ * 启用时评测到对应的测试点才将测试数据解压到 DATA_DIR，减少大题目占用的磁盘空间，需要启用 DATA_DIR
+ */
+extern bool KEEP_COMPRESSED_DATA;
+
 /**
  * @brief 选手程序编译及运行的根目录
  * RUN_DIR 的文件结构如下：
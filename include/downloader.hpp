@@ -0,0 +1,161 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <atomic>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "common/compression.hpp"
+
+namespace judge {
+
+/**
+ * @brief downloader 的配置，评测系统使用 config.hpp 中的 DOWNLOAD_* 配置
+ */
+struct download_options {
+    /**
+     * @brief 最多同时建立的连接数，同一台服务器的下载也受这个限制，超出的下载排队等待空闲连接
+     */
+    unsigned concurrency = 8;
+
+    /**
+     * @brief 下载失败（连接失败、超时、服务器返回 5xx、408、429）后的重试次数
+     */
+    unsigned retries = 2;
+
+    /**
+     * @brief 建立连接或者传输停滞超过该秒数时放弃本次尝试
+     */
+    long timeout = 30;
+};
+
+/**
+ * @brief 服务器为一次响应提供的缓存校验信息，再次下载时作为条件请求发送
+ */
+struct cache_validators {
+    /**
+     * @brief 响应头中的 ETag，条件请求时作为 If-None-Match 发送
+     */
+    std::string etag;
+
+    /**
+     * @brief 响应头中的 Last-Modified，条件请求时原样作为 If-Modified-Since 发送
+     */
+    std::string last_modified;
+
+    bool empty() const;
+};
+
+/**
+ * @brief 一次下载的结果
+ */
+struct download_result {
+    /**
+     * @brief 条件请求得到 304 Not Modified 时为假，此时目标文件不存在
+     */
+    bool modified = true;
+
+    /**
+     * @brief 服务器返回的缓存校验信息，304 响应没有给出时沿用请求时的校验信息
+     */
+    cache_validators validators;
+};
+
+/**
+ * @brief 基于 curl multi 的下载引擎
+ * 所有下载由一个后台线程通过同一个 multi handle 驱动，multi handle 持有连接缓存，
+ * 对同一台服务器的请求复用已经建立的 TCP/TLS 连接（HTTP keep-alive，支持时使用 HTTP/2 多路复用），
+ * 一组文件可以同时下载，而不是每个文件都重新握手、逐个下载。
+ */
+struct downloader {
+    explicit downloader(const download_options &options);
+
+    /**
+     * @brief 放弃还没有完成的下载并结束后台线程
+     */
+    ~downloader();
+
+    downloader(const downloader &) = delete;
+    downloader &operator=(const downloader &) = delete;
+
+    /**
+     * @brief 使用 DOWNLOAD_* 配置的全局下载引擎，所有评测线程共用连接缓存
+     */
+    static downloader &global();
+
+    /**
+     * @brief 异步下载一个文件，文件所在的文件夹会被创建
+     * @param url 只支持 GET 请求的地址
+     * @param file 要保存到的文件，重试时会覆盖上一次尝试写入的内容
+     * @param known 本地已有版本的缓存校验信息，非空时发送条件请求，服务器确认没有修改时不传输文件内容
+     * @param decode 远程文件的压缩格式，不为 NONE 时边下载边解压，file 保存的是解压后的内容
+     * @param cancelled 不为空时，该标志被置位后放弃下载：正在进行的传输在 curl 下一次进度回调时（至多约 1 秒）中止，
+     *        排队和等待重试的下载不再开始。标志必须在下载结束前保持有效
+     * @return 下载完成时就绪；下载失败或者被放弃时 get() 抛出 network_error
+     */
+    std::future<download_result> download(const std::string &url, const std::filesystem::path &file,
+                                          const cache_validators &known = {}, compression decode = compression::NONE,
+                                          const std::atomic<bool> *cancelled = nullptr);
+
+    /**
+     * @brief 同时下载一组文件并等待全部结束
+     * @param files 每个文件的地址和要保存到的路径
+     * @throw network_error 任意一个文件下载失败，此时其余的下载也已经结束
+     */
+    void download_all(const std::vector<std::pair<std::string, std::filesystem::path>> &files);
+
+private:
+    struct transfer;
+
+    void loop();
+
+    /**
+     * @brief 开始一次尝试，打开（截断）目标文件并将 easy handle 加入 multi handle
+     */
+    void start(transfer &t);
+
+    /**
+     * @brief 处理一次尝试的结果，需要重试时安排下一次尝试
+     */
+    void finish(transfer &t, CURLcode code);
+
+    /**
+     * @brief 唤醒在 wait 中等待的后台线程
+     */
+    void wakeup();
+
+    /**
+     * @brief 等待 socket 事件、wakeup 或者超时
+     */
+    void wait(int timeout_ms);
+
+    download_options options;
+
+    CURLM *multi;
+
+    // libcurl 7.68 之前没有 curl_multi_wakeup，通过自管道唤醒 curl_multi_wait
+    int wakeup_pipe[2] = {-1, -1};
+
+    std::mutex pending_mutex;
+
+    // 由调用方加入、还没有交给后台线程的下载
+    std::vector<std::unique_ptr<transfer>> pending;
+
+    // 后台线程持有的下载，包括正在进行的和等待重试的
+    std::list<std::unique_ptr<transfer>> transfers;
+
+    // 正在进行的下载数，不超过 options.concurrency
+    unsigned active = 0;
+
+    bool stopping = false;
+
+    std::thread worker;
+};
+
+}  // namespace judge
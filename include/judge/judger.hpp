@@ -41,6 +41,14 @@ struct judger {
      */
     virtual void judge(const message::client_task &task, concurrent_queue<message::client_task> &task_queue, const std::string &execcpuset) const = 0;
 
+    /**
+     * @brief worker 没有评测任务可做时调用，执行一个低优先级的后台任务
+     * 后台任务不属于任何提交，比如预生成随机测试数据
+     * @param execcpuset 当前 worker 可以使用哪些 cpu 核心
+     * @return true 若执行了后台任务
+     */
+    virtual bool run_background_task(const std::string &execcpuset) const;
+
     /**
      * @brief 注册评测结束的事件回调函数
      * 这些回调函数会在一个提交评测结束后被调用，通常是回收内存以及返回提交结果
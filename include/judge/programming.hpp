@@ -1,14 +1,22 @@
 #pragma once
 
 #include <any>
+#include <atomic>
 #include <boost/rational.hpp>
+#include <condition_variable>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
 #include "common/concurrent_queue.hpp"
 #include "common/io_utils.hpp"
 #include "common/messages.hpp"
 #include "common/status.hpp"
+#include "common/thread_pool.hpp"
 #include "judge/judger.hpp"
+#include "judge/random_data.hpp"
 #include "judge/submission.hpp"
 #include "program.hpp"
 
@@ -64,6 +72,22 @@ struct judge_task {
         NON_TIME_LIMIT    // 仅在依赖的测试点超出时间限制后才不继续测试
     };
 
+    /**
+     * @brief 表示依赖图中的一条边
+     */
+    struct dependency {
+        /**
+         * @brief 依赖的测试点在 submission.judge_tasks 中的下标
+         * 在 programming_submission::children 中表示子测试点的下标
+         */
+        int task;
+
+        /**
+         * @brief 这条边的依赖条件
+         */
+        dependency_condition condition = dependency_condition::ACCEPTED;
+    };
+
     /**
      * @brief 本测试点的类型，提供给 judge_server 来区分测试类型
      * 一道题的评测可以包含多种评测类型
@@ -90,7 +114,8 @@ struct judge_task {
     /**
      * @brief 本测试点使用的 run script
      * 不同的测试点可能有不同的 run script
-     * 对于 MemoryCheck，需要选择 valgrind
+     * 对于 MemoryCheck，需要选择 valgrind 或 sanitizer，选择 sanitizer 时
+     * 编译任务会额外编译一个启用 AddressSanitizer 的可执行文件
      * 对于 GTestCheck，需要选择 gtest
      */
     std::string run_script;
@@ -98,7 +123,7 @@ struct judge_task {
     /**
      * @brief 本测试点使用的比较脚本
      * 为空时表示使用提交自带的脚本，也就是 submission.compare
-     * 对于 MemoryCheck，需要选择 valgrind
+     * 对于 MemoryCheck，需要选择与 run script 相同的 valgrind 或 sanitizer
      * 对于 GTestCheck，需要选择 gtest
      */
     std::string compare_script;
@@ -148,6 +173,14 @@ struct judge_task {
      */
     dependency_condition depends_cond = dependency_condition::ACCEPTED;
 
+    /**
+     * @brief 除 depends_on 以外本测试点依赖的其他测试点，每条依赖有自己的依赖条件
+     * 本测试点在所有依赖的测试点都满足各自的依赖条件后才执行，任意一个不满足时
+     * 本测试点为 DEPENDENCY_NOT_SATISFIED。比如内存测试可以同时依赖编译测试和某个标准测试。
+     * 测试数据只会复用 depends_on 指向的测试点的数据。
+     */
+    std::vector<dependency> dependencies;
+
     /**
      * @brief 内存限制，限制应用程序实际最多能申请多少内存空间
      * @note 单位为 KB，小于 0 的数表示不限制内存空间申请
@@ -187,6 +220,20 @@ struct judge_task {
      * @brief 该评测点所需要的核心数
      */
     size_t cores = 1;
+
+    /**
+     * @brief GTest 评测任务（run script 和 compare script 均为 gtest）拆分的分片数
+     * 为 0 时根据测试数量和空闲的核心数自动选择，为 1 时不拆分
+     */
+    size_t shards = 0;
+
+    /**
+     * @brief 选手程序资源使用的采样间隔
+     * 大于 0 时 runguard 按此间隔记录选手程序的内存、CPU 时间、缺页、上下文切换和读写量，
+     * 降采样后以 timeline 附加到评测报告中，目前仅 standard 和 standard-trusted 检查脚本支持
+     * @note 单位为毫秒，不小于 1，为 0 时不采样
+     */
+    double timeline_interval = 0;
 };
 
 struct judge_task_result {
@@ -257,6 +304,106 @@ struct judge_task_result {
     std::filesystem::path data_dir;
 };
 
+/**
+ * @brief 表示一个题目级程序的内部编译任务
+ * 随机数据生成器、标准程序、比较器是题目的程序，和选手程序的编译互不依赖，
+ * 而且通常已经被同一题目的其他提交编译并缓存过了。因此这些程序的编译被拆分
+ * 成独立的编译任务，在空闲的核心上和选手程序的编译并行执行。
+ *
+ * 内部编译任务不出现在 judge_tasks 和 results 中，不会汇报给 judge_server。
+ * 分发给 worker 的 client_task.id 为 judge_tasks.size() + 编译任务下标。
+ */
+struct build_task {
+    enum class artifact_type {
+        RANDOM,    // 随机数据生成器，对应 submission.random
+        STANDARD,  // 标准程序，对应 submission.standard
+        COMPARE    // 比较器，对应 submission.compare
+    };
+
+    /**
+     * @brief 本编译任务负责编译哪个程序
+     */
+    artifact_type artifact;
+
+    /**
+     * @brief 编译结果，编译完成之前为 PENDING
+     * 编译失败时，需要该程序的评测任务将继承此结果的状态和错误信息
+     */
+    judge_task_result result;
+};
+
+/**
+ * @brief 表示 GTest 评测任务的一个分片
+ * 测试数量较多的 GTest 评测任务会被拆分成多个分片，每个分片通过 GTEST_TOTAL_SHARDS
+ * 和 GTEST_SHARD_INDEX 环境变量只运行一部分测试，作为内部评测任务分发到不同的核心上。
+ * 所有分片完成后，各分片的报告合并为原评测任务的评测结果，报告格式和不拆分时相同。
+ *
+ * 分片不出现在 judge_tasks 和 results 中，分发给 worker 的 client_task.id
+ * 为 judge_tasks.size() + build_tasks.size() + 分片下标。
+ */
+struct gtest_shard {
+    /**
+     * @brief 分片所属的评测任务在 judge_tasks 中的下标
+     */
+    std::size_t task;
+
+    /**
+     * @brief 分片编号，对应 GTEST_SHARD_INDEX
+     */
+    std::size_t index;
+
+    /**
+     * @brief 所属评测任务的分片总数，对应 GTEST_TOTAL_SHARDS
+     */
+    std::size_t total;
+
+    /**
+     * @brief 分片的评测结果，评测完成之前为 PENDING
+     */
+    judge_task_result result;
+};
+
+/**
+ * @brief 一个提交的标准测试数据后台预取任务，参见 programming_judger::distribute
+ */
+struct test_data_prefetch {
+    /**
+     * @brief 放弃所有预取任务，并等待正在进行的预取任务结束
+     * 正在进行的下载被中止，因此至多等待约 1 秒加上已经下载的文件的解压时间；
+     * 不等待还在线程池队列中的任务，这些任务开始时发现已经放弃，不会再访问提交
+     */
+    ~test_data_prefetch();
+
+    /**
+     * @brief 放弃所有预取任务，中止正在进行的下载，不等待预取任务结束
+     * 提交编译失败或者评测结束后不再需要测试数据
+     */
+    void cancel();
+
+    /**
+     * @brief 放弃标志，预取任务要把它传给 fetch_assets，放弃后正在进行的下载才能中止
+     */
+    const std::atomic<bool> &cancelled() const;
+
+    /**
+     * @brief 在线程池中执行一个预取任务，任务开始前已经放弃时直接跳过
+     */
+    void submit(thread_pool &pool, std::function<void()> task);
+
+private:
+    /**
+     * @brief 预取任务和提交共享的状态，提交销毁后仍然被线程池队列中的任务持有
+     */
+    struct state {
+        std::mutex mut;
+        std::condition_variable cv;
+        std::atomic<bool> cancelled = false;
+        std::size_t running = 0;
+    };
+
+    std::shared_ptr<state> shared = std::make_shared<state>();
+};
+
 /**
  * @brief 一个选手代码提交
  */
@@ -306,6 +453,43 @@ struct programming_submission : public submission {
      */
     std::size_t finished = 0;
 
+    /**
+     * @brief 依赖图的邻接表，children[i] 为依赖第 i 个测试点的所有子测试点以及依赖条件
+     * 在 verify 时根据 judge_tasks 构建
+     */
+    std::vector<std::vector<judge_task::dependency>> children;
+
+    /**
+     * @brief 每个测试点还有多少个父测试点没有完成评测，减为 0 时分发该测试点
+     */
+    std::vector<std::size_t> unfinished_parents;
+
+    /**
+     * @brief 题目级程序的内部编译任务
+     */
+    std::vector<build_task> build_tasks;
+
+    /**
+     * @brief 已经完成了多少个内部编译任务
+     * 内部编译任务全部完成前提交不能结束，否则编译任务会访问已经释放的提交
+     */
+    std::size_t build_finished = 0;
+
+    /**
+     * @brief 依赖条件已经满足，但还在等待题目级程序编译完成的评测任务
+     */
+    std::vector<std::size_t> blocked_tasks;
+
+    /**
+     * @brief 已经分发的 GTest 评测任务分片，在评测任务分发时按需追加
+     */
+    std::vector<gtest_shard> gtest_shards;
+
+    /**
+     * @brief 选手程序包含的 GTest 测试数的估计值，由编译任务统计，用于选择分片数
+     */
+    std::size_t gtest_cases = 0;
+
     /**
      * @brief 题目读锁，提交销毁后会自动释放锁
      * 正在评测的提交需要使用读锁锁住题目文件夹以避免题目更新时导致数据错误。
@@ -318,6 +502,13 @@ struct programming_submission : public submission {
      * 防止两个提交的文件发生冲突（rejudge 会导致多个同 sub_id 的提交）
      */
     scoped_file_lock submission_lock;
+
+    /**
+     * @brief 标准测试数据的后台预取任务
+     * 预取任务访问 test_data 并写入题目的缓存文件夹，因此放在最后：提交销毁时最先析构，
+     * 等待预取任务结束之后才释放 test_data 和 problem_lock
+     */
+    test_data_prefetch prefetch;
 };
 
 /**
@@ -331,6 +522,32 @@ struct programming_judger : public judger {
     bool distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const override;
 
     void judge(const message::client_task &task, concurrent_queue<message::client_task> &task_queue, const std::string &execcpuset) const override;
+
+    /**
+     * @brief 在空闲的 worker 上预生成随机测试数据，没有需要生成的数据时回收 blob_store 中不再使用的文件
+     */
+    bool run_background_task(const std::string &execcpuset) const override;
+
+private:
+    /**
+     * @brief 随机测试数据预生成服务，随机数据生成器和标准程序编译完成后开始预生成
+     */
+    mutable random_data_pool random_data;
+
+    /**
+     * @brief 随机数据生成器和标准程序都编译完成后，提交本提交所有随机测试的预生成任务
+     */
+    void schedule_random_data(programming_submission &submit) const;
+
+    /**
+     * @brief 执行题目级程序的内部编译任务，完成后分发等待该程序的评测任务
+     */
+    void judge_build(const message::client_task &task, concurrent_queue<message::client_task> &task_queue, const std::string &execcpuset) const;
+
+    /**
+     * @brief 执行 GTest 评测任务的一个分片，最后完成的分片负责合并报告并统计评测结果
+     */
+    void judge_shard(const message::client_task &task, concurrent_queue<message::client_task> &task_queue, const std::string &execcpuset) const;
 };
 
 }  // namespace judge
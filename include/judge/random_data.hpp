@@ -0,0 +1,226 @@
+#pragma once
+
+#include <condition_variable>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+#include "common/concurrent_queue.hpp"
+#include "program.hpp"
+
+/**
+ * 这个头文件包含随机测试数据的生成逻辑
+ * 包含：
+ * 1. random_data_spec 类（表示一组随机测试数据的生成方式）
+ * 2. random_data_slots 类（一组随机测试的缓存数据编号索引）
+ * 3. random_data_pool 类（在空闲核心上预生成随机测试数据的后台服务）
+ */
+namespace judge {
+
+/**
+ * @brief 表示一组随机测试数据的生成方式
+ * 这个类不引用提交，因此在提交评测结束之后仍然可以用来生成随机测试数据
+ */
+struct random_data_spec {
+    /**
+     * @brief 题目的缓存文件夹，CACHE_DIR / category / prob_id
+     */
+    std::filesystem::path cachedir;
+
+    /**
+     * @brief 题目最后更新时间，题目更新后尚未执行的预生成任务将被丢弃
+     */
+    time_t updated_at;
+
+    /**
+     * @brief 第几组随机测试，参见 judge_task::testcase_id
+     */
+    int testcase_id;
+
+    /**
+     * @brief 已经编译好的随机数据生成器的运行路径
+     */
+    std::filesystem::path random_path;
+
+    /**
+     * @brief 已经编译好的标准程序的运行路径
+     */
+    std::filesystem::path standard_path;
+
+    /**
+     * @brief 运行标准程序使用的 run script
+     */
+    std::string run_script;
+
+    /**
+     * @brief 提供 run script 的 executable_manager，由 judge_server 持有
+     */
+    const executable_manager *exec_mgr;
+
+    /**
+     * @brief 标准程序的时间限制，单位为秒
+     */
+    double time_limit;
+
+    /**
+     * @brief 传给标准程序的运行参数
+     */
+    std::vector<std::string> run_args;
+
+    /**
+     * @brief 该组随机测试数据的缓存文件夹，cachedir / random_data / testcase_id
+     */
+    std::filesystem::path random_data_dir() const;
+};
+
+/**
+ * @brief 一组随机测试（题目 + testcase_id）已经缓存的随机测试数据编号索引
+ * 每个编号对应 random_data / testcase_id / 编号 文件夹，编号的状态保存在内存中，
+ * 每次状态变化后写入该组随机测试文件夹下的 .slots 文件，进程重启后从文件恢复。
+ * 申请编号、选取已经生成好的编号都只需要持有本对象的锁，不需要锁住整个文件夹，
+ * 也不需要遍历文件夹，因此不同编号的随机数据可以并行生成。
+ * @note 索引只在进程内同步，同一个 CACHE_DIR 只能由一个评测进程使用
+ */
+struct random_data_slots {
+    enum class slot_state : char {
+        FREE = '-',        // 编号未被使用，或者上次生成时进程退出，可以重新申请
+        GENERATING = 'G',  // 正在生成随机测试数据
+        READY = 'R',       // 随机测试数据已经生成好，可以被评测任务使用
+        FAILED = 'F'       // 随机测试数据生成失败，文件夹内的 system.out 保存了错误信息
+    };
+
+    /**
+     * @brief 加载一组随机测试的编号索引
+     * @param dir 该组随机测试的缓存文件夹，参见 random_data_spec::random_data_dir
+     */
+    explicit random_data_slots(const std::filesystem::path &dir);
+
+    /**
+     * @brief 申请一个新的编号用于生成随机测试数据，编号状态变为 GENERATING
+     * 调用方生成完成后必须调用 commit，生成过程中出现异常时必须调用 release
+     * @return 申请到的编号，如果已经生成满 MAX_RANDOM_DATA_NUM 组则返回 -1
+     */
+    int claim();
+
+    /**
+     * @brief 提交随机测试数据的生成结果，唤醒等待数据的评测任务
+     * @param slot claim 申请到的编号
+     * @param success 是否成功生成，失败的编号将保持 FAILED 状态直到题目更新
+     */
+    void commit(int slot, bool success);
+
+    /**
+     * @brief 放弃 claim 申请到的编号，该编号可以被重新申请
+     */
+    void release(int slot);
+
+    /**
+     * @brief 随机选取一组已经生成好的随机测试数据
+     * 如果没有生成好的数据，则选取一组生成失败的数据；如果所有的编号都在生成中，则等待生成完成
+     * @param failed 选取的编号是否生成失败
+     * @return 选取的编号，如果没有生成好或者正在生成的编号则返回 -1，此时调用方应当重新 claim
+     */
+    int pick(bool &failed);
+
+    /**
+     * @brief 编号对应的随机测试数据文件夹
+     */
+    std::filesystem::path slot_dir(int slot) const;
+
+private:
+    void save();
+
+    std::filesystem::path dir;
+
+    std::mutex mut;
+
+    std::condition_variable settled;
+
+    /**
+     * @brief 每个编号的状态，下标为编号
+     */
+    std::vector<slot_state> states;
+
+    std::vector<int> free_slots;
+
+    std::vector<int> ready_slots;
+
+    std::vector<int> failed_slots;
+
+    /**
+     * @brief 处于 GENERATING、READY 或 FAILED 状态的编号数
+     */
+    std::size_t used = 0;
+
+    /**
+     * @brief 处于 GENERATING 状态的编号数
+     */
+    std::size_t generating = 0;
+};
+
+/**
+ * @brief 获得一组随机测试的编号索引，首次访问时从 .slots 文件加载
+ * @param cachedir 题目的缓存文件夹
+ * @param testcase_id 第几组随机测试
+ */
+std::shared_ptr<random_data_slots> get_random_data_slots(const std::filesystem::path &cachedir, int testcase_id);
+
+/**
+ * @brief 题目更新清空缓存文件夹后，丢弃该题目在内存中的所有编号索引
+ * @param cachedir 题目的缓存文件夹
+ */
+void invalidate_random_data_slots(const std::filesystem::path &cachedir);
+
+/**
+ * @brief 调用 random_generator.sh 生成一组随机测试数据
+ * 调用方需要通过 random_data_slots::claim 获得 datadir 的编号
+ * @param spec 随机测试数据的生成方式
+ * @param datadir 存放生成的数据的文件夹
+ * @param execcpuset 生成数据时允许使用的 cpu 核心
+ * @param background 是否以低优先级运行数据生成器
+ * @return random_generator.sh 的返回值，参见 error_codes
+ */
+int generate_random_data(const random_data_spec &spec, const std::filesystem::path &datadir, const std::string &execcpuset, bool background = false);
+
+/**
+ * @brief 随机测试数据预生成服务
+ * 随机数据生成器和标准程序编译完成后，judger 将题目的每组随机测试提交到这里，
+ * worker 在没有评测任务可做时调用 run 生成一组数据，直到该组随机测试的缓存数据
+ * 达到 MAX_RANDOM_DATA_NUM 组。这样提交评测时基本都可以直接使用已经生成好的数据，
+ * 不必在评测过程中等待随机数据生成。
+ */
+struct random_data_pool {
+    /**
+     * @brief 提交一组随机测试的预生成任务
+     * 如果这组随机测试已经在预生成中，则忽略本次提交
+     */
+    void schedule(const random_data_spec &spec);
+
+    /**
+     * @brief 执行一次预生成任务，生成至多一组随机测试数据
+     * 如果这组随机测试还没有生成满，生成完成后将重新排队
+     * @param execcpuset 当前 worker 占有的 cpu 核心
+     * @return true 若执行了预生成任务
+     */
+    bool run(const std::string &execcpuset);
+
+private:
+    /**
+     * @brief 结束一组随机测试的预生成，之后可以重新提交
+     */
+    void finish(const random_data_spec &spec);
+
+    concurrent_queue<random_data_spec> specs;
+
+    std::mutex mut;
+
+    /**
+     * @brief 正在预生成的随机测试，以 random_data_dir 为键
+     */
+    std::set<std::filesystem::path> scheduled;
+};
+
+}  // namespace judge
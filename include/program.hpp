@@ -247,6 +247,13 @@ struct source_code : program {
      */
     std::vector<std::string> compile_command;
 
+    /**
+     * @brief 编译时启用的 sanitizer，如 address
+     * 非空时除了 run 之外还会编译一个启用该 sanitizer 的可执行文件 run.asan，
+     * 供 sanitizer 运行脚本进行内存检查。只有 c/cpp 编译脚本支持该选项
+     */
+    std::string sanitize;
+
     source_code(executable_manager &exec_mgr);
 
     void fetch(const std::string &cpuset, const std::filesystem::path &dir, const std::filesystem::path &chrootdir) override;
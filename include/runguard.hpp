@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <string_view>
+#include <vector>
 #include "common/status.hpp"
 
 namespace judge {
@@ -42,8 +45,83 @@ struct runguard_result {
     int memory = -1;
 
     std::string time_result;
+
+    /**
+     * @brief 选手程序在用户态执行的指令数
+     * 只有 runguard 开启了 --count-instructions 且评测机支持硬件计数器时才有，否则为 -1
+     */
+    int64_t instructions = -1;
+
+    /**
+     * @brief 选手程序主进程及其回收的子进程的上下文切换次数，来自 wait4 的 rusage
+     * 主动让出 CPU（如等待 I/O）计入 voluntary，时间片用完被抢占计入 involuntary
+     */
+    int64_t voluntary_context_switches = -1;
+    int64_t involuntary_context_switches = -1;
+
+    /**
+     * @brief 缺页次数，major 表示需要读磁盘的缺页
+     */
+    int64_t major_faults = -1;
+    int64_t minor_faults = -1;
+
+    /**
+     * @brief 实际读写块设备的字节数，命中页缓存的读写不计入
+     */
+    int64_t read_bytes = -1;
+    int64_t write_bytes = -1;
+
+    /**
+     * @brief 选手程序同时存在的最大进程数，runguard 无法统计时为 -1
+     */
+    int64_t peak_pids = -1;
+
+    /**
+     * @brief 运行期间选手程序所在物理核心的其他逻辑核心（超线程兄弟核心）处于非空闲状态的时间比例
+     * 兄弟核心繁忙时选手程序可能变慢 20%~40%，没有开启超线程或者无法统计时为 -1
+     */
+    double sibling_busy = -1;
+
+    /**
+     * @brief runguard 提前结束选手程序的原因，如 wall-time、memory、output-limit，
+     * 正常结束时为空，取值参见 runguard/src/run_result.cpp 中的 KILL_REASONS。
+     * 指向静态字符串，不需要管理生命周期
+     */
+    std::string_view kill_reason;
 };
 
+/**
+ * @brief 读取 runguard 写出的 meta 文件
+ * 根据文件头自动识别文本、JSON 和二进制三种格式（runguard --meta-format），不认识的字段被忽略。
+ * 解析过程不分配内存，只有 time_result 和 internal_error 需要复制字符串
+ */
 runguard_result read_runguard_result(const std::filesystem::path &metafile);
 
+/**
+ * @brief runguard --timeline 记录的一个采样点
+ * 时间线文件的格式参见 runguard/include/timeline.hpp，除 memory 外都是从选手程序开始运行起的累计值
+ */
+struct runguard_timeline_point {
+    double time = 0;           // 采样时刻，单位为秒
+    int64_t memory = 0;        // 内存使用，单位为 KB
+    double cpu_time = 0;       // CPU 时间，单位为秒
+    int64_t page_faults = 0;   // 缺页次数
+    int64_t major_faults = 0;  // 需要读磁盘的缺页次数
+    int64_t context_switches = 0;
+    int64_t read_bytes = 0;   // 读入的数据量，单位为 KB
+    int64_t write_bytes = 0;  // 写出的数据量，单位为 KB
+};
+
+/**
+ * @brief 读取 runguard --timeline 写入的二进制时间线文件
+ * @return 所有采样点，文件不存在或者格式不正确时返回空数组
+ */
+std::vector<runguard_timeline_point> read_runguard_timeline(const std::filesystem::path &timeline_file);
+
+/**
+ * @brief 将时间线降采样到不超过 max_points 个点，以便附加到评测报告中
+ * 相邻的若干个采样点合并为一个点：内存取其中的最大值，避免丢失内存峰值，累计值取最后一个采样点的值
+ */
+std::vector<runguard_timeline_point> downsample_timeline(const std::vector<runguard_timeline_point> &timeline, std::size_t max_points);
+
 }  // namespace judge
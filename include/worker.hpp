@@ -53,6 +53,12 @@ void register_monitor(std::unique_ptr<monitor> &&monitor);
  */
 void report_error(const std::string &message);
 
+/**
+ * @brief 获得当前正在等待评测任务的 worker 数
+ * 评测器可以据此估计有多少空闲的核心，决定是否拆分评测任务以便并行评测
+ */
+std::size_t idle_worker_count();
+
 /**
  * @brief 启动评测 worker 线程
  * 注意评测服务端客户端收发消息直接通过发送指针实现，因此 worker 不能通过 fork
@@ -62,12 +68,13 @@ void report_error(const std::string &message);
  * @param task_queue 评测服务端发送评测信息的队列
  * @param core_queue 核心申请队列，对于多核编程题，获取到提交的 worker 将发送核心获取申请，
  * 其他 worker 发现申请后将当前 CPU 分配给之前申请的 worker，并阻塞当前 worker 的处理直到
- * 该多核提交评测完成为止。
+ * 该多核提交评测完成为止。同一 NUMA 节点上的 worker 共用一个队列，因此多核评测任务不会跨节点。
+ * @param group_size 共用 core_queue 的 worker 数，多核评测任务最多使用这么多核心
  * @return 产生的线程
  * 
  * 选手代码、测试数据、随机数据生成器、标准程序、SPJ 等资源的
  * 下载均由客户端完成。服务端只完成提交的拉取和数据点的分发。
  */
-std::thread start_worker(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue);
+std::thread start_worker(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue, size_t group_size);
 
 }  // namespace judge
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief 直接读写 cgroupfs 的 cgroup v2（unified hierarchy）实现
+ * cgroup v2 的所有控制器都挂载在同一个目录下，每个 cgroup 就是一个文件夹，
+ * 设置和统计都是文件夹内的文本文件，因此不需要 libcgroup，直接读写文件即可。
+ *
+ * 用到的文件：
+ * 1. memory.max、memory.swap.max - 内存限制，swap 限制为 0 以禁止交换（相当于 v1 的 memory.memsw.limit_in_bytes）
+ * 2. memory.peak - 内存使用峰值（相当于 v1 的 memory.memsw.max_usage_in_bytes）
+ * 3. memory.events - 其中的 oom_kill 表示 OOM killer 杀死的进程数（相当于 v1 的 memory.oom_control）
+ * 4. cpu.stat - 其中的 usage_usec 表示 cgroup 内进程使用的 CPU 时间（相当于 v1 的 cpuacct.usage）
+ * 5. cpuset.cpus - 允许使用的 CPU 核心
+ * 6. pids.max - 最大进程数
+ * 7. cgroup.procs - 将进程移入 cgroup
+ * 8. cgroup.kill - 杀死 cgroup 内的所有进程（Linux 5.14 起支持）
+ *
+ * https://www.kernel.org/doc/html/latest/admin-guide/cgroup-v2.html
+ */
+struct cgroup2 {
+    /**
+     * @brief cgroup v2 的挂载点
+     */
+    static const char *MOUNT_POINT;
+
+    /**
+     * @brief 检查 MOUNT_POINT 是否挂载了 cgroup v2
+     * 对于同时挂载了 v1 和 v2 的混合模式（v2 挂载在 /sys/fs/cgroup/unified），仍然使用 v1
+     */
+    static bool available();
+
+    /**
+     * @param cgroup_name cgroup 的名称，如 /judger/cgroup_1234_1577836800
+     */
+    explicit cgroup2(const std::string &cgroup_name);
+
+    /**
+     * @brief cgroup v1 每个控制器下的 cgroup 文件夹也可以这样直接读写
+     * @param cgroup_name cgroup 的名称
+     * @param mount_point 控制器的挂载点，如 /sys/fs/cgroup/memory
+     */
+    cgroup2(const std::string &cgroup_name, const std::string &mount_point);
+
+    /**
+     * @brief 这个 cgroup 是否已经在内核中创建
+     */
+    bool exists() const;
+
+    /**
+     * @brief 在内核中创建这个 cgroup
+     * 父 cgroup 必须已经在 cgroup.subtree_control 中开启了 memory、cpu、cpuset、pids 控制器，
+     * 参见 exec/create_cgroups.sh
+     */
+    void create();
+
+    /**
+     * @brief 写入 cgroup 的设定文件
+     * @param name 文件名，如 memory.max
+     */
+    void write(const std::string &name, const std::string &value);
+
+    /**
+     * @brief 读取只包含一个整数的统计文件，如 memory.peak
+     */
+    int64_t read_int64(const std::string &name);
+
+    /**
+     * @brief 读取 flat keyed 格式（每行为 key value）的统计文件中的一项，如 cpu.stat 中的 usage_usec
+     * @return 对应的值，如果不存在这一项则返回 -1
+     */
+    int64_t read_keyed(const std::string &name, const std::string &key);
+
+    /**
+     * @brief 将指定的进程移入本 cgroup
+     */
+    void attach(pid_t pid);
+
+    /**
+     * @brief 杀死 cgroup 内的所有进程
+     * 优先使用 cgroup.kill，内核不支持时逐个杀死 cgroup.procs 中的进程
+     * @throw runtime_error 重试多次后 cgroup 内仍有进程
+     */
+    void kill();
+
+    /**
+     * @brief 等待 cgroup 内的进程全部退出，即 cgroup.events 中的 populated 变为 0
+     */
+    void wait_empty();
+
+    /**
+     * @brief 从内核中删除这个 cgroup，调用前必须杀死 cgroup 内的所有进程
+     */
+    void remove();
+
+    /**
+     * @brief cgroup 在 cgroupfs 中的路径
+     */
+    const std::string &path() const;
+
+private:
+    std::string dir;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <sys/types.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "runguard_options.hpp"
+
+/**
+ * @brief 逐行比较受控程序的标准输出和标准输出文件
+ * 同时进行两种比较：
+ * 1. 精确比较：忽略行末的 \r，其余字符必须完全相同，等价于 compare/diff-all 的第二次比较
+ * 2. 宽松比较：忽略行末空白字符、空行，连续的空白字符视为相同，等价于 compare/diff-ign-space
+ * 宽松比较失败时选手程序一定是 Wrong Answer，此时可以立即结束选手程序；
+ * 只有精确比较失败时选手程序可能是 Presentation Error，需要读完所有输出才能确定结果
+ */
+struct output_comparator {
+    enum class result {
+        ACCEPTED,
+        PRESENTATION_ERROR,
+        WRONG_ANSWER
+    };
+
+    /**
+     * @brief 读入标准输出文件
+     * @param expected_file 标准输出文件的路径
+     */
+    explicit output_comparator(const std::string &expected_file);
+
+    /**
+     * @brief 比较受控程序新输出的一段数据
+     * @return false 若已经确定选手程序的输出为 Wrong Answer
+     */
+    bool feed(const char *data, size_t size);
+
+    /**
+     * @brief 受控程序的输出结束，比较最后一行并得到比较结果
+     */
+    result finish();
+
+private:
+    void compare_line(const std::string &line);
+
+    bool compare_partial_line();
+
+    // 去除行末的 \r 后的标准输出的每一行
+    std::vector<std::string> raw_lines;
+
+    // 宽松比较下标准输出的所有非空行
+    std::vector<std::string> normalized_lines;
+
+    bool expected_ends_with_newline = true;
+
+    size_t max_line_length = 0;
+
+    // 选手程序还没有输出完的一行
+    std::string partial;
+
+    size_t raw_index = 0, normalized_index = 0;
+
+    bool exact = true, mismatch = false;
+};
+
+/**
+ * @brief 在 watchdog 中读取受控程序的标准输出并进行流式比较
+ * 受控程序的标准输出被重定向到管道，watchdog 的后台线程从管道读取输出，
+ * 一边比较一边写入 --standard-output-file 指定的文件（如果有的话）。
+ * 遇到确定的 Wrong Answer 或者输出超过 --stream-size 时立即杀死受控程序的进程组。
+ *
+ * --capture-output 时输出通过 splice 从管道直接移入 memfd，不经过用户态缓冲区，也不在运行期间写磁盘；
+ * 比较器从 memfd 读取新写入的部分。受控程序结束后 memfd 被截断到恰好 --stream-size 字节并封存（sealed），
+ * 此后才一次性写入 --standard-output-file，输出很多的程序不会因为磁盘 I/O 变慢或者干扰其他评测核心。
+ * memfd 的内存计入 runguard 而不是受控程序的 cgroup，因此捕获的字节数从受控程序的内存限制中扣除，
+ * 并计入 memory-bytes。
+ */
+struct output_monitor {
+    /**
+     * @brief 读入标准输出文件，创建管道
+     * @param opt 需要 compare_filename 或 capture_output，可选 stdout_filename 和 stream_size
+     */
+    explicit output_monitor(const runguard_options &opt);
+
+    ~output_monitor();
+
+    /**
+     * @brief 在子进程中调用，将标准输出重定向到管道
+     */
+    void redirect_child();
+
+    /**
+     * @brief 在 watchdog 中调用，开始读取受控程序的输出
+     * @param pid 受控程序的进程号，同时也是受控程序的进程组号
+     */
+    void start(pid_t pid);
+
+    /**
+     * @brief 受控程序结束后调用，读完管道中剩余的输出并等待读取线程结束
+     */
+    void stop();
+
+    /**
+     * @brief 是否指定了 --compare-output，只捕获输出时没有比较结果
+     */
+    bool comparing() const;
+
+    /**
+     * @brief 比较结果，必须在 stop 之后调用，且 comparing() 为 true
+     */
+    output_comparator::result result();
+
+    /**
+     * @brief 捕获的输出和受控程序占用的内存合计超过了内存限制
+     */
+    bool memory_exceeded() const;
+
+    /**
+     * @brief --capture-output 时保存在 memfd 中的字节数，否则为 0
+     */
+    size_t captured_bytes() const;
+
+    /**
+     * @brief 受控程序是否因为输出和标准输出不同被提前结束
+     */
+    bool killed_on_mismatch() const;
+
+    /**
+     * @brief 受控程序的输出是否超过了 --stream-size 限制
+     */
+    bool truncated() const;
+
+    /**
+     * @brief 受控程序输出的字节数
+     */
+    size_t bytes() const;
+
+private:
+    void read_loop();
+
+    /**
+     * @brief 从管道读取一段输出，超过 limit 的部分不会保留
+     * @return 读取到的字节数（包括超出 limit 的部分），0 表示 EOF，-1 表示出错
+     */
+    ssize_t read_pipe(std::vector<char> &buffer, size_t &accepted);
+
+    /**
+     * @brief 截断并封存 memfd，需要时写出 --standard-output-file
+     */
+    void seal_capture();
+
+    /**
+     * @brief 从受控程序的内存限制中扣除已经捕获的输出
+     * @return false 若扣除后受控程序已经超过了内存限制
+     */
+    bool charge_memory();
+
+    std::unique_ptr<output_comparator> comparator;
+
+    int pipe_fd[2] = {-1, -1};
+
+    int output_fd = -1;
+
+    int capture_fd = -1;
+
+    size_t limit;
+
+    size_t written = 0;
+
+    pid_t child = -1;
+
+    // 受控程序 cgroup 的内存限制文件，只在捕获输出且有内存限制时打开
+    std::vector<int> memory_fds;
+
+    int64_t memory_limit = -1;
+
+    // 已经从内存限制中扣除的字节数
+    size_t charged = 0;
+
+    std::thread reader;
+
+    std::atomic<bool> stopping = false;
+
+    bool mismatch = false, over_limit = false, over_memory = false;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+/**
+ * @brief runguard 作为库使用时的入口
+ * runguard 命令、supervisor 和嵌入 runguard 的程序共用同一套实现：
+ * 1. parse_options 将命令行参数解析为 run_request
+ * 2. runguard_run 在子进程中执行 runit 并返回结构化的 run_result
+ * 3. supervisor_request 将运行请求交给常驻的 supervisor 执行
+ */
+
+#include "options.hpp"
+#include "run_result.hpp"
+#include "runguard_options.hpp"
+#include "supervisor.hpp"
+
+/**
+ * @brief 一次运行请求，和 runguard 的命令行参数一一对应
+ */
+using run_request = runguard_options;
+
+/**
+ * @brief 在 fork 出的子进程中运行请求并等待运行结束
+ * runit 会修改进程的命名空间、信号处理、uid，并在内部错误时直接退出进程，因此不能在调用方的进程中执行
+ * @param exitcode runguard 的返回值，即受控程序的返回值，内部错误时为 EXIT_FAILURE
+ */
+run_result runguard_run(const run_request &request, int &exitcode);
@@ -1,9 +1,62 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
 #include "runguard_options.hpp"
 
+/**
+ * cgroup statistics of the monitored process tree.
+ */
+struct cgroup_usage {
+    int64_t memory_bytes;  // peak memory usage (RAM + swap)
+    int64_t cpu_time_ns;   // total CPU time
+    bool oom;              // whether the OOM killer has been triggered
+    int64_t peak_pids;     // most tasks alive at the same time, -1 if unknown
+};
+
+/**
+ * Instantaneous statistics of the control group, see cgroup_read_sample.
+ */
+struct cgroup_sample {
+    int64_t memory_bytes;  // current memory usage
+    int64_t cpu_time_ns;   // CPU time used so far
+    int64_t page_faults;   // page faults so far, including major faults
+    int64_t major_faults;  // page faults which required disk I/O so far
+};
+
+/**
+ * Detect the cgroup hierarchy of the host and initialize the backend.
+ * 
+ * cgroup v2 (unified hierarchy mounted on /sys/fs/cgroup) is
+ * accessed directly via cgroupfs, otherwise libcgroup is used
+ * with cgroup v1 controllers. Calling it again is a no-op, so
+ * workers forked by the supervisor reuse its initialization.
+ */
+void cgroup_backend_init();
+
+/**
+ * Whether the cgroup v2 backend is in use, valid after cgroup_backend_init.
+ */
+bool cgroup_is_v2();
+
 void cgroup_create(const struct runguard_options &);
 
+/**
+ * Lease the pre-created control group of the cpuset.
+ * 
+ * Creating and removing a control group on every run costs
+ * several milliseconds of cgroupfs operations. Since a judge core
+ * runs one program at a time, the group /judger/core_<cpuset> is
+ * kept across runs: the lease locks it, kills leftover processes,
+ * rewrites the limits and resets (or records baselines of) the
+ * statistics, so cgroup_read_usage reports this run only.
+ * 
+ * @return false if another runguard holds the lease, in which
+ * case the caller should create a private control group instead.
+ * On success opt.cgroupname is set to the leased group.
+ */
+bool cgroup_lease(struct runguard_options &);
+
 /**
  * Move current process to the control group.
  * 
@@ -12,6 +65,39 @@ void cgroup_create(const struct runguard_options &);
  */
 void cgroup_attach(const struct runguard_options &);
 
+/**
+ * Open cgroup.procs of the control group in every hierarchy.
+ * 
+ * The sandbox has no cgroupfs, so its init process opens these
+ * files before entering the sandbox and the forked command joins
+ * the control group through them with cgroup_attach_fds. Init
+ * itself stays outside, so it is not charged for building the
+ * sandbox and does not count towards pids.max.
+ */
+std::vector<int> cgroup_open_procs(const struct runguard_options &);
+
+/**
+ * Move current process to the control group through the
+ * descriptors returned by cgroup_open_procs and close them.
+ */
+void cgroup_attach_fds(const std::vector<int> &fds);
+
+/**
+ * Open the memory limit files of the control group, so that
+ * cgroup_set_memory_limit still works after runguard dropped
+ * root privileges.
+ */
+std::vector<int> cgroup_open_memory_limit(const struct runguard_options &);
+
+/**
+ * Change the memory limit of the control group through the
+ * descriptors returned by cgroup_open_memory_limit.
+ * 
+ * @return false if the kernel cannot reclaim the usage below the
+ * new limit (cgroup v1), cgroup v2 invokes the OOM killer instead.
+ */
+bool cgroup_set_memory_limit(const std::vector<int> &fds, int64_t bytes);
+
 /**
  * Kill all processes in the control group.
  * 
@@ -21,11 +107,51 @@ void cgroup_attach(const struct runguard_options &);
 void cgroup_kill(const struct runguard_options &);
 
 /**
+ * Subscribe to OOM events of the control group.
+ * 
+ * cgroup v1 registers an eventfd on memory.oom_control through
+ * cgroup.event_control, cgroup v2 watches memory.events with inotify.
+ * 
+ * @return a descriptor which becomes readable when memory events
+ * happen, check it with cgroup_oom_triggered.
+ */
+int cgroup_watch_oom(const struct runguard_options &);
+
+/**
+ * Consume pending events on the descriptor returned by cgroup_watch_oom
+ * and check whether the OOM killer has been triggered in this run.
+ */
+bool cgroup_oom_triggered(const struct runguard_options &, int fd);
+
+/**
+ * Read memory, CPU time and OOM statistics of the control group.
+ * 
+ * Must be called before cgroup_delete.
+ */
+cgroup_usage cgroup_read_usage(const struct runguard_options &);
+
+/**
+ * Read the current memory usage, CPU time and page faults of the
+ * control group while the command is running.
+ * 
+ * Counters are cumulative and may include earlier runs in a leased
+ * control group, callers should only rely on their differences.
+ */
+cgroup_sample cgroup_read_sample(const struct runguard_options &);
+
+/**
+ * Remove the control group from the kernel.
  * 
+ * A leased control group is kept for the next run, this only
+ * waits until all processes in it have exited.
  */
 void cgroup_delete(const struct runguard_options &);
 
 /**
  * Limit current process resources usage.
+ * 
+ * With sandbox mounts the caller is the command forked by the
+ * init process of the sandbox, which has already entered it and
+ * opened cgroup_procs with cgroup_open_procs.
  */
-void set_restrictions(const struct runguard_options &opt);
+void set_restrictions(const struct runguard_options &opt, const std::vector<int> &cgroup_procs = {});
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <set>
+#include <string>
+
+/**
+ * @brief 解析 cpuset 格式的列表，如 "0,2-3"
+ * @throw std::invalid_argument 格式不正确
+ */
+std::set<unsigned> parse_cpu_list(const std::string &list);
+
+/**
+ * @brief 查询 CPU 核心所在的 NUMA 节点
+ * 内核在 /sys/devices/system/cpu/cpu<N>/ 下为核心所在的节点创建 node<M> 链接
+ * @return 节点编号，内核没有开启 NUMA 支持时返回 -1
+ */
+int numa_node_of_cpu(unsigned cpu);
+
+/**
+ * @brief 计算 cgroup 的 cpuset.mems：cpuset 中的核心所在的所有 NUMA 节点
+ * 选手程序只从这些节点分配内存，避免跨节点访问内存导致运行变慢、运行时间随分配到的核心波动
+ * @param cpuset 选手程序能使用的 CPU 核心，如 "0,2-3"
+ * @return 节点列表，如 "1"；无法得到 NUMA 拓扑时返回空字符串
+ */
+std::string numa_mems_of_cpuset(const std::string &cpuset);
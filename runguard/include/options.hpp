@@ -0,0 +1,12 @@
+#pragma once
+
+#include <ostream>
+#include "runguard_options.hpp"
+
+/**
+ * @brief 解析 runguard 的命令行参数
+ * runguard 命令和 supervisor 收到的运行请求都通过这个函数解析，
+ * 帮助信息和错误信息分别写入 out 和 err
+ * @return -1 表示解析成功，需要运行 opt.command；否则为 runguard 应当直接返回的退出码（如 --help 或者参数错误）
+ */
+int parse_options(int argc, const char *argv[], runguard_options &opt, std::ostream &out, std::ostream &err);
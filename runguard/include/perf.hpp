@@ -0,0 +1,62 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+
+/**
+ * @brief 用 perf_event 统计受控程序及其子进程在用户态执行的指令数
+ * 指令数不受 CPU 频率和其他核心负载的影响，机器满载时也能得到稳定的结果。
+ *
+ * 计数器必须在受控程序 exec 之前打开，因此需要和子进程同步：
+ * 1. fork 之前调用 prepare 创建同步管道
+ * 2. 子进程在 exec 之前调用 wait_attached，等待 watchdog 打开计数器
+ * 3. watchdog 调用 attach 打开计数器并让子进程继续
+ * 计数器设置了 enable_on_exec，runguard 在子进程中 exec 之前执行的指令不会被统计。
+ */
+struct instruction_counter {
+    ~instruction_counter();
+
+    /**
+     * @brief 创建同步管道，必须在 fork 之前调用
+     */
+    void prepare();
+
+    /**
+     * @brief 在子进程中调用，阻塞到 watchdog 调用 attach 为止
+     */
+    void wait_attached();
+
+    /**
+     * @brief 在 watchdog 中调用，打开受控程序的指令计数器，无论成功与否都会让子进程继续运行
+     * @param pid 受控程序的进程号
+     * @param limit 受控程序本身执行的指令数达到 limit 时由内核直接发送 SIGKILL，为 0 时不限制。
+     * 子进程继承的计数器各自溢出，达不到 limit 的多个子进程合计超出时由 watch 得到的定时器检查
+     * @return 是否成功打开计数器，虚拟机等没有硬件计数器的环境会失败
+     */
+    bool attach(pid_t pid, uint64_t limit);
+
+    /**
+     * @brief 创建定期检查总指令数的 timerfd，交给 watchdog 的事件循环
+     * @return timerfd，计数器没有打开或者不限制指令数时返回 -1
+     */
+    int watch();
+
+    /**
+     * @brief timerfd 可读时调用，读走定时器事件并检查受控程序和所有子进程的总指令数
+     * @return 总指令数是否达到了 attach 时指定的 limit
+     */
+    bool limit_exceeded();
+
+    /**
+     * @brief 读取受控程序执行的指令数，受控程序的进程都退出后读到的才是最终结果
+     * @return 指令数，计数器没有打开时返回 -1
+     */
+    int64_t read();
+
+private:
+    int sync_fd[2] = {-1, -1};
+
+    int counter_fd = -1, timer_fd = -1;
+
+    uint64_t limit = 0;
+};
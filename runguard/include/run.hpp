@@ -11,8 +11,9 @@
  * 4. 检查 runguard 进程的内存限制
  * 5. 调用 fork 创建子进程，并等待子进程结束
  *    1. 对于父进程
- *       1. 监听子进程的 SIGALRM 来进行时间限制、SIGTERM 来清除进程树
- *       2. 创建 itimer 来限制 real time，并注册 sigaction，在遇到 SIGALRM 时终止子进程并记录信息到 meta 文件中
+ *       1. 通过 watchdog 的 epoll 同时等待子进程退出（pidfd）、墙上时间硬限制（timerfd）和 SIGTERM（signalfd），
+ *          超时或收到 SIGTERM 时立即杀死整个 cgroup（ptrace 模式仍使用 itimer 和 SIGALRM）
+ *       2. 超过墙上时间硬限制时记录信息到 meta 文件中
  *       3. 与子进程建立管道连接，必要时重定向到文件
  *       4. 等待子进程结束
  *    2. 对于子进程，添加子进程资源限制，并与父进程建立管道重定向输入输出
@@ -20,7 +21,7 @@
  *       2. 通过 rlimit 限制 CPU time
  *       3. 通过 rlimit 给予无限大的栈空间
  *       4. 将子进程挂载到我们创建的 cgroup 上，限制 CPU 核心、内存使用
- *       5. 设置 chroot 和工作路径
+ *       5. 设置 chroot 和工作路径，指定了 --overlay 等挂载时改为搭建沙箱（参见 enter_sandbox）
  *       6. 设置子进程的 user 和 group 以允许文件访问权限限制
  *       7. 将子进程分离到一个独立的进程组，以便我们通过 SIGKILL 可以杀死进程组内所有进程
  * 6. 检查子进程是否正常退出
@@ -29,5 +30,12 @@
  * 7. 读取 cgroup 的监测数据，得到运行时间、内存使用
  * 8. 杀死 cgroup 内的所有进程确保选手 fork 出来的子进程都不会留驻系统
  * 9. 删除创建的 cgroup，并记录所有的信息到 meta 文件中
+ * @return 受控程序的返回值，runguard 以此作为自己的返回值；内部错误时不会返回，而是以 EXIT_FAILURE 退出进程
  */
 int runit(struct runguard_options opt);
+
+/**
+ * @brief 设置之后 runit 结束时（包括因为内部错误退出时）还会以 send_result 的格式将结果写入 fd
+ * 供 runguard_run 和 supervisor 取得结构化的运行结果
+ */
+void set_result_fd(int fd);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * @brief 一次运行的结果，即 meta 文件的内容
+ * runit 结束时将结果写入 --out-meta 指定的 meta 文件，
+ * 通过 runguard_run 或者 supervisor 运行时还会以 send_result 的格式传回调用方
+ */
+struct run_result {
+    int64_t memory_bytes = -1;  // cgroup 记录的内存使用峰值
+    bool oom = false;           // 发生了 OOM
+    bool restricted_function = false;
+
+    int exitcode = -1;  // 受控程序的返回值，被信号终止时为 128 + 信号，-1 表示没有运行完成
+    int signal = -1;    // 终止受控程序的信号
+
+    // 单位为秒
+    double wall_time = -1, user_time = -1, sys_time = -1, cpu_time = -1;
+
+    int64_t instructions = -1;  // 用户态执行的指令数，只在 --count-instructions 时有
+
+    std::string time_result;  // 空、soft-timelimit 或 hard-timelimit
+
+    // 以下只在 --compare-output 或 --capture-output 时有，只捕获输出时 compare_result 为空
+    int64_t stdout_bytes = -1;
+    bool output_truncated = false;
+    std::string compare_result;
+    bool compare_killed = false;
+
+    // 受控程序的主进程以及它回收了的子进程的统计，来自 wait4 的 rusage
+    int64_t voluntary_context_switches = -1;
+    int64_t involuntary_context_switches = -1;
+    int64_t major_faults = -1;
+    int64_t minor_faults = -1;
+    int64_t read_bytes = -1;   // 从块设备读入的字节数，不包括页缓存命中的读
+    int64_t write_bytes = -1;  // 写入块设备的字节数
+
+    int64_t peak_pids = -1;  // cgroup 中同时存在的最大进程数，内核不支持或者复用 cgroup 时为 -1
+
+    // 运行期间 cpuset 中核心的超线程兄弟核心处于非空闲状态的时间比例，参见 sibling_monitor；
+    // 没有 --cpuset、没有开启超线程或者无法统计时为 -1
+    double sibling_busy = -1;
+
+    /**
+     * 受控程序被提前结束的原因，参见 KILL_REASONS；正常结束或者自行崩溃时为空
+     */
+    std::string kill_reason;
+
+    std::string internal_error;  // runguard 内部错误，非空时 runguard 返回 EXIT_FAILURE
+};
+
+/**
+ * @brief kill_reason 的所有取值，二进制格式中保存下标
+ */
+extern const char *const KILL_REASONS[];
+
+enum class meta_format {
+    TEXT,   // 每行一个 key: value，评测脚本直接用 grep 读取
+    JSON,   // 一个 JSON 对象，键名和文本格式相同
+    BINARY  // 定长的 binary_meta，后接 internal-error 字符串
+};
+
+/**
+ * @brief 结构化格式的版本号，增加字段时递增，旧版本的读取方忽略不认识的字段
+ */
+const uint32_t META_VERSION = 3;
+
+/**
+ * @brief 二进制 meta 文件的文件头和定长部分，字段均为本机字节序
+ * 读取方根据 size 跳过新版本追加的字段，修改时需要同步修改 judge-system 的 src/runguard.cpp
+ */
+struct binary_meta {
+    char magic[4] = {'R', 'G', 'M', 'T'};
+    uint32_t version = META_VERSION;
+    uint32_t size = sizeof(binary_meta);  // 定长部分的长度
+
+    enum : uint32_t {
+        FLAG_OOM = 1,
+        FLAG_RESTRICTED_FUNCTION = 2,
+        FLAG_OUTPUT_TRUNCATED = 4,
+        FLAG_COMPARE_KILLED = 8
+    };
+    uint32_t flags = 0;
+
+    int32_t exitcode = -1;
+    int32_t signal = -1;
+    double wall_time = -1, user_time = -1, sys_time = -1, cpu_time = -1;
+    int64_t memory_bytes = -1;
+    int64_t instructions = -1;
+    int64_t stdout_bytes = -1;
+    int64_t voluntary_context_switches = -1;
+    int64_t involuntary_context_switches = -1;
+    int64_t major_faults = -1;
+    int64_t minor_faults = -1;
+    int64_t read_bytes = -1;
+    int64_t write_bytes = -1;
+    int64_t peak_pids = -1;
+
+    uint8_t time_result = 0;     // 0 为空，1 为 soft-timelimit，2 为 hard-timelimit
+    uint8_t compare_result = 0;  // 0 为空，1 为 accepted，2 为 presentation-error，3 为 wrong-answer
+    uint8_t kill_reason = 0;     // KILL_REASONS 的下标
+    uint8_t reserved = 0;
+
+    uint32_t internal_error_length = 0;  // 紧跟在定长部分之后的 internal-error 的长度
+
+    // 版本 3 起
+    double sibling_busy = -1;
+};
+
+/**
+ * @brief 写出 meta 文件
+ * 没有运行完成时（exitcode 为 -1）只写出 internal-error
+ */
+void write_meta(std::ostream &out, const run_result &result, meta_format format = meta_format::TEXT);
+
+/**
+ * @brief 解析文本或者二进制格式的 meta 文件，根据文件头自动识别格式，不认识的行或字段被忽略
+ */
+run_result parse_meta(const std::string &data);
+
+/**
+ * @brief 将 runguard 的返回值和运行结果写入管道或者 socket
+ * 格式为 int32 返回值、uint32 长度和该长度的二进制 meta
+ */
+void send_result(int fd, int exitcode, const run_result &result);
+
+/**
+ * @brief 读取 send_result 写入的运行结果
+ * @return false 若对端在写完结果之前关闭了连接
+ */
+bool receive_result(int fd, int &exitcode, run_result &result);
@@ -3,6 +3,8 @@
 #include <limits>
 #include <string>
 #include <vector>
+#include "run_result.hpp"
+#include "sandbox.hpp"
 
 struct time_limit {
     double soft, hard;
@@ -17,11 +19,35 @@ struct runguard_options {
     int group_id = -1;
     std::string cpuset;  // processor id to run client program.
 
+    /**
+     * 非空时受控程序运行在 runguard 搭建的沙箱中：独立的 PID 和挂载命名空间，
+     * 按这里声明的 overlay 和绑定挂载组成文件系统，没有挂载到 / 的 overlay 时以 chroot_dir 作为根目录，参见 enter_sandbox
+     */
+    std::vector<mount_spec> mounts;
+
+    /**
+     * 复用为 cpuset 预先创建的 cgroup（/judger/core_<cpuset>），而不是每次运行都创建新的 cgroup，
+     * 每个评测核心同一时间只会运行一个程序，参见 cgroup_lease
+     */
+    bool reuse_cgroup = false;
+
     bool use_wall_limit = false;
     struct time_limit wall_limit;  // wall clock time
     bool use_cpu_limit = false;
     struct time_limit cpu_limit;  // CPU time
 
+    /**
+     * 统计受控程序在用户态执行的指令数，写入 meta 文件的 instructions，参见 instruction_counter
+     */
+    bool count_instructions = false;
+
+    /**
+     * 按指令数判断是否超时，软限制和 CPU 时间一样在运行结束后判断，达到硬限制时立即结束受控程序。
+     * 评测机满载运行时指令数仍然稳定，由评测脚本根据每台评测机校准的每秒指令数将时间限制换算成指令数
+     */
+    bool use_instruction_limit = false;
+    struct time_limit instruction_limit;
+
     int64_t memory_limit = -1;  // Memory limit in bytes
     int file_limit = -1;        // Output limit
     int stream_size = -1;
@@ -35,13 +61,39 @@ struct runguard_options {
      */
     bool use_ptrace = false;
 
+    /**
+     * 使用 seccomp-bpf 过滤系统调用，允许的系统调用和 ptrace 模式相同（syscall_table），
+     * 但由内核完成检查，受控程序的系统调用不需要停下来等待 watchdog，参见 install_seccomp_filter
+     */
+    bool use_seccomp = false;
+
     std::string stdin_filename;
     std::string stdout_filename;
     std::string stderr_filename;
 
+    /**
+     * 标准输出文件的路径，非空时受控程序的标准输出通过管道交给 runguard 边运行边比较，
+     * 遇到确定的 Wrong Answer 时立即结束受控程序，比较结果写入 meta 文件的 compare-result
+     */
+    std::string compare_filename;
+
+    /**
+     * 受控程序的标准输出通过管道 splice 到 memfd 中，而不是在运行期间写入 stdout_filename，
+     * 输出恰好截断在 stream_size，超过时立即结束受控程序，参见 output_monitor
+     */
+    bool capture_output = false;
+
+    /**
+     * 非空时按 timeline_interval 采样受控程序的内存、CPU 时间、缺页、上下文切换和读写字节数，
+     * 运行结束后写入这个二进制时间线文件，格式参见 timeline.hpp
+     */
+    std::string timeline_filename;
+    unsigned timeline_interval = 10000;  // 采样间隔，单位为微秒
+
     bool preserve_sys_env = false;
     std::vector<std::string> env;
 
     std::string metafile_path;
+    meta_format metafile_format = meta_format::TEXT;  // 评测脚本用 grep 读取 meta 文件，默认使用文本格式
     std::vector<std::string> command;
 };
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+struct runguard_options;
+
+/**
+ * @brief 沙箱文件系统布局中的一个挂载点
+ * 评测脚本通过 --overlay、--bind、--bind-ro 声明受控程序看到的文件系统，
+ * 由 runguard 在受控程序私有的挂载命名空间中完成挂载，参见 enter_sandbox
+ */
+struct mount_spec {
+    enum class mount_type {
+        OVERLAY,
+        BIND
+    };
+
+    mount_type type;
+
+    /**
+     * @brief 挂载到沙箱中的路径，必须是绝对路径，"/" 表示沙箱的根目录
+     */
+    std::string target;
+
+    /**
+     * @brief overlayfs 的只读层，越靠前优先级越高，和 mount -o lowerdir= 的顺序相同
+     */
+    std::vector<std::string> lowerdirs;
+
+    /**
+     * @brief overlayfs 的可写层和工作目录，为空时挂载只读的 overlayfs
+     */
+    std::string upperdir, workdir;
+
+    /**
+     * @brief 绑定挂载的源路径，可以是文件夹或文件
+     */
+    std::string source;
+
+    bool read_only = true;
+};
+
+/**
+ * @brief 解析 --overlay 的参数，格式为 <target>:lowerdir=<dir>[:<dir>...][,upperdir=<dir>,workdir=<dir>]
+ * 如 /judge:lowerdir=compile:testin,upperdir=run,workdir=ofs/judge
+ * @throw std::invalid_argument 格式不正确
+ */
+mount_spec parse_overlay(const std::string &value);
+
+/**
+ * @brief 解析 --bind 和 --bind-ro 的参数，格式为 <source>:<target>
+ * @throw std::invalid_argument 格式不正确
+ */
+mount_spec parse_bind(const std::string &value, bool read_only);
+
+/**
+ * @brief 在子进程中搭建沙箱，代替 chroot
+ * 必须以 root 权限、在新的 PID 命名空间中调用（需要挂载新的 /proc）：
+ * 1. 分离出一个新的挂载命名空间并将所有挂载点设为 private，挂载不会传播回宿主机；
+ * 2. 在 tmpfs 上依次挂载根目录（--overlay / 或 --root）、其余的 overlay 和绑定挂载；
+ * 3. 挂载只属于这个 PID 命名空间的 /proc，以及只包含 null、zero、full、random、urandom 的 /dev；
+ * 4. pivot_root 到新的根目录并卸载宿主机的根目录，切换到工作路径。
+ * 所有挂载点都只存在于这个挂载命名空间中，命名空间内的进程全部退出后由内核自动卸载，
+ * 评测脚本不再需要 mount、umount 和卸载失败时的重试
+ * @throw std::system_error 挂载失败
+ */
+void enter_sandbox(const runguard_options &opt);
+
+/**
+ * @brief 作为 PID 命名空间的 1 号进程回收所有孤儿进程，直到受控程序退出
+ * @param command 受控程序的进程号
+ * @return 受控程序的 wait 状态
+ */
+int reap_as_init(pid_t command);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @brief 根据 syscall_table 中允许的系统调用生成 seccomp-bpf 过滤器并安装到当前进程
+ * 与 ptrace 模式使用同一张系统调用表：64 位系统调用使用 SYSCALL_TABLE_64，
+ * 通过 int 0x80 发起的 32 位系统调用使用 SYSCALL_TABLE_32。
+ * 调用表外的系统调用时内核直接以 SIGSYS 杀死整个进程（SECCOMP_RET_KILL_PROCESS），
+ * 该信号无法被捕获，因此 watchdog 看到受控程序因 SIGSYS 结束就说明调用了受限的系统调用。
+ * 过滤在内核中完成，受控程序不会像 ptrace 那样在每次系统调用时停下来等待 watchdog。
+ *
+ * 过滤器安装后只允许一次 execve：文件名参数必须是 exec_path 指向的地址，
+ * 受控程序自己发起的 execve 几乎不可能恰好使用同一个地址。
+ *
+ * @param exec_path 接下来要 execve 的程序路径，调用者必须保证在 execve 之前不修改该字符串
+ * @note 必须在子进程中调用，安装后不能再使用表外的系统调用（如 glog 的输出）
+ */
+void install_seccomp_filter(const std::string &exec_path);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <set>
+#include <string>
+
+/**
+ * @brief 查询 CPU 核心的超线程兄弟核心（同一物理核心上的其他逻辑核心）
+ * 来自 /sys/devices/system/cpu/cpu<N>/topology/thread_siblings_list，没有开启超线程时为空
+ */
+std::set<unsigned> smt_siblings_of_cpu(unsigned cpu);
+
+/**
+ * @brief 统计受控程序运行期间 cpuset 中核心的超线程兄弟核心有多忙
+ * 兄弟核心共享物理核心的执行单元和缓存，兄弟核心上运行其他程序时，
+ * 受控程序的运行时间可能增加 20%~40%，meta 文件记录下来以便判断临界的超时是否受到了干扰。
+ * 兄弟核心本身也在 cpuset 中时属于受控程序，不计入统计。
+ */
+struct sibling_monitor {
+    /**
+     * @param cpuset 受控程序能使用的 CPU 核心，如 "0,2-3"
+     */
+    explicit sibling_monitor(const std::string &cpuset);
+
+    /**
+     * @brief 受控程序开始运行时调用，记录兄弟核心在 /proc/stat 中的累计时间
+     */
+    void start();
+
+    /**
+     * @brief 受控程序结束后调用
+     * @return 运行期间兄弟核心处于非空闲状态的时间比例，没有兄弟核心或者无法统计时返回 -1
+     */
+    double finish();
+
+private:
+    /**
+     * @brief 读取兄弟核心的累计时间，单位为时钟滴答
+     */
+    bool read_times(uint64_t &busy, uint64_t &total) const;
+
+    std::set<unsigned> siblings;
+
+    uint64_t start_busy = 0, start_total = 0;
+
+    bool started = false;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "run_result.hpp"
+
+/**
+ * @brief 常驻的 runguard supervisor
+ * 每次执行 runguard 命令都要重新初始化 glog、解析参数、初始化 cgroup、查询用户和用户组，
+ * supervisor 以 root 权限常驻，只在启动时初始化一次，通过 unix socket 接收运行请求：
+ * 1. 请求包括 runguard 的命令行参数、环境变量、工作目录，并通过 SCM_RIGHTS 传递标准输入输出
+ * 2. supervisor 在自身进程中解析参数（用户名和用户组的查询结果可以复用），然后 fork 出一个 worker 执行 runit，
+ *    worker 切换到请求方的工作目录、环境变量和标准输入输出，请求方不是 root 时还会切换到请求方的用户
+ * 3. worker 结束时将返回值和运行结果写回 socket，meta 文件仍然由 worker 写入 --out-meta 指定的位置
+ * 4. 请求方在运行结束前断开连接（如评测脚本被杀死）时，supervisor 向 worker 发送 SIGTERM 结束受控程序
+ *
+ * runguard 命令在设置了 RUNGUARD_SUPERVISOR 环境变量时将参数原样转发给 supervisor，
+ * 因此评测脚本不需要修改。
+ */
+
+/**
+ * @brief 在 socket_path 上监听并处理运行请求，直到收到 SIGTERM 或 SIGINT
+ * @param socket_group 非空时 socket 文件属于该用户组且组内用户可写，否则只有 root 可以连接
+ * @return 进程的退出码
+ */
+int run_supervisor(const std::string &socket_path, const std::string &socket_group);
+
+/**
+ * @brief 请求 supervisor 执行一次 runguard，使用当前进程的环境变量、工作目录和标准输入输出
+ * @param args runguard 的命令行参数，包括 argv[0]
+ * @param exitcode runguard 的返回值
+ * @param result 运行结果
+ * @return false 若无法连接 supervisor，此时调用方可以自行运行
+ */
+bool supervisor_request(const std::string &socket_path, const std::vector<std::string> &args, int &exitcode, run_result &result);
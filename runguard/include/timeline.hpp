@@ -0,0 +1,86 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <vector>
+#include "runguard_options.hpp"
+
+/**
+ * @brief 时间线文件的文件头
+ * 时间线文件由文件头和若干条定长的 timeline_sample 组成，均为小端序
+ */
+struct timeline_header {
+    char magic[4] = {'R', 'G', 'T', 'L'};
+    uint32_t version = 1;
+    uint32_t interval_us = 0;  // 采样间隔
+    uint32_t sample_size = 0;  // sizeof(timeline_sample)，读取方可以据此跳过新版本增加的字段
+};
+
+/**
+ * @brief 一次采样的结果
+ * 除 memory_kb 外都是从受控程序开始运行起的累计值
+ */
+struct timeline_sample {
+    uint32_t time_us;           // 采样时刻
+    uint32_t memory_kb;         // cgroup 当前的内存使用
+    uint32_t cpu_us;            // cgroup 的 CPU 时间
+    uint32_t page_faults;       // cgroup 的缺页次数
+    uint32_t major_faults;      // cgroup 中需要读磁盘的缺页次数
+    uint32_t context_switches;  // 受控程序主进程的上下文切换次数（主动和被动之和）
+    uint32_t read_kb;           // 受控程序主进程读入的字节数
+    uint32_t write_kb;          // 受控程序主进程写出的字节数
+};
+
+/**
+ * @brief 按固定间隔采样受控程序的资源使用，运行结束后写入时间线文件
+ * 采样由 watchdog 的 timerfd 驱动，在 watchdog 进程中读取 cgroup 和 /proc 的统计文件，
+ * 不打断受控程序；采样结果先保存在内存中，运行结束后一次写入，运行期间不产生磁盘 I/O。
+ */
+struct timeline_recorder {
+    /**
+     * @param opt 使用 timeline_filename 和 timeline_interval
+     */
+    explicit timeline_recorder(const runguard_options &opt);
+
+    ~timeline_recorder();
+
+    /**
+     * @brief 受控程序开始运行时调用，开始计时
+     */
+    void start(pid_t child);
+
+    /**
+     * @brief 到达采样时刻时可读的 timerfd，交给 watchdog 监听
+     */
+    int fd() const;
+
+    /**
+     * @brief timerfd 可读时调用，读走事件并采样一次
+     */
+    void sample();
+
+    /**
+     * @brief 受控程序结束后调用，采样最后一次并写入时间线文件
+     */
+    void finish();
+
+private:
+    struct counters {
+        int64_t time_ns, memory_bytes, cpu_time_ns, page_faults, major_faults, context_switches, read_bytes, write_bytes;
+        bool process_alive;  // 能否读到受控程序主进程的 /proc 统计
+    };
+
+    counters read_counters();
+
+    const runguard_options &opt;
+
+    int timer_fd = -1;
+
+    // 受控程序主进程的 /proc/<pid>/status 和 /proc/<pid>/io
+    int status_fd = -1, io_fd = -1;
+
+    // 开始运行时的统计值，复用的 cgroup 中的累计值包含之前的运行
+    counters base;
+
+    std::vector<timeline_sample> samples;
+};
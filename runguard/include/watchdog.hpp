@@ -0,0 +1,69 @@
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <functional>
+#include <vector>
+#include "runguard_options.hpp"
+
+/**
+ * @brief 基于 epoll 的 watchdog 事件循环
+ * 用一个 epoll 同时等待以下事件，不依赖信号处理函数打断阻塞的 wait4：
+ * 1. 受控程序退出：pidfd_open 得到的文件描述符在进程退出时可读（Linux 5.3 起支持，
+ *    旧内核退回到 signalfd 接收 SIGCHLD）
+ * 2. 墙上时间硬限制：到期的 timerfd
+ * 3. runguard 收到 SIGTERM：signalfd
+ * 4. 通过 add 注册的其他事件，如内存超限
+ * 需要结束受控程序时直接杀死整个 cgroup（v2 中是一次 cgroup.kill），
+ * 然后继续等待 pidfd 可读，不需要像 SIGTERM/SIGKILL 那样固定地等待一段时间。
+ */
+struct watchdog {
+    /**
+     * @brief 创建事件循环，必须在 fork 之后的父进程中调用
+     * 这里会阻塞 SIGTERM 并改由 signalfd 接收，因此不能在 fork 之前调用，否则受控程序会继承信号屏蔽字
+     * @param opt 使用 wall_limit 和 cgroupname
+     * @param child 受控程序的进程号
+     */
+    watchdog(const runguard_options &opt, pid_t child);
+
+    ~watchdog();
+
+    /**
+     * @brief 注册一个文件描述符，可读时调用 handler
+     * @param handler 必须读走文件描述符上的事件，否则会被反复调用；返回 true 时杀死受控程序
+     */
+    void add(int fd, std::function<bool()> handler);
+
+    /**
+     * @brief 等待受控程序退出
+     * @param ru 受控程序的资源使用情况
+     * @return wait4 得到的受控程序的退出状态
+     */
+    int wait(struct rusage &ru);
+
+    /**
+     * @brief 受控程序是否因为超过墙上时间硬限制被杀死
+     */
+    bool wall_limit_exceeded() const;
+
+    /**
+     * @brief 受控程序是否因为 runguard 收到 SIGTERM 被杀死
+     */
+    bool terminated() const;
+
+private:
+    void kill_command(const char *reason);
+
+    const runguard_options &opt;
+
+    pid_t child;
+
+    int epoll_fd = -1, child_fd = -1, timer_fd = -1, signal_fd = -1;
+
+    // child_fd 是 signalfd 而不是 pidfd
+    bool child_fd_is_signalfd = false;
+
+    bool wall_timeout = false, signaled = false, killed = false;
+
+    std::vector<std::function<bool()>> handlers;
+};
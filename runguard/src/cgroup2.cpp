@@ -0,0 +1,150 @@
+#include "cgroup2.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <linux/magic.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <time.h>
+#include <unistd.h>
+#include <system_error>
+
+using namespace std;
+
+const char *cgroup2::MOUNT_POINT = "/sys/fs/cgroup";
+
+bool cgroup2::available() {
+    struct statfs fs;
+    if (statfs(MOUNT_POINT, &fs) != 0) return false;
+    return fs.f_type == CGROUP2_SUPER_MAGIC;
+}
+
+cgroup2::cgroup2(const string &cgroup_name)
+    : dir(MOUNT_POINT + cgroup_name) {}
+
+cgroup2::cgroup2(const string &cgroup_name, const string &mount_point)
+    : dir(mount_point + cgroup_name) {}
+
+bool cgroup2::exists() const {
+    return access(dir.c_str(), F_OK) == 0;
+}
+
+const string &cgroup2::path() const {
+    return dir;
+}
+
+void cgroup2::create() {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+        throw system_error(errno, system_category(), fmt::format("unable to create cgroup {}", dir));
+}
+
+void cgroup2::write(const string &name, const string &value) {
+    string file = dir + "/" + name;
+    int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, system_category(), fmt::format("unable to open {}", file));
+    ssize_t ret = ::write(fd, value.data(), value.size());
+    int err = errno;
+    close(fd);
+    if (ret < 0)
+        throw system_error(err, system_category(), fmt::format("unable to write '{}' to {}", value, file));
+}
+
+/**
+ * @brief 读入 cgroupfs 中的一个文件，大多数文件一次 read 即可读完，memory.stat 可能超过一页
+ */
+static string read_file(const string &file) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw system_error(errno, system_category(), fmt::format("unable to open {}", file));
+    string content;
+    char buffer[4096];
+    ssize_t ret;
+    while ((ret = read(fd, buffer, sizeof(buffer))) > 0)
+        content.append(buffer, ret);
+    int err = errno;
+    close(fd);
+    if (ret < 0)
+        throw system_error(err, system_category(), fmt::format("unable to read {}", file));
+    return content;
+}
+
+int64_t cgroup2::read_int64(const string &name) {
+    string content = read_file(dir + "/" + name);
+    if (content.compare(0, 3, "max") == 0) return -1;
+    return stoll(content);
+}
+
+int64_t cgroup2::read_keyed(const string &name, const string &key) {
+    string content = read_file(dir + "/" + name);
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t end = content.find('\n', pos);
+        if (end == string::npos) end = content.size();
+        if (end > pos + key.size() && content.compare(pos, key.size(), key) == 0 && content[pos + key.size()] == ' ')
+            return stoll(content.substr(pos + key.size() + 1, end - pos - key.size() - 1));
+        pos = end + 1;
+    }
+    return -1;
+}
+
+void cgroup2::attach(pid_t pid) {
+    write("cgroup.procs", to_string(pid));
+}
+
+// 被杀死的进程退出需要一点时间
+static const struct timespec retry_delay = {0, 1000000L};  // 1ms
+
+void cgroup2::kill() {
+    string kill_file = dir + "/cgroup.kill";
+    if (access(kill_file.c_str(), F_OK) == 0) {
+        write("cgroup.kill", "1");
+        return;
+    }
+
+    // 内核不支持 cgroup.kill，杀死 cgroup.procs 中的所有进程。
+    // 杀死进程的同时选手程序可能还在 fork，因此先冻结 cgroup，冻结的进程收到 SIGKILL 后仍然会退出。
+    // 处于 D 状态的进程可能一直无法退出，因此限制重试次数
+    bool freeze = access((dir + "/cgroup.freeze").c_str(), F_OK) == 0;
+    if (freeze) write("cgroup.freeze", "1");
+    bool empty = false;
+    for (int retry = 0; retry < 1000; ++retry) {
+        string procs = read_file(dir + "/cgroup.procs");
+        if (procs.empty()) {
+            empty = true;
+            break;
+        }
+        size_t pos = 0;
+        while (pos < procs.size()) {
+            size_t end = procs.find('\n', pos);
+            if (end == string::npos) end = procs.size();
+            if (end > pos) ::kill(stoi(procs.substr(pos, end - pos)), SIGKILL);
+            pos = end + 1;
+        }
+        nanosleep(&retry_delay, nullptr);
+    }
+    // 保持冻结会让下一个租用该 cgroup 的程序无法运行
+    if (freeze) write("cgroup.freeze", "0");
+    if (!empty)
+        throw runtime_error(fmt::format("unable to kill processes in cgroup {}", dir));
+}
+
+void cgroup2::wait_empty() {
+    for (int retry = 0; read_keyed("cgroup.events", "populated") > 0; ++retry) {
+        if (retry >= 1000)
+            throw runtime_error(fmt::format("processes in cgroup {} are still alive", dir));
+        nanosleep(&retry_delay, nullptr);
+    }
+}
+
+void cgroup2::remove() {
+    // 在进程全部退出之前 rmdir 会返回 EBUSY
+    for (int retry = 0; rmdir(dir.c_str()) != 0; ++retry) {
+        if (errno == ENOENT) return;
+        if (errno != EBUSY || retry >= 1000)
+            throw system_error(errno, system_category(), fmt::format("unable to remove cgroup {}", dir));
+        nanosleep(&retry_delay, nullptr);
+    }
+}
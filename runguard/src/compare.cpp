@@ -0,0 +1,330 @@
+#include "compare.hpp"
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <system_error>
+#include "limits.hpp"
+
+using namespace std;
+
+/**
+ * @brief 将连续的空白字符替换为一个空格，并去除行末的空白字符
+ * @param keep_trailing_space 是否保留行末的一个空格，用于还没有输出完的一行
+ */
+static string normalize(const string &line, bool keep_trailing_space = false) {
+    string result;
+    bool space = false;
+    for (char c : line) {
+        if (isspace((unsigned char)c)) {
+            space = true;
+        } else {
+            if (space) result += ' ';
+            space = false;
+            result += c;
+        }
+    }
+    if (space && keep_trailing_space) result += ' ';
+    return result;
+}
+
+output_comparator::output_comparator(const string &expected_file) {
+    ifstream fin(expected_file, ios::binary);
+    if (!fin) throw system_error(errno, system_category(), fmt::format("unable to open expected output {}", expected_file));
+    stringstream buffer;
+    buffer << fin.rdbuf();
+    string content = buffer.str();
+
+    expected_ends_with_newline = content.empty() || content.back() == '\n';
+    size_t begin = 0;
+    while (begin < content.size()) {
+        size_t end = content.find('\n', begin);
+        if (end == string::npos) end = content.size();
+        string line = content.substr(begin, end - begin);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        max_line_length = max(max_line_length, line.size());
+
+        string normalized = normalize(line);
+        if (!normalized.empty()) normalized_lines.push_back(move(normalized));
+        raw_lines.push_back(move(line));
+        begin = end + 1;
+    }
+}
+
+void output_comparator::compare_line(const string &line) {
+    string raw = line;
+    if (!raw.empty() && raw.back() == '\r') raw.pop_back();
+    if (exact && (raw_index >= raw_lines.size() || raw_lines[raw_index] != raw))
+        exact = false;
+    ++raw_index;
+
+    string normalized = normalize(line);
+    if (normalized.empty()) return;  // 宽松比较忽略空行
+    if (normalized_index >= normalized_lines.size() || normalized_lines[normalized_index] != normalized)
+        mismatch = true;
+    ++normalized_index;
+}
+
+bool output_comparator::compare_partial_line() {
+    if (partial.size() > max_line_length + 1) {
+        // 这一行已经比标准输出的任意一行都长，精确比较一定失败，
+        // 只保留宽松比较需要的内容，避免选手程序不换行地输出空白字符占用内存
+        exact = false;
+        partial = normalize(partial, true);
+    }
+
+    // 还没有输出完的一行必须是标准输出对应行的前缀
+    string normalized = normalize(partial);
+    if (normalized.empty()) return true;
+    if (normalized_index >= normalized_lines.size() ||
+        normalized_lines[normalized_index].compare(0, normalized.size(), normalized) != 0)
+        mismatch = true;
+    return !mismatch;
+}
+
+bool output_comparator::feed(const char *data, size_t size) {
+    if (mismatch) return false;
+
+    const char *end = data + size;
+    while (data < end) {
+        const char *newline = (const char *)memchr(data, '\n', end - data);
+        if (!newline) {
+            partial.append(data, end);
+            break;
+        }
+        partial.append(data, newline);
+        compare_line(partial);
+        partial.clear();
+        if (mismatch) return false;
+        data = newline + 1;
+    }
+    return compare_partial_line();
+}
+
+output_comparator::result output_comparator::finish() {
+    if (!mismatch) {
+        bool ends_with_newline = partial.empty();
+        if (!partial.empty()) {
+            compare_line(partial);
+            partial.clear();
+        }
+        if (ends_with_newline != expected_ends_with_newline || raw_index != raw_lines.size())
+            exact = false;
+        if (normalized_index != normalized_lines.size())
+            mismatch = true;
+    }
+
+    if (mismatch) return result::WRONG_ANSWER;
+    return exact ? result::ACCEPTED : result::PRESENTATION_ERROR;
+}
+
+output_monitor::output_monitor(const runguard_options &opt) {
+    if (!opt.compare_filename.empty())
+        comparator = make_unique<output_comparator>(opt.compare_filename);
+    limit = opt.stream_size >= 0 ? (size_t)opt.stream_size * 1024 : numeric_limits<size_t>::max();
+
+    if (pipe2(pipe_fd, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "creating stdout pipe");
+
+    if (opt.capture_output) {
+        capture_fd = memfd_create("runguard-stdout", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (capture_fd < 0)
+            throw system_error(errno, system_category(), "creating memfd for stdout");
+        // 管道越大，受控程序因为管道写满而等待 watchdog 的次数越少，失败时使用默认的 64KB
+        fcntl(pipe_fd[0], F_SETPIPE_SZ, 1 << 20);
+
+        // 读取输出时 watchdog 已经放弃了 root 权限，必须现在打开
+        if (opt.memory_limit >= 0) {
+            memory_limit = opt.memory_limit;
+            memory_fds = cgroup_open_memory_limit(opt);
+        }
+    }
+
+    if (!opt.stdout_filename.empty()) {
+        output_fd = open(opt.stdout_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (output_fd < 0)
+            throw system_error(errno, system_category(), fmt::format("unable to open {}", opt.stdout_filename));
+    }
+}
+
+output_monitor::~output_monitor() {
+    stop();
+    for (int fd : {pipe_fd[0], pipe_fd[1], output_fd, capture_fd})
+        if (fd >= 0) close(fd);
+    for (int fd : memory_fds) close(fd);
+}
+
+void output_monitor::redirect_child() {
+    // dup2 得到的文件描述符不带 FD_CLOEXEC，其余的文件描述符在 exec 时关闭
+    if (dup2(pipe_fd[1], STDOUT_FILENO) < 0)
+        throw system_error(errno, system_category(), "redirecting stdout to pipe");
+}
+
+void output_monitor::start(pid_t pid) {
+    child = pid;
+    // 关闭 watchdog 持有的写端，这样受控程序的进程都退出后读端才能读到 EOF
+    close(pipe_fd[1]);
+    pipe_fd[1] = -1;
+    reader = thread(&output_monitor::read_loop, this);
+}
+
+void output_monitor::stop() {
+    stopping = true;
+    if (reader.joinable()) {
+        reader.join();
+        seal_capture();
+    }
+}
+
+ssize_t output_monitor::read_pipe(vector<char> &buffer, size_t &accepted) {
+    size_t room = limit - written;
+    if (capture_fd < 0) {
+        ssize_t n = read(pipe_fd[0], buffer.data(), buffer.size());
+        if (n <= 0) return n;
+        accepted = min((size_t)n, room);
+        for (size_t offset = 0; output_fd >= 0 && offset < accepted;) {
+            ssize_t w = write(output_fd, buffer.data() + offset, accepted - offset);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                LOG(ERROR) << "writing stdout file: " << strerror(errno);
+                close(output_fd);
+                output_fd = -1;
+                break;
+            }
+            offset += w;
+        }
+        written += accepted;
+        return n;
+    }
+
+    // 多移入一个字节才能知道输出是否超过了限制，超出的字节在 seal_capture 中截断
+    size_t length = room >= buffer.size() ? buffer.size() : room + 1;
+    loff_t offset = written;
+    ssize_t n = splice(pipe_fd[0], nullptr, capture_fd, &offset, length, SPLICE_F_MOVE);
+    if (n <= 0) return n;
+    accepted = min((size_t)n, room);
+    if (comparator && accepted > 0 && pread(capture_fd, buffer.data(), accepted, written) != (ssize_t)accepted)
+        return -1;
+    written += accepted;
+    return n;
+}
+
+void output_monitor::seal_capture() {
+    if (capture_fd < 0) return;
+
+    if (ftruncate(capture_fd, written) != 0)
+        LOG(ERROR) << "truncating captured stdout: " << strerror(errno);
+    if (fcntl(capture_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+        LOG(ERROR) << "sealing captured stdout: " << strerror(errno);
+
+    for (off_t offset = 0; output_fd >= 0 && offset < (off_t)written;) {
+        ssize_t n = sendfile(output_fd, capture_fd, &offset, written - offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            LOG(ERROR) << "writing stdout file: " << strerror(errno);
+            break;
+        }
+    }
+}
+
+// 按 1MB 的粒度调整内存限制，减少 cgroupfs 的写入
+static const size_t CHARGE_STEP = 1 << 20;
+
+bool output_monitor::charge_memory() {
+    if (memory_fds.empty() || written <= charged) return true;
+    charged = (written + CHARGE_STEP - 1) / CHARGE_STEP * CHARGE_STEP;
+    if ((int64_t)charged >= memory_limit) return false;
+    try {
+        return cgroup_set_memory_limit(memory_fds, memory_limit - charged);
+    } catch (exception &e) {
+        LOG(ERROR) << "charging captured stdout: " << e.what();
+        for (int fd : memory_fds) close(fd);
+        memory_fds.clear();
+        return true;
+    }
+}
+
+void output_monitor::read_loop() {
+    // 受控程序退出后，它的子进程可能仍然持有管道的写端，
+    // 此时只读取管道中剩余的数据，不再等待 EOF
+    const int DRAIN_ROUNDS = 16;
+    int drain_rounds = 0;
+
+    vector<char> buffer(1 << 16);
+    while (!stopping || drain_rounds++ < DRAIN_ROUNDS) {
+        struct pollfd pfd = {pipe_fd[0], POLLIN, 0};
+        int ret = poll(&pfd, 1, 100);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            LOG(ERROR) << "polling stdout pipe: " << strerror(errno);
+            break;
+        }
+        if (ret == 0) {
+            if (stopping) break;
+            continue;
+        }
+
+        size_t accepted = 0;
+        ssize_t n = read_pipe(buffer, accepted);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG(ERROR) << "reading stdout pipe: " << strerror(errno);
+            break;
+        }
+        if (n == 0) break;  // EOF
+
+        if (accepted < (size_t)n) {
+            over_limit = true;
+            LOG(WARNING) << "Output Limit Exceeded: aborting command";
+        } else if (!charge_memory()) {
+            over_memory = true;
+            LOG(WARNING) << "Memory Limit Exceeded (captured stdout): aborting command";
+        } else if (comparator && !comparator->feed(buffer.data(), accepted)) {
+            mismatch = true;
+            LOG(WARNING) << "Output mismatch at byte " << written << ": aborting command";
+        }
+
+        if (over_limit || over_memory || mismatch) {
+            if (kill(-child, SIGKILL) != 0 && errno != ESRCH)
+                LOG(ERROR) << "unable to send SIGKILL to command: " << strerror(errno);
+            break;
+        }
+    }
+}
+
+bool output_monitor::comparing() const {
+    return comparator != nullptr;
+}
+
+output_comparator::result output_monitor::result() {
+    return comparator->finish();
+}
+
+bool output_monitor::memory_exceeded() const {
+    return over_memory;
+}
+
+size_t output_monitor::captured_bytes() const {
+    return capture_fd >= 0 ? written : 0;
+}
+
+bool output_monitor::killed_on_mismatch() const {
+    return mismatch;
+}
+
+bool output_monitor::truncated() const {
+    return over_limit;
+}
+
+size_t output_monitor::bytes() const {
+    return written;
+}
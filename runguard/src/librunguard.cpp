@@ -0,0 +1,43 @@
+#include "librunguard.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <system_error>
+#include "run.hpp"
+
+using namespace std;
+
+run_result runguard_run(const run_request &request, int &exitcode) {
+    int pipe_fd[2];
+    if (pipe2(pipe_fd, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "creating result pipe");
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        int err = errno;
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        throw system_error(err, system_category(), "unable to fork runguard");
+    }
+    if (pid == 0) {
+        close(pipe_fd[0]);
+        set_result_fd(pipe_fd[1]);
+        exit(runit(request));
+    }
+
+    close(pipe_fd[1]);
+    run_result result;
+    bool received = receive_result(pipe_fd[0], exitcode, result);
+    close(pipe_fd[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (!received) {
+        exitcode = EXIT_FAILURE;
+        result.internal_error = WIFSIGNALED(status) ? "runguard killed by signal " + to_string(WTERMSIG(status))
+                                                    : "runguard exited without result";
+    }
+    return result;
+}
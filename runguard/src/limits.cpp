@@ -1,19 +1,110 @@
 #include "limits.hpp"
 #include <glog/logging.h>
 #include <fmt/core.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <libcgroup.h>
 #include <signal.h>
 #include <math.h>
+#include <sys/eventfd.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/resource.h>
 #include <unistd.h>
+#include <limits>
 #include <system_error>
 #include "cgroup.hpp"
+#include "cgroup2.hpp"
+#include "numa.hpp"
 #include "utils.hpp"
 
 using namespace std;
 
+static bool use_cgroup2 = false;
+
+/**
+ * 当前租用的 cgroup 的状态，参见 cgroup_lease
+ */
+static struct {
+    bool leased = false;
+
+    // 持有期间对锁文件加 flock，进程退出时内核自动释放
+    int lock_fd = -1;
+
+    // v2 中重置过的 memory.peak，只有通过这个文件描述符才能读到重置后的峰值，
+    // 内核不支持重置（Linux 6.12 之前）时为 -1
+    int peak_fd = -1;
+
+    // 租用时 cgroup 已有的 CPU 时间（纳秒）和 OOM 次数，v1 中 CPU 时间可以直接清零
+    int64_t cpu_base = 0;
+    int64_t oom_base = 0;
+} lease;
+
+void cgroup_backend_init() {
+    // supervisor 启动时已经初始化过，fork 出的 worker 不需要再次初始化
+    static bool initialized = false;
+    if (initialized) return;
+    initialized = true;
+
+    use_cgroup2 = cgroup2::available();
+    if (use_cgroup2) {
+        LOG(INFO) << "using cgroup v2";
+    } else {
+        cgroup_guard::init();
+    }
+}
+
+bool cgroup_is_v2() {
+    return use_cgroup2;
+}
+
+static void cgroup2_configure(cgroup2 &cg, const struct runguard_options &opt) {
+    // swap 限制为 0 可以强制不发生交换，memory.max 就是 RAM+交换 的限制
+    cg.write("memory.max", opt.memory_limit < 0 ? "max" : to_string(opt.memory_limit));
+    try {
+        cg.write("memory.swap.max", "0");
+    } catch (system_error &e) {
+        if (e.code().value() != ENOENT) throw;
+        LOG(WARNING) << "swap accounting is disabled, memory limit does not include swap";
+    }
+
+    if (!opt.cpuset.empty()) {
+        // 设置选手程序能使用的 CPU，内存只从这些 CPU 所在的 NUMA 节点分配，
+        // 无法得到 NUMA 拓扑时 cpuset.mems 保持为空，继承父 cgroup 的内存节点
+        cg.write("cpuset.cpus", opt.cpuset);
+        string mems = numa_mems_of_cpuset(opt.cpuset);
+        if (!mems.empty()) cg.write("cpuset.mems", mems);
+    } else {
+        LOG(INFO) << "cpuset undefined";
+    }
+
+    // pids.max 和 RLIMIT_NPROC 不同，只统计 cgroup 内的进程，不受同一用户的其他进程影响
+    if (opt.nproc != numeric_limits<size_t>::max())
+        cg.write("pids.max", to_string(opt.nproc));
+    else if (lease.leased)  // 复用的 cgroup 可能保留着上次运行的限制
+        cg.write("pids.max", "max");
+}
+
+/**
+ * @brief v1 的 cpuset.mems 不能为空，没有 NUMA 支持的内核只有节点 0
+ */
+static string cgroup1_mems(const struct runguard_options &opt) {
+    string mems = numa_mems_of_cpuset(opt.cpuset);
+    return mems.empty() ? "0" : mems;
+}
+
+static void cgroup2_create(const struct runguard_options &opt) {
+    cgroup2 cg(opt.cgroupname);
+    cg.create();
+    cgroup2_configure(cg, opt);
+}
+
 void cgroup_create(const struct runguard_options &opt) {
+    if (use_cgroup2) {
+        cgroup2_create(opt);
+        return;
+    }
+
     cgroup_guard cg(opt.cgroupname);
 
     // 初始化 memory 资源管控器
@@ -30,8 +121,8 @@ void cgroup_create(const struct runguard_options &opt) {
         // 设置选手程序能使用的 CPU（我们必须让这些程序独占 CPU 以避免时间计量不准确
         cgroup_ctrl cpuset_ctrl = cg.add_controller("cpuset");
 
-        // TODO: cpuset.mems 需要被设置为对应的 NUMA 以避免跨 NUMA 导致内存访问慢
-        cpuset_ctrl.add_value("cpuset.mems", "0");
+        // cpuset.mems 设置为这些 CPU 所在的 NUMA 节点，避免跨 NUMA 导致内存访问慢
+        cpuset_ctrl.add_value("cpuset.mems", cgroup1_mems(opt));
         cpuset_ctrl.add_value("cpuset.cpus", opt.cpuset);
     } else {
         LOG(INFO) << "cpuset undefined";
@@ -43,13 +134,187 @@ void cgroup_create(const struct runguard_options &opt) {
     cg.create_cgroup(1);
 }
 
+static void cgroup2_lease(const struct runguard_options &opt) {
+    cgroup2 cg(opt.cgroupname);
+    cg.create();
+
+    // 上一个租用者异常退出时可能残留进程
+    cg.kill();
+    cg.wait_empty();
+    cgroup2_configure(cg, opt);
+
+    // 回收上次运行留下的页缓存，避免计入本次的内存峰值；内存回收不完全时返回 EAGAIN，可以忽略
+    try {
+        int64_t current = cg.read_int64("memory.current");
+        if (current > 0) cg.write("memory.reclaim", to_string(current));
+    } catch (system_error &e) {
+        LOG(INFO) << e.what();
+    }
+
+    lease.cpu_base = cg.read_keyed("cpu.stat", "usage_usec") * 1000;
+    lease.oom_base = cg.read_keyed("memory.events", "oom_kill");
+
+    // 向 memory.peak 写入任意内容会重置通过该文件描述符读到的峰值
+    string peak_file = cg.path() + "/memory.peak";
+    lease.peak_fd = open(peak_file.c_str(), O_RDWR | O_CLOEXEC);
+    if (lease.peak_fd >= 0 && write(lease.peak_fd, "reset\n", 6) < 0) {
+        close(lease.peak_fd);
+        lease.peak_fd = -1;
+    }
+    if (lease.peak_fd < 0)
+        LOG(WARNING) << "unable to reset " << peak_file << ", using max rss instead";
+}
+
+static void cgroup1_lease(const struct runguard_options &opt) {
+    // v1 的每个控制器都是单独的层级，直接读写各控制器下的文件夹
+    cgroup2 memory(opt.cgroupname, "/sys/fs/cgroup/memory");
+    cgroup2 cpuacct(opt.cgroupname, "/sys/fs/cgroup/cpuacct");
+    cgroup2 cpuset(opt.cgroupname, "/sys/fs/cgroup/cpuset");
+
+    // 第一次租用时通过 libcgroup 创建，之后一直保留
+    if (!memory.exists() || !cpuacct.exists() || !cpuset.exists()) {
+        cgroup_create(opt);
+    } else {
+        cgroup_kill(opt);
+
+        // 先取消 RAM+交换 的限制，否则调整 memory.limit_in_bytes 时可能违反 limit_in_bytes <= memsw.limit_in_bytes
+        string limit = opt.memory_limit < 0 ? "-1" : to_string(opt.memory_limit);
+        memory.write("memory.memsw.limit_in_bytes", "-1");
+        memory.write("memory.limit_in_bytes", limit);
+        memory.write("memory.memsw.limit_in_bytes", limit);
+
+        // cgroup 内没有进程时回收所有页缓存
+        try {
+            memory.write("memory.force_empty", "0");
+        } catch (system_error &e) {
+            LOG(INFO) << e.what();
+        }
+
+        cpuset.write("cpuset.mems", cgroup1_mems(opt));
+        cpuset.write("cpuset.cpus", opt.cpuset);
+    }
+
+    memory.write("memory.max_usage_in_bytes", "0");
+    memory.write("memory.memsw.max_usage_in_bytes", "0");
+    cpuacct.write("cpuacct.usage", "0");
+    lease.cpu_base = 0;
+    lease.oom_base = max<int64_t>(memory.read_keyed("memory.oom_control", "oom_kill"), 0);
+}
+
+bool cgroup_lease(struct runguard_options &opt) {
+    string lock_file = fmt::format("/tmp/runguard_core_{}.lock", opt.cpuset);
+    int fd = open(lock_file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        throw system_error(errno, generic_category(), fmt::format("unable to open {}", lock_file));
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        int err = errno;
+        close(fd);
+        if (err != EWOULDBLOCK)
+            throw system_error(err, generic_category(), fmt::format("unable to lock {}", lock_file));
+        LOG(INFO) << "cgroup of cpuset " << opt.cpuset << " is in use";
+        return false;
+    }
+
+    opt.cgroupname = fmt::format("/judger/core_{}", opt.cpuset);
+    lease.leased = true;
+    lease.lock_fd = fd;
+
+    if (use_cgroup2)
+        cgroup2_lease(opt);
+    else
+        cgroup1_lease(opt);
+
+    LOG(INFO) << "leased cgroup " << opt.cgroupname;
+    return true;
+}
+
 void cgroup_attach(const struct runguard_options &opt) {
+    if (use_cgroup2) {
+        cgroup2(opt.cgroupname).attach(getpid());
+        return;
+    }
+
     cgroup_guard cg(opt.cgroupname);
     cg.get_cgroup();
     cg.attach_task();
 }
 
+vector<int> cgroup_open_procs(const struct runguard_options &opt) {
+    vector<string> dirs;
+    if (use_cgroup2) {
+        dirs.push_back(cgroup2(opt.cgroupname).path());
+    } else {
+        // 和 cgroup1_lease 一样直接访问各控制器的层级，没有使用 cpuset 时 cpuset 下没有这个 cgroup
+        for (auto mount_point : {"/sys/fs/cgroup/memory", "/sys/fs/cgroup/cpuacct", "/sys/fs/cgroup/cpuset"}) {
+            cgroup2 cg(opt.cgroupname, mount_point);
+            if (cg.exists()) dirs.push_back(cg.path());
+        }
+    }
+
+    vector<int> fds;
+    for (auto &dir : dirs) {
+        string file = dir + "/cgroup.procs";
+        int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            int err = errno;
+            for (int opened : fds) close(opened);
+            throw system_error(err, generic_category(), fmt::format("unable to open {}", file));
+        }
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+void cgroup_attach_fds(const vector<int> &fds) {
+    for (int fd : fds) {
+        // 向 cgroup.procs 写入 0 表示移入写入的进程自己，不需要知道自己在宿主机上的进程号
+        if (write(fd, "0", 1) != 1)
+            throw system_error(errno, generic_category(), "unable to attach to cgroup");
+        close(fd);
+    }
+}
+
+vector<int> cgroup_open_memory_limit(const struct runguard_options &opt) {
+    vector<string> files;
+    if (use_cgroup2) {
+        files.push_back(cgroup2(opt.cgroupname).path() + "/memory.max");
+    } else {
+        // 降低限制时必须先改 limit_in_bytes，保证 limit_in_bytes <= memsw.limit_in_bytes
+        string dir = cgroup2(opt.cgroupname, "/sys/fs/cgroup/memory").path();
+        files.push_back(dir + "/memory.limit_in_bytes");
+        files.push_back(dir + "/memory.memsw.limit_in_bytes");
+    }
+
+    vector<int> fds;
+    for (auto &file : files) {
+        int fd = open(file.c_str(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            int err = errno;
+            for (int opened : fds) close(opened);
+            throw system_error(err, generic_category(), fmt::format("unable to open {}", file));
+        }
+        fds.push_back(fd);
+    }
+    return fds;
+}
+
+bool cgroup_set_memory_limit(const vector<int> &fds, int64_t bytes) {
+    string value = to_string(bytes);
+    for (int fd : fds) {
+        if (pwrite(fd, value.data(), value.size(), 0) == (ssize_t)value.size()) continue;
+        // v1 无法回收到新的限制以下时返回 EBUSY，v2 则直接触发 OOM killer
+        if (errno == EBUSY) return false;
+        throw system_error(errno, generic_category(), "unable to set memory limit");
+    }
+    return true;
+}
+
 void cgroup_kill(const struct runguard_options &opt) {
+    if (use_cgroup2) {
+        cgroup2(opt.cgroupname).kill();
+        return;
+    }
+
     void *ptr = nullptr;
     pid_t pid;
 
@@ -62,7 +327,151 @@ void cgroup_kill(const struct runguard_options &opt) {
     }
 }
 
+int cgroup_watch_oom(const struct runguard_options &opt) {
+    if (use_cgroup2) {
+        // memory.events 中的计数变化时内核会产生文件修改事件
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0)
+            throw system_error(errno, generic_category(), "inotify_init1");
+        string file = cgroup2(opt.cgroupname).path() + "/memory.events";
+        if (inotify_add_watch(fd, file.c_str(), IN_MODIFY) < 0) {
+            int err = errno;
+            close(fd);
+            throw system_error(err, generic_category(), fmt::format("unable to watch {}", file));
+        }
+        return fd;
+    }
+
+    // 向 cgroup.event_control 写入 "<eventfd> <memory.oom_control 的文件描述符>" 订阅 OOM 事件
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd < 0)
+        throw system_error(errno, generic_category(), "requesting event fd");
+    cgroup2 memory(opt.cgroupname, "/sys/fs/cgroup/memory");
+    string oom_control = memory.path() + "/memory.oom_control";
+    int ofd = open(oom_control.c_str(), O_RDONLY | O_CLOEXEC);
+    if (ofd < 0) {
+        int err = errno;
+        close(efd);
+        throw system_error(err, generic_category(), fmt::format("unable to open {}", oom_control));
+    }
+    try {
+        memory.write("cgroup.event_control", fmt::format("{} {}", efd, ofd));
+    } catch (...) {
+        close(efd);
+        close(ofd);
+        throw;
+    }
+    // 注册之后内核持有 memory.oom_control 的引用，可以关闭
+    close(ofd);
+    return efd;
+}
+
+bool cgroup_oom_triggered(const struct runguard_options &opt, int fd) {
+    if (use_cgroup2) {
+        char buffer[4096];
+        while (read(fd, buffer, sizeof(buffer)) > 0)
+            ;
+        // memory.events 中的其他计数（如 high、max）变化也会产生事件
+        return cgroup2(opt.cgroupname).read_keyed("memory.events", "oom_kill") > lease.oom_base;
+    }
+
+    uint64_t count;
+    return read(fd, &count, sizeof(count)) == sizeof(count) && count > 0;
+}
+
+static cgroup_usage cgroup2_read_usage(const struct runguard_options &opt) {
+    cgroup2 cg(opt.cgroupname);
+    cgroup_usage usage;
+
+    try {
+        if (lease.peak_fd >= 0) {
+            char buffer[32];
+            ssize_t len = pread(lease.peak_fd, buffer, sizeof(buffer) - 1, 0);
+            if (len < 0)
+                throw system_error(errno, generic_category(), "unable to read memory.peak");
+            usage.memory_bytes = stoll(string(buffer, len));
+        } else if (lease.leased) {
+            // 复用的 cgroup 的 memory.peak 包含之前所有运行的峰值
+            throw runtime_error("memory.peak of leased cgroup cannot be reset");
+        } else {
+            usage.memory_bytes = cg.read_int64("memory.peak");
+        }
+    } catch (exception &e) {
+        // memory.peak 需要 Linux 5.19，旧内核只能使用子进程的最大常驻内存
+        struct rusage ru;
+        if (getrusage(RUSAGE_CHILDREN, &ru) != 0)
+            throw system_error(errno, generic_category(), "getrusage");
+        usage.memory_bytes = (int64_t)ru.ru_maxrss * 1024;
+        LOG(WARNING) << e.what() << ", using max rss instead";
+    }
+
+    usage.cpu_time_ns = cg.read_keyed("cpu.stat", "usage_usec") * 1000 - lease.cpu_base;
+    usage.oom = cg.read_keyed("memory.events", "oom_kill") > lease.oom_base;
+
+    // pids.peak 需要 Linux 6.1，并且和 memory.peak 不同，无法为复用的 cgroup 清零
+    usage.peak_pids = -1;
+    if (!lease.leased) {
+        try {
+            usage.peak_pids = cg.read_int64("pids.peak");
+        } catch (exception &) {
+        }
+    }
+    return usage;
+}
+
+cgroup_usage cgroup_read_usage(const struct runguard_options &opt) {
+    if (use_cgroup2) return cgroup2_read_usage(opt);
+
+    cgroup_usage usage;
+    cgroup_guard guard(opt.cgroupname);
+    guard.get_cgroup();  // prepare for get_controller
+
+    {
+        cgroup_ctrl ctrl = guard.get_controller("memory");
+        usage.memory_bytes = ctrl.get_value_int64("memory.memsw.max_usage_in_bytes");
+    }
+    {
+        cgroup_ctrl ctrl = guard.get_controller("cpuacct");
+        usage.cpu_time_ns = ctrl.get_value_int64("cpuacct.usage");
+    }
+
+    // 旧内核的 memory.oom_control 中没有 oom_kill，此时返回 -1
+    usage.oom = cgroup2(opt.cgroupname, "/sys/fs/cgroup/memory").read_keyed("memory.oom_control", "oom_kill") > lease.oom_base;
+    usage.peak_pids = -1;  // v1 中没有使用 pids 控制器
+    return usage;
+}
+
+cgroup_sample cgroup_read_sample(const struct runguard_options &opt) {
+    cgroup_sample sample;
+    if (use_cgroup2) {
+        cgroup2 cg(opt.cgroupname);
+        sample.memory_bytes = cg.read_int64("memory.current");
+        sample.cpu_time_ns = cg.read_keyed("cpu.stat", "usage_usec") * 1000;
+        sample.page_faults = cg.read_keyed("memory.stat", "pgfault");
+        sample.major_faults = cg.read_keyed("memory.stat", "pgmajfault");
+    } else {
+        cgroup2 memory(opt.cgroupname, "/sys/fs/cgroup/memory");
+        sample.memory_bytes = memory.read_int64("memory.usage_in_bytes");
+        sample.cpu_time_ns = cgroup2(opt.cgroupname, "/sys/fs/cgroup/cpuacct").read_int64("cpuacct.usage");
+        sample.page_faults = memory.read_keyed("memory.stat", "pgfault");
+        sample.major_faults = memory.read_keyed("memory.stat", "pgmajfault");
+    }
+    return sample;
+}
+
 void cgroup_delete(const struct runguard_options &opt) {
+    if (use_cgroup2) {
+        cgroup2 cg(opt.cgroupname);
+        if (lease.leased)
+            cg.wait_empty();
+        else
+            cg.remove();
+        return;
+    }
+
+    // cgroup_kill 在 v1 中会等到 cgroup 中没有进程为止，复用的 cgroup 无需再等待
+    if (lease.leased) return;
+
     cgroup_guard cg(opt.cgroupname);
     cg.add_controller("cpuacct");
     cg.add_controller("memory");
@@ -82,7 +491,7 @@ void set_rlimit(int resource, rlim_t cur, rlim_t max) {
         throw system_error(errno, generic_category(), "setrlimit");
 }
 
-void set_restrictions(const struct runguard_options &opt) {
+void set_restrictions(const struct runguard_options &opt, const vector<int> &cgroup_procs) {
     if (!opt.preserve_sys_env) {
         char *path = getenv("PATH");
         environ[0] = nullptr;
@@ -116,17 +525,22 @@ void set_restrictions(const struct runguard_options &opt) {
     if (opt.nproc > 0) set_rlimit(RLIMIT_NPROC, opt.nproc, opt.nproc);
     if (opt.no_core_dumps) set_rlimit(RLIMIT_CORE, 0, 0);
 
-    // put child process in the control group
-    cgroup_attach(opt);
+    // put child process in the control group,
+    // the sandbox has no cgroupfs, so join through the files opened by init
+    if (opt.mounts.empty())
+        cgroup_attach(opt);
+    else
+        cgroup_attach_fds(cgroup_procs);
 
     // run the command in a separate process group,
     // so the command and all its child processes can be killed
-    // off with one signal
-    if (setsid() == -1)
+    // off with one signal, in the sandbox it stays in the group of init
+    if (opt.mounts.empty() && setsid() == -1)
         throw system_error(errno, generic_category(), "unable to setsid");
 
-    // set root directory and change working directory
-    if (!opt.chroot_dir.empty()) {
+    // set root directory and change working directory,
+    // the init process of the sandbox has already entered it
+    if (opt.mounts.empty() && !opt.chroot_dir.empty()) {
         if (chroot(opt.chroot_dir.c_str()) != 0)
             throw system_error(errno, generic_category(), fmt::format("unable to chroot to {}", opt.chroot_dir));
         if (chdir("/") != 0)
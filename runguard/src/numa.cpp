@@ -0,0 +1,56 @@
+#include "numa.hpp"
+#include <dirent.h>
+#include <fmt/core.h>
+#include <stdexcept>
+#include "utils.hpp"
+
+using namespace std;
+
+set<unsigned> parse_cpu_list(const string &list) {
+    set<unsigned> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == string::npos) end = list.size();
+        string token = list.substr(pos, end - pos);
+        size_t dash = token.find('-');
+        string first = token.substr(0, dash), last = dash == string::npos ? first : token.substr(dash + 1);
+        if (!is_number(first) || !is_number(last) || stoul(first) > stoul(last))
+            throw invalid_argument(fmt::format("invalid cpu list {}", list));
+        for (unsigned cpu = stoul(first); cpu <= stoul(last); ++cpu) cpus.insert(cpu);
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+int numa_node_of_cpu(unsigned cpu) {
+    string dir = fmt::format("/sys/devices/system/cpu/cpu{}", cpu);
+    DIR *dp = opendir(dir.c_str());
+    if (!dp) return -1;
+    int node = -1;
+    while (struct dirent *entry = readdir(dp)) {
+        string name = entry->d_name;
+        if (name.compare(0, 4, "node") == 0 && is_number(name.substr(4))) {
+            node = stoi(name.substr(4));
+            break;
+        }
+    }
+    closedir(dp);
+    return node;
+}
+
+string numa_mems_of_cpuset(const string &cpuset) {
+    set<int> nodes;
+    for (unsigned cpu : parse_cpu_list(cpuset)) {
+        int node = numa_node_of_cpu(cpu);
+        if (node < 0) return "";
+        nodes.insert(node);
+    }
+
+    string mems;
+    for (int node : nodes) {
+        if (!mems.empty()) mems += ',';
+        mems += to_string(node);
+    }
+    return mems;
+}
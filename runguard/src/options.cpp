@@ -0,0 +1,234 @@
+#include "options.hpp"
+#include <math.h>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+#include "sandbox.hpp"
+#include "system.hpp"
+#include "utils.hpp"
+
+using namespace std;
+
+void validate(boost::any& v, const vector<string>& values, size_t*, int) {
+    using namespace boost::program_options;
+    validators::check_first_occurrence(v);
+
+    string const& s = validators::get_single_string(values);
+    if (s[0] == '-') {
+        throw validation_error(validation_error::invalid_option_value);
+    }
+
+    v = boost::lexical_cast<size_t>(s);
+}
+
+void validate(boost::any& v, const vector<string>& values, struct time_limit*, int) {
+    using namespace boost::program_options;
+    validators::check_first_occurrence(v);
+
+    struct time_limit result;
+    string const& s = validators::get_single_string(values);
+    auto colon = s.find(':');
+    string left = s.substr(0, colon);
+    string right = colon < s.size() ? s.substr(colon + 1) : "";
+
+    result.soft = boost::lexical_cast<double>(left);
+    if (right.size())
+        result.hard = boost::lexical_cast<double>(right);
+    else
+        result.hard = result.soft;
+
+    if (result.hard < result.soft ||
+        !finite(result.hard) || !finite(result.soft) ||
+        result.hard < 0 || result.soft < 0)
+        throw validation_error(validation_error::invalid_option_value);
+
+    v = result;
+}
+
+int parse_options(int argc, const char* argv[], runguard_options& opt, ostream& out, ostream& err) {
+    namespace po = boost::program_options;
+    po::options_description desc("runguard options");
+    po::positional_options_description pos;
+    po::variables_map vm;
+
+    // clang-format off
+    desc.add_options()
+        ("root,r", po::value<string>(), "run command with root directory set to root. If this option is provided, running command is executed relative to the chroot.")
+        ("user,u", po::value<string>(), "run command as user with username or user id")
+        ("work", po::value<string>(), "work directory for command")
+        ("overlay", po::value<vector<string>>(), "mount overlayfs in the sandbox (e.g. \"/:lowerdir=chroot,upperdir=work,workdir=ofs\"), target / becomes the root directory, can be repeated")
+        ("bind", po::value<vector<string>>(), "bind mount source to target in the sandbox read-write (e.g. \"feedback:/feedback\"), can be repeated")
+        ("bind-ro", po::value<vector<string>>(), "bind mount source to target in the sandbox read-only, can be repeated")
+        ("group,g", po::value<string>(), "run command under group with groupname or group id. If only 'user' is set, this defaults to the same")
+        ("wall-time,T", po::value<time_limit>(), "kill command after wall time clock seconds (floating point is acceptable)")
+        ("cpu-time,t", po::value<time_limit>(), "set maximum CPU time (floating point is acceptable) consumption of the command in seconds")
+        ("count-instructions", "count user space instructions retired by command with perf_event, written to the meta file")
+        ("instruction-limit", po::value<time_limit>(), "set maximum number of instructions retired by command (e.g. 1e9:3e9 for soft and hard limit), implies --count-instructions")
+        ("memory-limit,m", po::value<size_t>(), "set maximum memory consumption of the command in KB")
+        ("file-limit,f", po::value<size_t>(), "set maximum created file size of the command in KB")
+        ("nproc,p", po::value<size_t>(), "set maximum process living simutanously")
+        ("cpuset,P", po::value<string>(), "set the processor IDs that can only be used (e.g. \"0,2-3\")")
+        ("reuse-cgroup", "lease the pre-created cgroup /judger/core_<cpuset> instead of creating a new one for every run, requires --cpuset")
+        ("ptrace", "enable ptrace for protection instead of unshare")
+        ("seccomp", "filter system calls of command with seccomp-bpf, using the same syscall table as ptrace but without stopping the command on every system call")
+        ("no-core-dumps,c", "disable core dumps")
+        ("standard-input-file,i", po::value<string>(), "redirect command standard input fd to file")
+        ("standard-output-file,o", po::value<string>(), "redirect command standard output fd to file")
+        ("standard-error-file,e", po::value<string>(), "redirect command standard error fd to file")
+        ("stream-size", po::value<size_t>(), "truncate command output streams at the size in KB")
+        ("compare-output", po::value<string>(), "compare command standard output with the file while running, and kill command on the first mismatch")
+        ("capture-output", "capture command standard output in memory instead of writing it while running, kill command as soon as it exceeds --stream-size, and write --standard-output-file after command exits")
+        ("timeline", po::value<string>(), "sample memory, CPU time, page faults, context switches and I/O of command periodically and write the binary timeline to file")
+        ("timeline-interval", po::value<double>(), "sampling interval of --timeline in milliseconds (default 10, at least 1)")
+        ("environment,E", "preseve system environment variables (or only PATH is loaded)")
+        ("variable,V", po::value<vector<string>>(), "add additional environment variables (e.g. -Vkey1=value1 -Vkey2=value2)")
+        ("out-meta,M", po::value<string>(), "write runguard monitor results (run time, exitcode, memory usage, ...) to file")
+        ("meta-format", po::value<string>(), "format of --out-meta: text (default, key: value per line), json or binary")
+        ("cmd", po::value<vector<string>>()->composing()->required(), "commands")
+        ("help", "display this help text")
+        ("version", "display version of this application");
+    // clang-format on
+
+    pos.add("cmd", -1);
+
+    try {
+        po::store(po::command_line_parser(argc, argv)
+                      .options(desc)
+                      .positional(pos)
+                      .allow_unregistered()
+                      .run(),
+                  vm);
+        po::notify(vm);
+    } catch (po::error& e) {
+        err << e.what() << endl
+            << endl;
+        err << desc << endl;
+        return 1;
+    }
+
+    if (vm.count("help")) {
+        out << "Runguard: Running user program in protected mode with system resource access limitations." << endl
+            << "This app requires root privilege if either 'root' or 'user' option is provided." << endl
+            << "Usage: " << argv[0] << " [options] -- [command]" << endl
+            << "       " << argv[0] << " --daemon <socket> [--socket-group <group>] to start the resident supervisor, "
+            << "then runguard forwards runs to it when RUNGUARD_SUPERVISOR=<socket> is set" << endl;
+        out << desc << endl;
+        return 0;
+    }
+
+    if (vm.count("version")) {
+        out << "runguard" << endl;
+        return 0;
+    }
+
+    if (vm.count("root")) {
+        opt.chroot_dir = vm["root"].as<string>();
+    }
+
+    if (vm.count("user")) {
+        string user = vm["user"].as<string>();
+        if (is_number(user)) {
+            opt.user_id = boost::lexical_cast<int>(user);
+        } else {
+            opt.user_id = get_userid(user.c_str());
+        }
+    }
+
+    if (vm.count("group") || vm.count("user")) {
+        string group = vm["group"].as<string>();
+        if (is_number(group)) {
+            opt.group_id = boost::lexical_cast<int>(group);
+        } else {
+            opt.group_id = get_groupid(group.c_str());
+        }
+    }
+
+    if (vm.count("work")) opt.work_dir = vm["work"].as<string>();
+
+    try {
+        if (vm.count("overlay"))
+            for (auto& value : vm["overlay"].as<vector<string>>())
+                opt.mounts.push_back(parse_overlay(value));
+        if (vm.count("bind"))
+            for (auto& value : vm["bind"].as<vector<string>>())
+                opt.mounts.push_back(parse_bind(value, false));
+        if (vm.count("bind-ro"))
+            for (auto& value : vm["bind-ro"].as<vector<string>>())
+                opt.mounts.push_back(parse_bind(value, true));
+    } catch (invalid_argument& e) {
+        err << e.what() << endl;
+        return 1;
+    }
+
+    if (vm.count("variable")) {
+        opt.env = vm["variable"].as<vector<string>>();
+    }
+
+    if (vm.count("wall-time")) opt.use_wall_limit = true, opt.wall_limit = vm["wall-time"].as<time_limit>();
+    if (vm.count("cpu-time")) opt.use_cpu_limit = true, opt.cpu_limit = vm["cpu-time"].as<time_limit>();
+    if (vm.count("count-instructions")) opt.count_instructions = true;
+    if (vm.count("instruction-limit")) {
+        opt.use_instruction_limit = opt.count_instructions = true;
+        opt.instruction_limit = vm["instruction-limit"].as<time_limit>();
+    }
+    if (vm.count("memory-limit")) {
+        opt.memory_limit = vm["memory-limit"].as<size_t>();
+        if (opt.memory_limit != (opt.memory_limit * 1024) / 1024)
+            opt.memory_limit = -1;
+        else
+            opt.memory_limit *= 1024;
+    }
+    if (vm.count("file-limit")) opt.file_limit = vm["file-limit"].as<size_t>();
+    if (vm.count("nproc")) opt.nproc = vm["nproc"].as<size_t>();
+    if (vm.count("no-core-dumps")) opt.no_core_dumps = true;
+    if (vm.count("ptrace")) opt.use_ptrace = true;
+    if (vm.count("seccomp")) opt.use_seccomp = true, opt.use_ptrace = false;
+    if (vm.count("cpuset")) opt.cpuset = vm["cpuset"].as<string>();
+    if (vm.count("reuse-cgroup")) opt.reuse_cgroup = true;
+    if (vm.count("standard-input-file")) opt.stdin_filename = vm["standard-input-file"].as<string>();
+    if (vm.count("standard-output-file")) opt.stdout_filename = vm["standard-output-file"].as<string>();
+    if (vm.count("standard-error-file")) opt.stderr_filename = vm["standard-error-file"].as<string>();
+    if (vm.count("stream-size")) opt.stream_size = vm["stream-size"].as<size_t>();
+    if (vm.count("compare-output")) opt.compare_filename = vm["compare-output"].as<string>();
+    if (vm.count("capture-output")) opt.capture_output = true;
+    if (vm.count("timeline")) opt.timeline_filename = vm["timeline"].as<string>();
+    if (vm.count("timeline-interval")) {
+        double interval = vm["timeline-interval"].as<double>();
+        // 间隔太小时采样本身会明显占用评测核心之外的 CPU
+        if (!(interval >= 1 && interval <= 60000)) {
+            err << "timeline interval must be between 1 and 60000 milliseconds" << endl;
+            return 1;
+        }
+        opt.timeline_interval = (unsigned)(interval * 1000);
+    }
+    if (vm.count("environment")) opt.preserve_sys_env = true;
+    if (vm.count("out-meta")) opt.metafile_path = vm["out-meta"].as<string>();
+    if (vm.count("meta-format")) {
+        string format = vm["meta-format"].as<string>();
+        if (format == "text")
+            opt.metafile_format = meta_format::TEXT;
+        else if (format == "json")
+            opt.metafile_format = meta_format::JSON;
+        else if (format == "binary")
+            opt.metafile_format = meta_format::BINARY;
+        else {
+            err << "unrecognized meta format " << format << endl;
+            return 1;
+        }
+    }
+    if (!opt.mounts.empty()) {
+        // 沙箱需要在受控程序的 PID 命名空间中挂载 /proc，ptrace 模式没有分离命名空间
+        if (opt.use_ptrace) {
+            err << "sandbox mounts cannot be used with --ptrace" << endl;
+            return 1;
+        }
+        bool overlay_root = any_of(opt.mounts.begin(), opt.mounts.end(), [](const mount_spec& spec) { return spec.target == "/"; });
+        if (overlay_root == !opt.chroot_dir.empty()) {
+            err << "sandbox requires exactly one of --root and --overlay for /" << endl;
+            return 1;
+        }
+    }
+    opt.command = vm["cmd"].as<vector<string>>();
+
+    return -1;
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include "perf.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <glog/logging.h>
+#include <linux/perf_event.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <system_error>
+
+using namespace std;
+
+instruction_counter::~instruction_counter() {
+    for (int fd : {sync_fd[0], sync_fd[1], counter_fd, timer_fd})
+        if (fd >= 0) close(fd);
+}
+
+void instruction_counter::prepare() {
+    if (pipe2(sync_fd, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "creating instruction counter pipe");
+}
+
+void instruction_counter::wait_attached() {
+    close(sync_fd[1]);
+    sync_fd[1] = -1;
+
+    // watchdog 关闭写端后 read 返回 0
+    char c;
+    while (::read(sync_fd[0], &c, 1) < 0 && errno == EINTR)
+        ;
+    close(sync_fd[0]);
+    sync_fd[0] = -1;
+}
+
+// 检查总指令数的间隔，每秒执行数十亿条指令，间隔 10ms 时超出限制的部分在千万条左右
+static const long CHECK_INTERVAL_NSEC = 10000000L;
+
+bool instruction_counter::attach(pid_t pid, uint64_t limit) {
+    this->limit = limit;
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;  // 统计受控程序创建的子进程和线程，它们退出时计数累加到这里
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    if (limit > 0) {
+        // 计数达到 sample_period 时溢出，通过 O_ASYNC 把 F_SETSIG 设置的信号发送给 F_SETOWN 指定的进程
+        attr.sample_period = limit;
+        attr.wakeup_events = 1;
+    }
+
+    counter_fd = syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (counter_fd < 0) {
+        LOG(WARNING) << "unable to open instruction counter: " << strerror(errno);
+    } else if (limit > 0 &&
+               (fcntl(counter_fd, F_SETOWN, pid) != 0 ||
+                fcntl(counter_fd, F_SETSIG, SIGKILL) != 0 ||
+                fcntl(counter_fd, F_SETFL, O_ASYNC) != 0)) {
+        LOG(WARNING) << "unable to enforce instruction limit: " << strerror(errno);
+    }
+
+    close(sync_fd[0]);
+    close(sync_fd[1]);
+    sync_fd[0] = sync_fd[1] = -1;
+    return counter_fd >= 0;
+}
+
+int instruction_counter::watch() {
+    if (counter_fd < 0 || limit == 0) return -1;
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) throw system_error(errno, system_category(), "creating instruction limit timerfd");
+    struct itimerspec spec = {};
+    spec.it_interval.tv_nsec = spec.it_value.tv_nsec = CHECK_INTERVAL_NSEC;
+    if (timerfd_settime(timer_fd, 0, &spec, nullptr) != 0)
+        throw system_error(errno, system_category(), "setting instruction limit timerfd");
+    return timer_fd;
+}
+
+bool instruction_counter::limit_exceeded() {
+    uint64_t expirations;
+    if (::read(timer_fd, &expirations, sizeof(expirations)) < 0) return false;
+    // 继承的计数器读到的是受控程序和所有子进程（包括还在运行的）的指令数之和
+    return (uint64_t)read() >= limit;
+}
+
+int64_t instruction_counter::read() {
+    if (counter_fd < 0) return -1;
+    uint64_t count;
+    if (::read(counter_fd, &count, sizeof(count)) != sizeof(count))
+        throw system_error(errno, system_category(), "reading instruction counter");
+    return count;
+}
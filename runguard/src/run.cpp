@@ -7,7 +7,6 @@
 #include <sys/ptrace.h>
 #include <sys/resource.h>
 #include <sys/time.h>
-#include <sys/times.h>
 #include <sys/types.h>
 #include <sys/user.h>
 #include <sys/wait.h>
@@ -16,13 +15,21 @@
 #include <boost/assign.hpp>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <system_error>
-#include "cgroup.hpp"
+#include "compare.hpp"
 #include "limits.hpp"
+#include "perf.hpp"
+#include "run_result.hpp"
 #include "runguard_options.hpp"
+#include "sandbox.hpp"
+#include "seccomp.hpp"
+#include "smt.hpp"
 #include "syscall_table.hpp"
 #include "system.hpp"
+#include "timeline.hpp"
 #include "utils.hpp"
+#include "watchdog.hpp"
 
 using namespace std;
 
@@ -34,20 +41,42 @@ const int TIMELIMIT_ALL = 3;
 int walllimit = 0, cpulimit = 0;
 
 ofstream metafile;
+static run_result result;      // 写入 meta 文件的运行结果
+static int result_fd = -1;     // 运行结束时额外将结果写入的文件描述符，参见 set_result_fd
+static pid_t runguard_pid = -1;  // 执行 runit 的进程，用于区分 fork 出的受控程序
+static meta_format metafile_format = meta_format::TEXT;
 int child_pid = -1;
-int efd = -1;
+static bool oom_event = false;  // watchdog 收到了 OOM 事件
+static bool terminated_by_signal = false;  // runguard 收到 SIGTERM 后结束了受控程序
 static volatile sig_atomic_t received_SIGCHLD = 0;
 static volatile sig_atomic_t received_signal = -1;
+unique_ptr<output_monitor> monitor;  // 开启流式比较或者捕获输出时读取受控程序的标准输出
+unique_ptr<instruction_counter> counter;  // 统计或限制指令数时受控程序的指令计数器
+unique_ptr<sibling_monitor> siblings;  // 设置了 --cpuset 时统计超线程兄弟核心的繁忙程度
 
 template <typename... Args>
 void error(int err, Args&&... args) {
     throw system_error(err, system_category(), fmt::format(args...));
 }
 
-template <typename T>
-void append_meta(const char* key, T message) {
-    if (!metafile) return;
-    metafile << key << ": " << message << endl;
+void set_result_fd(int fd) {
+    result_fd = fd;
+}
+
+/**
+ * @brief 写出 meta 文件，并将运行结果交给 runguard_run 或 supervisor 的调用方
+ * 受控程序在 exec 之前出错时也会调用，此时 result 中只有 internal-error，
+ * 由 runguard 进程稍后写出完整的结果
+ */
+static void publish_result(int exitcode) {
+    if (metafile) write_meta(metafile, result, metafile_format);
+    if (result_fd >= 0 && getpid() == runguard_pid) {
+        try {
+            send_result(result_fd, exitcode, result);
+        } catch (exception& e) {
+            LOG(ERROR) << e.what();
+        }
+    }
 }
 
 void runguard_terminate_handler() {
@@ -68,10 +97,12 @@ void runguard_terminate_handler() {
     } catch (const exception& e) {
         cerr << e.what() << endl;
 
-        append_meta("internal-error", e.what());
+        result.internal_error = e.what();
     } catch (...) {
         cerr << "Unknown exception occurred" << endl;
+        result.internal_error = "unknown exception";
     }
+    publish_result(EXIT_FAILURE);
 
     /* Make sure that all children are killed before terminating */
     if (child_pid > 0) {
@@ -95,8 +126,8 @@ void runguard_terminate_handler() {
 }
 
 void summarize_cgroup(const runguard_options& opt, int exitcode,
-                      struct timeval starttime, struct timeval endtime,
-                      struct tms startticks, struct tms endticks,
+                      struct timespec starttime, struct timespec endtime,
+                      const struct rusage& ru,
                       bool restricted_function) {
     static const char output_timelimit_str[4][16] = {
         "",
@@ -105,46 +136,16 @@ void summarize_cgroup(const runguard_options& opt, int exitcode,
         "hard-timelimit"};
     double cpudiff;
 
-    cgroup_guard guard(opt.cgroupname);
-    guard.get_cgroup();  // prepare for get_controller
-
-    {
-        cgroup_ctrl ctrl = guard.get_controller("memory");
-        int64_t max_usage = ctrl.get_value_int64("memory.memsw.max_usage_in_bytes");
-
-        LOG(INFO) << "total memory used: " << max_usage / 1024 << "kB";
-        append_meta("memory-bytes", to_string(max_usage));
-    }
-    {
-        cgroup_ctrl ctrl = guard.get_controller("cpuacct");
-        int64_t cpu_time = ctrl.get_value_int64("cpuacct.usage");  // in ns
-        cpudiff = (double)cpu_time / 1e9;
-    }
-
-    bool is_oom = false;
-    {
-        ifstream fin("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.oom_control");
-        while (fin.good()) {
-            string token;
-            fin >> token;
-            if (token == "oom_kill")
-                fin >> is_oom;
-        }
-    }
-
-    // 另一种实现读取是否发生 OOM 的方法：
-    // uint64_t u;
-    // assert(is_oom == (read(efd, &u, sizeof(uint64_t)) == sizeof(uint64_t)));
+    cgroup_usage usage = cgroup_read_usage(opt);
 
-    if (is_oom)
-        append_meta("memory-result", "oom");
-    else
-        append_meta("memory-result", "");
+    LOG(INFO) << "total memory used: " << usage.memory_bytes / 1024 << "kB";
+    result.memory_bytes = usage.memory_bytes;
+    cpudiff = (double)usage.cpu_time_ns / 1e9;
 
-    if (restricted_function)
-        append_meta("restricted-function", "yes");
-    else
-        append_meta("restricted-function", "");
+    result.oom = usage.oom || oom_event;
+    result.restricted_function = restricted_function;
+    result.peak_pids = usage.peak_pids;
+    if (siblings) result.sibling_busy = siblings->finish();
 
     // 杀死 cgroup 内所有的进程，以确保父进程结束后不会有
     // so our timing is correct: no child processes can survive longer than
@@ -153,24 +154,50 @@ void summarize_cgroup(const runguard_options& opt, int exitcode,
     cgroup_kill(opt);
     cgroup_delete(opt);
 
-    unsigned long tps = sysconf(_SC_CLK_TCK);
-    append_meta("exitcode", exitcode);
-
-    if (received_signal != -1) {
-        append_meta("signal", received_signal);
-    }
+    result.exitcode = exitcode;
+    result.signal = received_signal;
 
+    // wait4 返回的 rusage 精确到微秒，times 返回的时钟滴答只能精确到 10ms
     double walldiff = (endtime.tv_sec - starttime.tv_sec) +
-                      (endtime.tv_usec - starttime.tv_usec) * 1E-6;
-    double userdiff = (double)(endticks.tms_cutime - startticks.tms_cutime) / tps;
-    double sysdiff = (double)(endticks.tms_cstime - startticks.tms_cstime) / tps;
-
-    append_meta("wall-time", fmt::format("{:.3f}", walldiff));
-    append_meta("user-time", fmt::format("{:.3f}", userdiff));
-    append_meta("sys-time", fmt::format("{:.3f}", sysdiff));
-    append_meta("cpu-time", fmt::format("{:.3f}", cpudiff));
-
-    LOG(INFO) << fmt::format("run time: real {:.3f}, user {:.3f}, sys {:.3f}", walldiff, userdiff, sysdiff);
+                      (endtime.tv_nsec - starttime.tv_nsec) * 1E-9;
+    double userdiff = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1E-6;
+    double sysdiff = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1E-6;
+
+    result.wall_time = walldiff;
+    result.user_time = userdiff;
+    result.sys_time = sysdiff;
+    result.cpu_time = cpudiff;
+
+    result.voluntary_context_switches = ru.ru_nvcsw;
+    result.involuntary_context_switches = ru.ru_nivcsw;
+    result.major_faults = ru.ru_majflt;
+    result.minor_faults = ru.ru_minflt;
+    // ru_inblock 和 ru_oublock 以 512 字节为单位
+    result.read_bytes = (int64_t)ru.ru_inblock * 512;
+    result.write_bytes = (int64_t)ru.ru_oublock * 512;
+
+    LOG(INFO) << fmt::format("run time: real {:.6f}, user {:.6f}, sys {:.6f}", walldiff, userdiff, sysdiff);
+
+    bool instruction_killed = false;
+    if (counter) {
+        // 受控程序的进程都已经退出，子进程的指令数已经累加到计数器中
+        int64_t instructions = counter->read();
+        if (instructions >= 0) {
+            result.instructions = instructions;
+            LOG(INFO) << "instructions retired: " << instructions;
+
+            if (opt.use_instruction_limit && instructions >= opt.instruction_limit.hard) {
+                cpulimit |= TIMELIMIT_HARD;
+                instruction_killed = true;
+                LOG(WARNING) << "Time Limit Exceeded (hard instruction limit)";
+            } else if (opt.use_instruction_limit && instructions > opt.instruction_limit.soft) {
+                cpulimit |= TIMELIMIT_SOFT;
+                LOG(WARNING) << "Time Limit Exceeded (soft instruction limit)";
+            }
+        } else if (opt.use_instruction_limit) {
+            LOG(WARNING) << "instruction counter unavailable, instruction limit is not enforced";
+        }
+    }
 
     if (opt.use_wall_limit && walldiff > opt.wall_limit.soft) {
         walllimit |= TIMELIMIT_SOFT;
@@ -182,7 +209,41 @@ void summarize_cgroup(const runguard_options& opt, int exitcode,
         LOG(WARNING) << "Time Limit Exceeded (soft cpu time)";
     }
 
-    append_meta("time-result", output_timelimit_str[walllimit | cpulimit]);
+    result.time_result = output_timelimit_str[walllimit | cpulimit];
+
+    if (monitor) {
+        static const char compare_result_str[3][24] = {
+            "accepted",
+            "presentation-error",
+            "wrong-answer"};
+        result.stdout_bytes = monitor->bytes();
+        result.output_truncated = monitor->truncated();
+        // 捕获的输出一直保存到受控程序结束，峰值加上捕获的字节数是受控程序占用内存的上界
+        result.memory_bytes += monitor->captured_bytes();
+        if (monitor->memory_exceeded()) result.oom = true;
+        if (monitor->comparing()) {
+            result.compare_result = compare_result_str[(int)monitor->result()];
+            result.compare_killed = monitor->killed_on_mismatch();
+        }
+    }
+
+    // 多个原因同时成立时（比如被 OOM killer 杀死的同时超时），优先报告更早、更确定发生的原因
+    if (result.compare_killed)
+        result.kill_reason = "wrong-answer";
+    else if (result.output_truncated)
+        result.kill_reason = "output-limit";
+    else if (restricted_function)
+        result.kill_reason = "restricted-function";
+    else if (result.oom)
+        result.kill_reason = "memory";
+    else if (instruction_killed)
+        result.kill_reason = "instructions";
+    else if (cpulimit & TIMELIMIT_HARD)
+        result.kill_reason = "cpu-time";
+    else if (walllimit & TIMELIMIT_HARD)
+        result.kill_reason = "wall-time";
+    else if (terminated_by_signal)
+        result.kill_reason = "terminated";
 }
 
 void terminate(int sig) {
@@ -202,6 +263,7 @@ void terminate(int sig) {
         walllimit |= TIMELIMIT_HARD;
         LOG(WARNING) << "timelimit exceeded (hard wall time): aborting command";
     } else {
+        terminated_by_signal = true;
         LOG(WARNING) << "received signal " << sig << ": aborting command";
     }
 
@@ -236,7 +298,9 @@ int run_unshare(runguard_options opt);
 
 int runit(struct runguard_options opt) {
     set_terminate(runguard_terminate_handler);
-    metafile.open(opt.metafile_path.c_str(), ofstream::out);
+    runguard_pid = getpid();
+    metafile.open(opt.metafile_path.c_str(), ofstream::out | ofstream::binary);
+    metafile_format = opt.metafile_format;
 
     {
         struct sigaction sigact;
@@ -260,11 +324,15 @@ int runit(struct runguard_options opt) {
         }
     }
 
-    cgroup_guard::init();
+    cgroup_backend_init();
 
-    opt.cgroupname = fmt::format("/judger/cgroup_{}_{}", getpid(), (int)time(NULL));
+    // 评测核心同时只运行一个程序，优先复用该核心预先创建的 cgroup，
+    // 租用失败（如多个静态检查进程共用一组核心）时再创建临时的 cgroup
+    if (!opt.reuse_cgroup || opt.cpuset.empty() || !cgroup_lease(opt)) {
+        opt.cgroupname = fmt::format("/judger/cgroup_{}_{}", getpid(), (int)time(NULL));
 
-    cgroup_create(opt);
+        cgroup_create(opt);
+    }
 
     {
         /* Check if any Linux Out-Of-Memory killer adjustments have to
@@ -294,23 +362,23 @@ int runit(struct runguard_options opt) {
         }
     }
 
-    // 另一种实现读取是否发生 OOM 的方法：
-    // if ((efd = eventfd(0, EFD_NONBLOCK)) < 0) error(errno, "requesting event fd");
-    // int cfd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/cgroup.event_control").c_str(), O_WRONLY);
-    // if (cfd < 0) error(errno, "opening cgroup.event_control");
-    // int ofd = open(("/sys/fs/cgroup/memory" + opt.cgroupname + "/memory.oom_control").c_str(), O_RDONLY);
-    // if (ofd < 0) error(errno, "opening memory.oom_control");
-    // string oom = fmt::format("{} {}", efd, ofd);
-    // if (write(cfd, oom.data(), oom.size()) < 0) error(errno, "writing cgroup.event_control");
-    // if (close(cfd) < 0) error(errno, "closing cgroup.event_control");
-
-    if (opt.use_ptrace)
-        return run_ptrace(opt);
-    else
-        return run_unshare(opt);
+    if (!opt.compare_filename.empty() || opt.capture_output)
+        monitor = make_unique<output_monitor>(opt);
+
+    if (opt.count_instructions) {
+        counter = make_unique<instruction_counter>();
+        counter->prepare();
+    }
+
+    if (!opt.cpuset.empty())
+        siblings = make_unique<sibling_monitor>(opt.cpuset);
+
+    int exitcode = opt.use_ptrace ? run_ptrace(opt) : run_unshare(opt);
+    publish_result(exitcode);
+    return exitcode;
 }
 
-void set_restrictions_parent(const runguard_options& opt) {
+static void drop_watchdog_privileges(const runguard_options& opt) {
     if (opt.user_id < 0) {
         /*
         * Shed privileges, only if not using a separate child uid,
@@ -320,6 +388,10 @@ void set_restrictions_parent(const runguard_options& opt) {
         */
         if (setuid(getuid()) != 0) error(errno, "setting watchdog uid");
     }
+}
+
+void set_restrictions_parent(const runguard_options& opt) {
+    drop_watchdog_privileges(opt);
 
     sigset_t emptymask;
     if (sigemptyset(&emptymask) != 0) error(errno, "creating empty signal mask");
@@ -365,6 +437,25 @@ void set_restrictions_parent(const runguard_options& opt) {
     }
 }
 
+/**
+ * @brief 和 execvp 一样在 PATH 中查找命令，返回第一个可执行的文件路径
+ */
+static string search_path(const string& name) {
+    if (name.find('/') != string::npos) return name;
+
+    const char* env = getenv("PATH");
+    string path = env ? env : "/bin:/usr/bin";
+    for (size_t begin = 0; begin <= path.size();) {
+        size_t end = path.find(':', begin);
+        if (end == string::npos) end = path.size();
+        string dir = end > begin ? path.substr(begin, end - begin) : ".";
+        string file = dir + "/" + name;
+        if (access(file.c_str(), X_OK) == 0) return file;
+        begin = end + 1;
+    }
+    return name;
+}
+
 int run_unshare(runguard_options opt) {
     /*
      * unshare 函数可以用来进行进程隔离。通常情况下，POSIX 系统的 fork 或 clone 函数
@@ -383,48 +474,167 @@ int run_unshare(runguard_options opt) {
      *              这样 runguard 及受控程序无法获得主机程序的进程列表
      * CLONE_NEWUTS: 隔离主机和受控程序的 hostname 和 NIS，避免利用 NIS 来进行通信
      * CLONE_SYSVSEM：
+     * CLONE_NEWPID：使用沙箱时隔离进程号，fork 出的子进程成为新 PID 命名空间的 1 号进程，
+     *              它退出时内核杀死命名空间内的所有进程，沙箱的挂载随之释放
      */
-    unshare(CLONE_FILES | CLONE_FS | CLONE_NEWIPC | CLONE_NEWNET | CLONE_NEWNS | CLONE_NEWUTS | CLONE_SYSVSEM);
+    bool sandbox = !opt.mounts.empty();
+    unshare(CLONE_FILES | CLONE_FS | CLONE_NEWIPC | CLONE_NEWNET | CLONE_NEWNS | CLONE_NEWUTS | CLONE_SYSVSEM |
+            (sandbox ? CLONE_NEWPID : 0));
+
+    // 沙箱的 init 进程通过这个管道将受控程序的 wait 状态交给 watchdog
+    int status_pipe[2] = {-1, -1};
+    if (sandbox && pipe2(status_pipe, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "creating status pipe");
+    // init 搭建好沙箱后关闭写端，watchdog 读到 EOF 后才开始计时
+    int ready_pipe[2] = {-1, -1};
+    if (sandbox && pipe2(ready_pipe, O_CLOEXEC) != 0)
+        throw system_error(errno, system_category(), "creating ready pipe");
 
     switch (child_pid = fork()) {
         case -1:
             throw system_error(errno, system_category(), "unable to fork");
         case 0: {  // child process, run the command
-            if (opt.stdout_filename.size())
+            if (monitor)
+                monitor->redirect_child();
+            else if (opt.stdout_filename.size())
                 freopen(opt.stdout_filename.c_str(), "w", stdout);
             if (opt.stderr_filename.size())
                 freopen(opt.stderr_filename.c_str(), "w", stderr);
             if (opt.stdin_filename.size())
                 freopen(opt.stdin_filename.c_str(), "r", stdin);
 
-            set_restrictions(opt);
+            vector<int> cgroup_procs;
+            if (sandbox) {
+                // 1 号进程会忽略没有注册处理函数的信号（包括 RLIMIT_CPU 发出的 SIGXCPU），
+                // 因此当前进程只作为 init 回收进程，再 fork 出一个进程运行受控程序。
+                // init 以 root 身份在 cgroup 外搭建沙箱，不计入进程数限制，搭建沙箱的时间也不计入受控程序
+                close(status_pipe[0]);
+                close(ready_pipe[0]);
+                // watchdog 通过 kill(-child_pid) 结束受控程序，受控程序和 init 在同一个进程组中
+                if (setsid() == -1) error(errno, "unable to setsid");
+                cgroup_procs = cgroup_open_procs(opt);
+                enter_sandbox(opt);
+                // 受控程序从 init 继承指令计数器，必须在 fork 之前等待 watchdog 打开计数器
+                if (counter) counter->wait_attached();
+                close(ready_pipe[1]);
+
+                pid_t command = fork();
+                if (command < 0) error(errno, "unable to fork command");
+                if (command > 0) {
+                    for (int fd : cgroup_procs) close(fd);
+                    int status = reap_as_init(command);
+                    if (write(status_pipe[1], &status, sizeof(status)) != sizeof(status))
+                        error(errno, "writing command status");
+                    _exit(EXIT_SUCCESS);
+                }
+            }
+
+            set_restrictions(opt, cgroup_procs);
 
             auto& cmd = opt.command;
             char** args = new char*[cmd.size() + 1];
             for (size_t i = 0; i < cmd.size(); ++i) args[i] = cmd[i].data();
             args[cmd.size()] = 0;
 
-            execvp(args[0], args);
+            if (counter && !sandbox) counter->wait_attached();
+
+            if (opt.use_seccomp) {
+                // execvp 会用不同的路径多次尝试 execve，而过滤器只允许一个确定的路径
+                string path = search_path(cmd[0]);
+                install_seccomp_filter(path);
+                execv(path.c_str(), args);
+            } else {
+                execvp(args[0], args);
+            }
             error(errno, "unable to start command {}", cmd[0]);
         } break;
         default: {  // watchdog
-            set_restrictions_parent(opt);
+            // 打开其他用户进程的计数器需要 root 权限，必须在 set_restrictions_parent 放弃权限之前
+            if (counter) counter->attach(child_pid, opt.use_instruction_limit ? (uint64_t)opt.instruction_limit.hard : 0);
+            if (sandbox) {
+                // watchdog 的墙上时间限制从构造时开始计时，等待 init 搭建好沙箱，
+                // 搭建失败时 init 直接退出，同样读到 EOF
+                close(ready_pipe[1]);
+                char c;
+                while (read(ready_pipe[0], &c, 1) < 0 && errno == EINTR)
+                    ;
+                close(ready_pipe[0]);
+            }
+            watchdog wd(opt, child_pid);
+            if (sandbox) close(status_pipe[1]);
+
+            // 发生 OOM 时立即结束受控程序，避免内存不足、反复回收内存的程序一直运行到超时
+            int oom_fd = -1;
+            try {
+                oom_fd = cgroup_watch_oom(opt);
+                wd.add(oom_fd, [&]() {
+                    if (!cgroup_oom_triggered(opt, oom_fd)) return false;
+                    oom_event = true;
+                    LOG(WARNING) << "Memory Limit Exceeded (OOM killer triggered)";
+                    return true;
+                });
+            } catch (exception& e) {
+                LOG(WARNING) << "unable to watch OOM events: " << e.what();
+            }
+
+            // 溢出信号只能杀死受控程序本身，fork 出的多个进程合计超出指令数限制时由 watchdog 结束
+            if (counter) {
+                try {
+                    if (int fd = counter->watch(); fd >= 0) {
+                        wd.add(fd, [&]() {
+                            if (!counter->limit_exceeded()) return false;
+                            LOG(WARNING) << "Time Limit Exceeded (hard instruction limit)";
+                            return true;
+                        });
+                    }
+                } catch (exception& e) {
+                    LOG(WARNING) << "unable to watch instruction limit: " << e.what();
+                }
+            }
+
+            // 采样和 OOM 事件一样由 watchdog 的事件循环驱动，不需要额外的线程。
+            // 沙箱中 child_pid 是 init 进程，内存和 CPU 时间仍来自 cgroup，但上下文切换和读写字节数只是 init 自己的
+            unique_ptr<timeline_recorder> timeline;
+            if (!opt.timeline_filename.empty()) {
+                timeline = make_unique<timeline_recorder>(opt);
+                timeline->start(child_pid);
+                wd.add(timeline->fd(), [&]() {
+                    timeline->sample();
+                    return false;
+                });
+            }
+            drop_watchdog_privileges(opt);
 
             int status, exitcode;
+            bool rf = false;
             struct rusage ru;
-            struct tms startticks, endticks;
-            struct timeval starttime, endtime;
-            if (times(&startticks) == (clock_t)-1)
-                error(errno, "getting start clock ticks");
-            if (gettimeofday(&starttime, NULL))
+            struct timespec starttime, endtime;
+            if (clock_gettime(CLOCK_MONOTONIC, &starttime))
                 error(errno, "getting time");
-            if (wait4(child_pid, &status, 0, &ru) == -1)
-                error(errno, "wait4");
+            if (monitor) monitor->start(child_pid);
+            if (siblings) siblings->start();
+            status = wd.wait(ru);
+            if (sandbox) {
+                // init 被杀死（如超时后 watchdog 杀死整个 cgroup）时没有写入状态，沿用 init 的状态
+                int command_status;
+                if (read(status_pipe[0], &command_status, sizeof(command_status)) == sizeof(command_status))
+                    status = command_status;
+                close(status_pipe[0]);
+            }
+            if (wd.wall_limit_exceeded()) walllimit |= TIMELIMIT_HARD;
+            if (wd.terminated()) terminated_by_signal = true;
+            if (oom_fd >= 0) close(oom_fd);
+            if (timeline) {
+                try {
+                    timeline->finish();
+                } catch (exception& e) {
+                    LOG(ERROR) << "unable to record timeline: " << e.what();
+                }
+            }
 
-            if (times(&endticks) == (clock_t)-1)
-                error(errno, "getting end clock ticks");
-            if (gettimeofday(&endtime, NULL))
+            if (clock_gettime(CLOCK_MONOTONIC, &endtime))
                 error(errno, "getting time");
+            if (monitor) monitor->stop();
 
             if (WIFEXITED(status)) {
                 exitcode = WEXITSTATUS(status);
@@ -437,6 +647,11 @@ int run_unshare(runguard_options opt) {
                         cpulimit |= TIMELIMIT_HARD;
                         LOG(WARNING) << "Time Limit Exceeded (hard limit)";
                         break;
+                    case SIGSYS:
+                        // seccomp 过滤器杀死进程时使用的信号
+                        rf = opt.use_seccomp;
+                        LOG(WARNING) << "Command called restricted system call";
+                        break;
                     default:
                         LOG(WARNING) << "Command terminated with signal (" << received_signal << ", " << strsignal(received_signal) << ")";
                         break;
@@ -452,7 +667,7 @@ int run_unshare(runguard_options opt) {
             if (setuid(getuid()) != 0)
                 error(errno, "dropping root privileges");
 
-            summarize_cgroup(opt, exitcode, starttime, endtime, startticks, endticks, false);
+            summarize_cgroup(opt, exitcode, starttime, endtime, ru, rf);
 
             return exitcode;
         } break;
@@ -474,11 +689,15 @@ bool check_access(int pid, struct user_regs_struct regs) {
 }
 
 int run_ptrace(runguard_options opt) {
+    init_syscall_table();
+
     switch (child_pid = fork()) {
         case -1:
             throw system_error(errno, system_category(), "unable to fork");
         case 0: {  // child process, run the command
-            if (opt.stdout_filename.size())
+            if (monitor)
+                monitor->redirect_child();
+            else if (opt.stdout_filename.size())
                 freopen(opt.stdout_filename.c_str(), "w", stdout);
             if (opt.stderr_filename.size())
                 freopen(opt.stderr_filename.c_str(), "w", stderr);
@@ -492,24 +711,27 @@ int run_ptrace(runguard_options opt) {
             for (size_t i = 0; i < cmd.size(); ++i) args[i] = cmd[i].data();
             args[cmd.size()] = 0;
 
+            if (counter) counter->wait_attached();
+
             ptrace(PTRACE_TRACEME, 0, 0, 0);
 
             execvp(args[0], args);
             error(errno, "unable to start command {}", cmd[0]);
         } break;
         default: {  // watchdog
+            // 打开其他用户进程的计数器需要 root 权限，必须在 set_restrictions_parent 放弃权限之前
+            if (counter) counter->attach(child_pid, opt.use_instruction_limit ? (uint64_t)opt.instruction_limit.hard : 0);
             set_restrictions_parent(opt);
 
             int status, exitcode;
             bool incall = false, ptrace_kill = false, rf = false;
             struct user_regs_struct regs;
             struct rusage ru;
-            struct tms startticks, endticks;
-            struct timeval starttime, endtime;
-            if (times(&startticks) == (clock_t)-1)
-                error(errno, "getting start clock ticks");
-            if (gettimeofday(&starttime, NULL))
+            struct timespec starttime, endtime;
+            if (clock_gettime(CLOCK_MONOTONIC, &starttime))
                 error(errno, "getting time");
+            if (monitor) monitor->start(child_pid);
+            if (siblings) siblings->start();
 
             while (1) {
                 if (wait4(child_pid, &status, 0, &ru) == -1)
@@ -521,7 +743,7 @@ int run_ptrace(runguard_options opt) {
                     if (received_signal != SIGTRAP) {
                         ptrace(PTRACE_KILL, child_pid, 0, 0);
                         ptrace_kill = true;
-                        waitpid(child_pid, NULL, 0);
+                        wait4(child_pid, NULL, 0, &ru);
                         break;
                     }
 
@@ -531,7 +753,7 @@ int run_ptrace(runguard_options opt) {
                     if (incall) {
                         if (!check_access(child_pid, regs)) {
                             ptrace(PTRACE_KILL, child_pid, NULL, NULL);
-                            waitpid(child_pid, NULL, 0);
+                            wait4(child_pid, NULL, 0, &ru);
 
                             rf = true;
                             break;
@@ -542,10 +764,9 @@ int run_ptrace(runguard_options opt) {
                 }
             }
 
-            if (times(&endticks) == (clock_t)-1)
-                error(errno, "getting end clock ticks");
-            if (gettimeofday(&endtime, NULL))
+            if (clock_gettime(CLOCK_MONOTONIC, &endtime))
                 error(errno, "getting time");
+            if (monitor) monitor->stop();
 
             if (WIFEXITED(status)) {
                 exitcode = WEXITSTATUS(status);
@@ -573,7 +794,7 @@ int run_ptrace(runguard_options opt) {
             if (setuid(getuid()) != 0)
                 error(errno, "dropping root privileges");
 
-            summarize_cgroup(opt, exitcode, starttime, endtime, startticks, endticks, rf);
+            summarize_cgroup(opt, exitcode, starttime, endtime, ru, rf);
 
             return exitcode;
         } break;
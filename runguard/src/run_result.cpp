@@ -0,0 +1,290 @@
+#include "run_result.hpp"
+#include <errno.h>
+#include <fmt/core.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstddef>
+#include <sstream>
+#include <system_error>
+
+using namespace std;
+
+const char *const KILL_REASONS[] = {
+    "",
+    "wall-time",            // 超过墙上时间硬限制
+    "cpu-time",             // 超过 CPU 时间硬限制（SIGXCPU）
+    "instructions",         // 超过指令数硬限制
+    "memory",               // OOM killer 结束了进程
+    "output-limit",         // 输出超过 --stream-size
+    "wrong-answer",         // 流式比较确定了 Wrong Answer
+    "restricted-function",  // 调用了禁止的系统调用
+    "terminated"            // runguard 收到了 SIGTERM
+};
+
+static const char *const TIME_RESULTS[] = {"", "soft-timelimit", "hard-timelimit"};
+static const char *const COMPARE_RESULTS[] = {"", "accepted", "presentation-error", "wrong-answer"};
+
+template <size_t N>
+static uint8_t index_of(const char *const (&table)[N], const string &value) {
+    for (size_t i = 0; i < N; ++i)
+        if (value == table[i]) return i;
+    return 0;
+}
+
+template <size_t N>
+static const char *name_of(const char *const (&table)[N], uint8_t index) {
+    return index < N ? table[index] : "";
+}
+
+/**
+ * @brief 按 meta 文件的顺序列出所有需要写出的字段，文本和 JSON 格式共用
+ */
+template <typename Emit>
+static void visit_fields(const run_result &result, Emit &&emit) {
+    if (result.exitcode >= 0) {
+        emit("memory-bytes", result.memory_bytes);
+        emit("memory-result", string(result.oom ? "oom" : ""));
+        emit("restricted-function", string(result.restricted_function ? "yes" : ""));
+        emit("exitcode", (int64_t)result.exitcode);
+        if (result.signal != -1)
+            emit("signal", (int64_t)result.signal);
+        emit("wall-time", result.wall_time);
+        emit("user-time", result.user_time);
+        emit("sys-time", result.sys_time);
+        emit("cpu-time", result.cpu_time);
+        if (result.instructions >= 0)
+            emit("instructions", result.instructions);
+        emit("time-result", result.time_result);
+        if (result.stdout_bytes >= 0) {
+            emit("stdout-bytes", result.stdout_bytes);
+            if (result.output_truncated)
+                emit("output-truncated", string("stdout"));
+            emit("compare-result", result.compare_result);
+            emit("compare-killed", string(result.compare_killed ? "yes" : ""));
+        }
+        emit("voluntary-context-switches", result.voluntary_context_switches);
+        emit("involuntary-context-switches", result.involuntary_context_switches);
+        emit("major-faults", result.major_faults);
+        emit("minor-faults", result.minor_faults);
+        emit("read-bytes", result.read_bytes);
+        emit("write-bytes", result.write_bytes);
+        if (result.peak_pids >= 0)
+            emit("peak-pids", result.peak_pids);
+        if (result.sibling_busy >= 0)
+            emit("sibling-busy", result.sibling_busy);
+        emit("kill-reason", result.kill_reason);
+    }
+    if (!result.internal_error.empty())
+        emit("internal-error", result.internal_error);
+}
+
+namespace {
+struct text_writer {
+    ostream &out;
+
+    void operator()(const char *key, int64_t value) { out << key << ": " << value << "\n"; }
+    void operator()(const char *key, double value) { out << key << ": " << fmt::format("{:.6f}", value) << "\n"; }
+    void operator()(const char *key, const string &value) { out << key << ": " << value << "\n"; }
+};
+
+struct json_writer {
+    ostream &out;
+
+    void key(const char *key) { out << ",\"" << key << "\":"; }
+    void operator()(const char *name, int64_t value) { key(name), out << value; }
+    void operator()(const char *name, double value) { key(name), out << fmt::format("{:.6f}", value); }
+    void operator()(const char *name, const string &value) {
+        key(name);
+        out << '"';
+        for (unsigned char c : value) {
+            if (c == '"' || c == '\\')
+                out << '\\' << c;
+            else if (c < 0x20)
+                out << fmt::format("\\u{:04x}", c);
+            else
+                out << c;
+        }
+        out << '"';
+    }
+};
+}  // namespace
+
+static void write_binary(ostream &out, const run_result &result) {
+    binary_meta meta;
+    if (result.oom) meta.flags |= binary_meta::FLAG_OOM;
+    if (result.restricted_function) meta.flags |= binary_meta::FLAG_RESTRICTED_FUNCTION;
+    if (result.output_truncated) meta.flags |= binary_meta::FLAG_OUTPUT_TRUNCATED;
+    if (result.compare_killed) meta.flags |= binary_meta::FLAG_COMPARE_KILLED;
+    meta.exitcode = result.exitcode;
+    meta.signal = result.signal;
+    meta.wall_time = result.wall_time;
+    meta.user_time = result.user_time;
+    meta.sys_time = result.sys_time;
+    meta.cpu_time = result.cpu_time;
+    meta.memory_bytes = result.memory_bytes;
+    meta.instructions = result.instructions;
+    meta.stdout_bytes = result.stdout_bytes;
+    meta.voluntary_context_switches = result.voluntary_context_switches;
+    meta.involuntary_context_switches = result.involuntary_context_switches;
+    meta.major_faults = result.major_faults;
+    meta.minor_faults = result.minor_faults;
+    meta.read_bytes = result.read_bytes;
+    meta.write_bytes = result.write_bytes;
+    meta.peak_pids = result.peak_pids;
+    meta.sibling_busy = result.sibling_busy;
+    meta.time_result = index_of(TIME_RESULTS, result.time_result);
+    meta.compare_result = index_of(COMPARE_RESULTS, result.compare_result);
+    meta.kill_reason = index_of(KILL_REASONS, result.kill_reason);
+    meta.internal_error_length = result.internal_error.size();
+    out.write((const char *)&meta, sizeof(meta));
+    out.write(result.internal_error.data(), result.internal_error.size());
+}
+
+void write_meta(ostream &out, const run_result &result, meta_format format) {
+    switch (format) {
+        case meta_format::TEXT:
+            visit_fields(result, text_writer{out});
+            break;
+        case meta_format::JSON:
+            out << "{\"version\":" << META_VERSION;
+            visit_fields(result, json_writer{out});
+            out << "}\n";
+            break;
+        case meta_format::BINARY:
+            write_binary(out, result);
+            break;
+    }
+    out.flush();
+}
+
+static run_result parse_binary(const string &data) {
+    run_result result;
+    binary_meta meta;
+    uint32_t size;
+    if (data.size() < offsetof(binary_meta, flags)) return result;
+    memcpy(&size, data.data() + offsetof(binary_meta, size), sizeof(size));
+    // 旧版本的定长部分更短，缺少的字段保持默认值
+    memcpy(&meta, data.data(), min<size_t>({size, sizeof(meta), data.size()}));
+
+    result.oom = meta.flags & binary_meta::FLAG_OOM;
+    result.restricted_function = meta.flags & binary_meta::FLAG_RESTRICTED_FUNCTION;
+    result.output_truncated = meta.flags & binary_meta::FLAG_OUTPUT_TRUNCATED;
+    result.compare_killed = meta.flags & binary_meta::FLAG_COMPARE_KILLED;
+    result.exitcode = meta.exitcode;
+    result.signal = meta.signal;
+    result.wall_time = meta.wall_time;
+    result.user_time = meta.user_time;
+    result.sys_time = meta.sys_time;
+    result.cpu_time = meta.cpu_time;
+    result.memory_bytes = meta.memory_bytes;
+    result.instructions = meta.instructions;
+    result.stdout_bytes = meta.stdout_bytes;
+    result.voluntary_context_switches = meta.voluntary_context_switches;
+    result.involuntary_context_switches = meta.involuntary_context_switches;
+    result.major_faults = meta.major_faults;
+    result.minor_faults = meta.minor_faults;
+    result.read_bytes = meta.read_bytes;
+    result.write_bytes = meta.write_bytes;
+    result.peak_pids = meta.peak_pids;
+    result.sibling_busy = meta.sibling_busy;
+    result.time_result = name_of(TIME_RESULTS, meta.time_result);
+    result.compare_result = name_of(COMPARE_RESULTS, meta.compare_result);
+    result.kill_reason = name_of(KILL_REASONS, meta.kill_reason);
+    if (size <= data.size() && meta.internal_error_length <= data.size() - size)
+        result.internal_error = data.substr(size, meta.internal_error_length);
+    return result;
+}
+
+static run_result parse_text(const string &text) {
+    run_result result;
+    istringstream in(text);
+    string line;
+    while (getline(in, line)) {
+        size_t colon = line.find(": ");
+        string key = line.substr(0, colon);
+        string value = colon == string::npos ? "" : line.substr(colon + 2);
+        try {
+            if (key == "memory-bytes") result.memory_bytes = stoll(value);
+            else if (key == "memory-result") result.oom = value == "oom";
+            else if (key == "restricted-function") result.restricted_function = value == "yes";
+            else if (key == "exitcode") result.exitcode = stoi(value);
+            else if (key == "signal") result.signal = stoi(value);
+            else if (key == "wall-time") result.wall_time = stod(value);
+            else if (key == "user-time") result.user_time = stod(value);
+            else if (key == "sys-time") result.sys_time = stod(value);
+            else if (key == "cpu-time") result.cpu_time = stod(value);
+            else if (key == "instructions") result.instructions = stoll(value);
+            else if (key == "time-result") result.time_result = value;
+            else if (key == "stdout-bytes") result.stdout_bytes = stoll(value);
+            else if (key == "output-truncated") result.output_truncated = true;
+            else if (key == "compare-result") result.compare_result = value;
+            else if (key == "compare-killed") result.compare_killed = value == "yes";
+            else if (key == "voluntary-context-switches") result.voluntary_context_switches = stoll(value);
+            else if (key == "involuntary-context-switches") result.involuntary_context_switches = stoll(value);
+            else if (key == "major-faults") result.major_faults = stoll(value);
+            else if (key == "minor-faults") result.minor_faults = stoll(value);
+            else if (key == "read-bytes") result.read_bytes = stoll(value);
+            else if (key == "write-bytes") result.write_bytes = stoll(value);
+            else if (key == "peak-pids") result.peak_pids = stoll(value);
+            else if (key == "sibling-busy") result.sibling_busy = stod(value);
+            else if (key == "kill-reason") result.kill_reason = value;
+            else if (key == "internal-error") result.internal_error = value;
+        } catch (logic_error &) {
+            // 格式不正确的数值保持默认值
+        }
+    }
+    return result;
+}
+
+run_result parse_meta(const string &data) {
+    if (data.compare(0, 4, "RGMT") == 0)
+        return parse_binary(data);
+    return parse_text(data);
+}
+
+static void write_all(int fd, const void *data, size_t size) {
+    const char *p = (const char *)data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw system_error(errno, system_category(), "sending run result");
+        }
+        p += n, size -= n;
+    }
+}
+
+static bool read_all(int fd, void *data, size_t size) {
+    char *p = (char *)data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n, size -= n;
+    }
+    return true;
+}
+
+void send_result(int fd, int exitcode, const run_result &result) {
+    ostringstream meta;
+    write_meta(meta, result, meta_format::BINARY);
+    string data = meta.str();
+    int32_t code = exitcode;
+    uint32_t length = data.size();
+    write_all(fd, &code, sizeof(code));
+    write_all(fd, &length, sizeof(length));
+    write_all(fd, data.data(), data.size());
+}
+
+bool receive_result(int fd, int &exitcode, run_result &result) {
+    int32_t code;
+    uint32_t length;
+    if (!read_all(fd, &code, sizeof(code)) || !read_all(fd, &length, sizeof(length)))
+        return false;
+    string data(length, '\0');
+    if (!read_all(fd, data.data(), length)) return false;
+    exitcode = code;
+    result = parse_meta(data);
+    return true;
+}
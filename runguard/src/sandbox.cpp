@@ -0,0 +1,273 @@
+#include "sandbox.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include "runguard_options.hpp"
+
+using namespace std;
+
+// 搭建沙箱时在 STAGING 上挂载 tmpfs 并 pivot_root 进去，此后宿主机的根目录位于 OLD_ROOT，
+// 沙箱的根目录挂载在 NEW_ROOT。pivot_root 之后 tmpfs 不再覆盖宿主机的 /tmp
+static const char *STAGING = "/tmp";
+static const string NEW_ROOT = "/newroot";
+static const string OLD_ROOT = "/oldroot";
+
+// 受控程序能访问的设备，均从宿主机的 /dev 绑定挂载
+static const char *DEVICES[] = {"null", "zero", "full", "random", "urandom"};
+
+static string normalize_target(const string &target) {
+    if (target.empty() || target[0] != '/')
+        throw invalid_argument(fmt::format("mount target {} is not an absolute path", target));
+    string result = target;
+    while (result.size() > 1 && result.back() == '/') result.pop_back();
+    return result;
+}
+
+static vector<string> split(const string &value, char delim) {
+    vector<string> parts;
+    size_t begin = 0;
+    while (true) {
+        size_t end = value.find(delim, begin);
+        parts.push_back(value.substr(begin, end - begin));
+        if (end == string::npos) break;
+        begin = end + 1;
+    }
+    return parts;
+}
+
+mount_spec parse_overlay(const string &value) {
+    mount_spec spec;
+    spec.type = mount_spec::mount_type::OVERLAY;
+
+    size_t colon = value.find(':');
+    if (colon == string::npos)
+        throw invalid_argument(fmt::format("overlay {} has no mount options", value));
+    spec.target = normalize_target(value.substr(0, colon));
+
+    for (const string &option : split(value.substr(colon + 1), ',')) {
+        size_t equal = option.find('=');
+        string key = option.substr(0, equal);
+        string dir = equal == string::npos ? "" : option.substr(equal + 1);
+        if (dir.empty())
+            throw invalid_argument(fmt::format("overlay option {} has no value", option));
+
+        if (key == "lowerdir")
+            spec.lowerdirs = split(dir, ':');
+        else if (key == "upperdir")
+            spec.upperdir = dir;
+        else if (key == "workdir")
+            spec.workdir = dir;
+        else
+            throw invalid_argument(fmt::format("unrecognized overlay option {}", key));
+    }
+
+    if (spec.lowerdirs.empty())
+        throw invalid_argument(fmt::format("overlay {} requires lowerdir", spec.target));
+    if (spec.upperdir.empty() != spec.workdir.empty())
+        throw invalid_argument(fmt::format("overlay {} requires both upperdir and workdir", spec.target));
+    spec.read_only = spec.upperdir.empty();
+    return spec;
+}
+
+mount_spec parse_bind(const string &value, bool read_only) {
+    mount_spec spec;
+    spec.type = mount_spec::mount_type::BIND;
+
+    size_t colon = value.rfind(':');
+    if (colon == string::npos || colon == 0)
+        throw invalid_argument(fmt::format("bind mount {} should be <source>:<target>", value));
+    spec.source = value.substr(0, colon);
+    spec.target = normalize_target(value.substr(colon + 1));
+    if (spec.target == "/")
+        throw invalid_argument("use --root to bind the root directory");
+    spec.read_only = read_only;
+    return spec;
+}
+
+/**
+ * @brief 将宿主机上的路径转换为绝对路径，pivot_root 之后的相对路径没有意义
+ */
+static string absolute_path(const string &path) {
+    char resolved[PATH_MAX];
+    if (!realpath(path.c_str(), resolved))
+        throw system_error(errno, system_category(), fmt::format("unable to resolve {}", path));
+    return resolved;
+}
+
+static void make_dirs(const string &path) {
+    for (size_t pos = 1; pos <= path.size(); ++pos) {
+        if (pos != path.size() && path[pos] != '/') continue;
+        string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            throw system_error(errno, system_category(), fmt::format("unable to create directory {}", dir));
+    }
+}
+
+/**
+ * @brief 绑定挂载文件时挂载点也必须是文件
+ */
+static void make_mount_point(const string &source, const string &target) {
+    struct stat st;
+    if (stat(source.c_str(), &st) != 0)
+        throw system_error(errno, system_category(), fmt::format("unable to stat {}", source));
+    if (S_ISDIR(st.st_mode)) {
+        make_dirs(target);
+        return;
+    }
+
+    make_dirs(target.substr(0, target.rfind('/')));
+    int fd = open(target.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 && errno != EEXIST && errno != EISDIR)
+        throw system_error(errno, system_category(), fmt::format("unable to create mount point {}", target));
+    if (fd >= 0) close(fd);
+}
+
+static void do_mount(const char *source, const string &target, const char *fstype, unsigned long flags, const string &data = "") {
+    if (mount(source, target.c_str(), fstype, flags, data.empty() ? nullptr : data.c_str()) != 0)
+        throw system_error(errno, system_category(), fmt::format("unable to mount {} on {}", source ? source : fstype, target));
+}
+
+static void bind_mount(const string &source, const string &target, bool read_only) {
+    make_mount_point(source, target);
+    do_mount(source.c_str(), target, nullptr, MS_BIND | MS_REC);
+    // MS_RDONLY 只能在绑定之后通过 remount 设置
+    if (read_only)
+        do_mount(nullptr, target, nullptr, MS_BIND | MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NODEV);
+}
+
+static void mount_spec_at(const mount_spec &spec, const string &target) {
+    if (spec.type == mount_spec::mount_type::BIND) {
+        bind_mount(OLD_ROOT + spec.source, target, spec.read_only);
+        return;
+    }
+
+    // 没有可写层时 overlayfs 至少需要两个只读层，只有一个只读层时等价于只读的绑定挂载
+    if (spec.upperdir.empty() && spec.lowerdirs.size() == 1) {
+        bind_mount(OLD_ROOT + spec.lowerdirs[0], target, true);
+        return;
+    }
+
+    string data = "lowerdir=";
+    for (size_t i = 0; i < spec.lowerdirs.size(); ++i) {
+        if (i > 0) data += ':';
+        data += OLD_ROOT + spec.lowerdirs[i];
+    }
+    if (!spec.upperdir.empty())
+        data += fmt::format(",upperdir={}{},workdir={}{}", OLD_ROOT, spec.upperdir, OLD_ROOT, spec.workdir);
+    make_dirs(target);
+    do_mount("overlay", target, "overlay", 0, data);
+}
+
+/**
+ * @brief 在沙箱中创建只包含少数设备的 /dev，设备节点从宿主机绑定挂载，不需要 mknod
+ */
+static void mount_dev(const string &root) {
+    string dev = root + "/dev";
+    make_dirs(dev);
+    do_mount("tmpfs", dev, "tmpfs", MS_NOSUID | MS_NOEXEC, "mode=0755,size=64k");
+
+    for (const char *device : DEVICES)
+        bind_mount(OLD_ROOT + "/dev/" + device, dev + "/" + device, false);
+
+    const pair<const char *, const char *> links[] = {
+        {"/proc/self/fd", "fd"},
+        {"/proc/self/fd/0", "stdin"},
+        {"/proc/self/fd/1", "stdout"},
+        {"/proc/self/fd/2", "stderr"}};
+    for (auto &[from, name] : links)
+        if (symlink(from, (dev + "/" + name).c_str()) != 0)
+            throw system_error(errno, system_category(), fmt::format("unable to create /dev/{}", name));
+
+    // 设备节点是独立的绑定挂载，只读的 tmpfs 只禁止受控程序在 /dev 下创建文件
+    do_mount(nullptr, dev, nullptr, MS_REMOUNT | MS_RDONLY | MS_NOSUID | MS_NOEXEC);
+}
+
+void enter_sandbox(const runguard_options &opt) {
+    // 挂载点按深度排序，保证父目录先于子目录挂载；同一目标的后一个挂载覆盖前一个
+    vector<mount_spec> mounts = opt.mounts;
+    stable_sort(mounts.begin(), mounts.end(), [](const mount_spec &a, const mount_spec &b) {
+        return count(a.target.begin(), a.target.end(), '/') - (a.target == "/") <
+               count(b.target.begin(), b.target.end(), '/') - (b.target == "/");
+    });
+
+    // 评测脚本传入的路径是相对于当前工作路径的，必须在 pivot_root 之前解析
+    string root_dir = opt.chroot_dir.empty() ? "" : absolute_path(opt.chroot_dir);
+    for (auto &spec : mounts) {
+        if (!spec.source.empty()) spec.source = absolute_path(spec.source);
+        for (auto &dir : spec.lowerdirs) dir = absolute_path(dir);
+        if (!spec.upperdir.empty()) spec.upperdir = absolute_path(spec.upperdir);
+        if (!spec.workdir.empty()) spec.workdir = absolute_path(spec.workdir);
+    }
+
+    // watchdog 和受控程序共用 run_unshare 创建的挂载命名空间，pivot_root 会同时修改
+    // 命名空间内其他进程的根目录，因此沙箱需要再分离出一个只属于受控程序的挂载命名空间
+    if (unshare(CLONE_NEWNS) != 0)
+        throw system_error(errno, system_category(), "unable to unshare mount namespace");
+    do_mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE);
+
+    do_mount("tmpfs", STAGING, "tmpfs", MS_NOSUID | MS_NODEV, "mode=0755");
+    make_dirs(STAGING + NEW_ROOT);
+    make_dirs(STAGING + OLD_ROOT);
+    if (syscall(SYS_pivot_root, STAGING, (STAGING + OLD_ROOT).c_str()) != 0)
+        throw system_error(errno, system_category(), "unable to pivot_root to staging directory");
+    if (chdir("/") != 0)
+        throw system_error(errno, system_category(), "unable to chdir to staging directory");
+
+    bool has_root = false;
+    for (auto &spec : mounts) {
+        if (spec.target == "/") {
+            mount_spec_at(spec, NEW_ROOT);
+            has_root = true;
+        } else {
+            if (!has_root) {
+                if (root_dir.empty())
+                    throw invalid_argument("sandbox requires --root or --overlay for /");
+                bind_mount(OLD_ROOT + root_dir, NEW_ROOT, false);
+                has_root = true;
+            }
+            mount_spec_at(spec, NEW_ROOT + spec.target);
+        }
+    }
+
+    // 在新的 PID 命名空间中挂载的 /proc 只能看到受控程序自己的进程
+    make_dirs(NEW_ROOT + "/proc");
+    do_mount("proc", NEW_ROOT + "/proc", "proc", MS_NOSUID | MS_NODEV | MS_NOEXEC);
+    mount_dev(NEW_ROOT);
+
+    // pivot_root(".", ".") 将宿主机的根目录叠在新的根目录之上，随后立即卸载
+    if (chdir(NEW_ROOT.c_str()) != 0)
+        throw system_error(errno, system_category(), "unable to chdir to sandbox root");
+    if (syscall(SYS_pivot_root, ".", ".") != 0)
+        throw system_error(errno, system_category(), "unable to pivot_root to sandbox root");
+    if (umount2(".", MNT_DETACH) != 0)
+        throw system_error(errno, system_category(), "unable to detach host root directory");
+
+    string work_dir = opt.work_dir.empty() ? "/" : opt.work_dir;
+    if (chdir(work_dir.c_str()) != 0)
+        throw system_error(errno, system_category(), fmt::format("unable to chdir to {} in sandbox", work_dir));
+
+    LOG(INFO) << "entered sandbox with " << mounts.size() << " mounts";
+}
+
+int reap_as_init(pid_t command) {
+    // 受控程序 fork 出的进程成为孤儿后由 1 号进程收养，必须一并回收，否则会一直是僵尸进程
+    while (true) {
+        int status;
+        pid_t pid = wait(&status);
+        if (pid == command) return status;
+        if (pid < 0 && errno != EINTR)
+            throw system_error(errno, system_category(), "waiting for command");
+    }
+}
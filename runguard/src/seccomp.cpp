@@ -0,0 +1,97 @@
+#include "seccomp.hpp"
+#include <errno.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <vector>
+#include "syscall_table.hpp"
+
+using namespace std;
+
+#ifndef SECCOMP_RET_KILL_PROCESS
+// Linux 4.14 之前只能杀死发起系统调用的线程
+#define SECCOMP_RET_KILL_PROCESS SECCOMP_RET_KILL
+#endif
+
+#ifndef __X32_SYSCALL_BIT
+#define __X32_SYSCALL_BIT 0x40000000
+#endif
+
+static sock_filter stmt(uint16_t code, uint32_t k) {
+    return BPF_STMT(code, k);
+}
+
+static sock_filter jump(uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) {
+    return BPF_JUMP(code, k, jt, jf);
+}
+
+static const uint32_t syscall_nr = offsetof(struct seccomp_data, nr);
+static const uint32_t syscall_arch = offsetof(struct seccomp_data, arch);
+
+/**
+ * @brief 生成一种架构的过滤规则，以 return 结束
+ * 对表中的每个系统调用生成 "相等则允许" 的两条指令，不需要计算远距离的跳转
+ */
+static vector<sock_filter> compile_table(int table, int execve_nr, uint64_t exec_path) {
+    vector<sock_filter> prog;
+    prog.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, syscall_nr));
+
+    if (table == SYSCALL_TABLE_64) {
+        // x32 ABI 的系统调用号带有 __X32_SYSCALL_BIT，同样属于 AUDIT_ARCH_X86_64，必须单独拒绝
+        prog.push_back(jump(BPF_JMP | BPF_JGE | BPF_K, __X32_SYSCALL_BIT, 0, 1));
+        prog.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+    }
+
+    if (execve_nr >= 0) {
+        // 只允许 execve 受控程序：比较文件名指针的低 32 位和高 32 位
+        const uint32_t arg0 = offsetof(struct seccomp_data, args[0]);
+        prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, execve_nr, 0, 6));
+        prog.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, arg0));
+        prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)exec_path, 0, 3));
+        prog.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, arg0 + 4));
+        prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)(exec_path >> 32), 0, 1));
+        prog.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+        prog.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+        // 过滤 execve 之前累加器中是 arg0 的高 32 位，后面的比较需要重新读取系统调用号
+        prog.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, syscall_nr));
+    }
+
+    for (int nr = 0; nr < 512; ++nr) {
+        if (!syscall_used[table][nr]) continue;
+        prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, nr, 0, 1));
+        prog.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    }
+    prog.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+    return prog;
+}
+
+void install_seccomp_filter(const string &exec_path) {
+    init_syscall_table();
+
+    vector<sock_filter> table64 = compile_table(SYSCALL_TABLE_64, __NR_execve, (uint64_t)exec_path.c_str());
+    vector<sock_filter> table32 = compile_table(SYSCALL_TABLE_32, -1, 0);
+    if (table64.size() > 255 || table32.size() > 255)
+        throw runtime_error("syscall table too large for seccomp filter");
+
+    vector<sock_filter> prog;
+    prog.push_back(stmt(BPF_LD | BPF_W | BPF_ABS, syscall_arch));
+    prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 0, table64.size()));
+    prog.insert(prog.end(), table64.begin(), table64.end());
+    prog.push_back(jump(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_I386, 0, table32.size()));
+    prog.insert(prog.end(), table32.begin(), table32.end());
+    prog.push_back(stmt(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+
+    struct sock_fprog fprog;
+    fprog.len = prog.size();
+    fprog.filter = prog.data();
+
+    // 非 root 用户安装过滤器需要 no_new_privs，同时也防止受控程序通过 setuid 程序提权
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+        throw system_error(errno, system_category(), "unable to set no_new_privs");
+    if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &fprog) != 0)
+        throw system_error(errno, system_category(), "unable to install seccomp filter");
+}
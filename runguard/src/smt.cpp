@@ -0,0 +1,61 @@
+#include "smt.hpp"
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "numa.hpp"
+
+using namespace std;
+
+set<unsigned> smt_siblings_of_cpu(unsigned cpu) {
+    ifstream fin(fmt::format("/sys/devices/system/cpu/cpu{}/topology/thread_siblings_list", cpu));
+    string list;
+    if (!getline(fin, list)) return {};
+    set<unsigned> siblings;
+    try {
+        siblings = parse_cpu_list(list);
+    } catch (invalid_argument &e) {
+        LOG(WARNING) << e.what();
+    }
+    siblings.erase(cpu);
+    return siblings;
+}
+
+sibling_monitor::sibling_monitor(const string &cpuset) {
+    set<unsigned> cpus = parse_cpu_list(cpuset);
+    for (unsigned cpu : cpus)
+        for (unsigned sibling : smt_siblings_of_cpu(cpu))
+            if (!cpus.count(sibling)) siblings.insert(sibling);
+}
+
+bool sibling_monitor::read_times(uint64_t &busy, uint64_t &total) const {
+    // cpu<N> user nice system idle iowait irq softirq steal guest guest_nice，
+    // guest 已经计入 user，只累加前 8 项，idle 和 iowait 视为空闲
+    ifstream fin("/proc/stat");
+    string line;
+    size_t found = 0;
+    busy = total = 0;
+    while (getline(fin, line)) {
+        unsigned cpu;
+        if (sscanf(line.c_str(), "cpu%u ", &cpu) != 1 || !siblings.count(cpu)) continue;
+        istringstream in(line.substr(line.find(' ')));
+        uint64_t times[8] = {}, sum = 0;
+        for (auto &time : times) in >> time, sum += time;
+        total += sum;
+        busy += sum - times[3] - times[4];
+        ++found;
+    }
+    return found == siblings.size();
+}
+
+void sibling_monitor::start() {
+    started = !siblings.empty() && read_times(start_busy, start_total);
+}
+
+double sibling_monitor::finish() {
+    uint64_t busy, total;
+    if (!started || !read_times(busy, total)) return -1;
+    if (total <= start_total) return 0;  // 运行时间不到一个时钟滴答
+    return (double)(busy - start_busy) / (total - start_total);
+}
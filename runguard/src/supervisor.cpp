@@ -0,0 +1,379 @@
+#include "supervisor.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <grp.h>
+#include <limits.h>
+#include <pwd.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <map>
+#include <sstream>
+#include <system_error>
+#include "limits.hpp"
+#include "options.hpp"
+#include "run.hpp"
+#include "system.hpp"
+
+using namespace std;
+
+extern char **environ;
+
+// 运行请求的最大长度，防止异常的请求占用过多内存
+static const uint32_t MAX_REQUEST_SIZE = 1 << 20;
+
+namespace {
+/**
+ * @brief 一次运行请求
+ * 格式为 uint32 长度，然后是 uint32 参数个数、uint32 环境变量个数，以及参数、环境变量、工作目录共计若干个以 \0 结尾的字符串。
+ * 长度和请求方的标准输入、输出、错误的文件描述符通过同一次 sendmsg 发送
+ */
+struct run_request_message {
+    vector<string> args, env;
+    string cwd;
+    int fds[3] = {-1, -1, -1};
+    struct ucred peer;
+
+    ~run_request_message() {
+        for (int fd : fds)
+            if (fd >= 0) close(fd);
+    }
+};
+}  // namespace
+
+static void append_string(string &buffer, const string &str) {
+    buffer.append(str.c_str(), str.size() + 1);
+}
+
+static void append_uint32(string &buffer, uint32_t value) {
+    buffer.append((const char *)&value, sizeof(value));
+}
+
+static bool send_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n, size -= n;
+    }
+    return true;
+}
+
+static void write_all(int fd, const string &text) {
+    for (size_t pos = 0; pos < text.size();) {
+        ssize_t n = write(fd, text.data() + pos, text.size() - pos);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        pos += n;
+    }
+}
+
+static bool recv_all(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n, size -= n;
+    }
+    return true;
+}
+
+static bool receive_request(int conn, run_request_message &req) {
+    socklen_t len = sizeof(req.peer);
+    if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &req.peer, &len) != 0) return false;
+
+    uint32_t size;
+    struct iovec iov = {&size, sizeof(size)};
+    union {
+        char buf[CMSG_SPACE(sizeof(req.fds))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    if (recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL) != sizeof(size)) return false;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(req.fds)))
+        return false;
+    memcpy(req.fds, CMSG_DATA(cmsg), sizeof(req.fds));
+
+    if (size < 2 * sizeof(uint32_t) || size > MAX_REQUEST_SIZE) return false;
+    string payload(size, '\0');
+    if (!recv_all(conn, payload.data(), size)) return false;
+
+    uint32_t argc, envc;
+    memcpy(&argc, payload.data(), sizeof(argc));
+    memcpy(&envc, payload.data() + sizeof(argc), sizeof(envc));
+    vector<string> strings;
+    for (size_t pos = 2 * sizeof(uint32_t); pos < payload.size();) {
+        size_t end = payload.find('\0', pos);
+        if (end == string::npos) return false;
+        strings.push_back(payload.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    if (argc == 0 || strings.size() != (size_t)argc + envc + 1) return false;
+    req.args.assign(strings.begin(), strings.begin() + argc);
+    req.env.assign(strings.begin() + argc, strings.begin() + argc + envc);
+    req.cwd = strings.back();
+    return true;
+}
+
+bool supervisor_request(const string &socket_path, const vector<string> &args, int &exitcode, run_result &result) {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    int conn = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (conn < 0) return false;
+    if (connect(conn, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(conn);
+        return false;
+    }
+
+    string payload;
+    size_t envc = 0;
+    while (environ[envc]) ++envc;
+    append_uint32(payload, args.size());
+    append_uint32(payload, envc);
+    for (auto &arg : args) append_string(payload, arg);
+    for (size_t i = 0; i < envc; ++i) append_string(payload, environ[i]);
+    char cwd[PATH_MAX];
+    append_string(payload, getcwd(cwd, sizeof(cwd)) ? cwd : "/");
+
+    uint32_t size = payload.size();
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    struct iovec iov = {&size, sizeof(size)};
+    union {
+        char buf[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    bool sent = sendmsg(conn, &msg, MSG_NOSIGNAL) == sizeof(size) && send_all(conn, payload.data(), payload.size());
+    if (!sent || !receive_result(conn, exitcode, result)) {
+        // 已经连接上 supervisor，说明运行可能已经开始，不能再由调用方重新运行
+        exitcode = EXIT_FAILURE;
+        result = run_result();
+        result.internal_error = "connection to runguard supervisor lost";
+    }
+    close(conn);
+    return true;
+}
+
+/**
+ * @brief 在 worker 中读取请求，切换到请求方的运行环境并执行 runit，不会返回
+ * 请求在 worker 中读取，异常的请求方只会阻塞自己的 worker，不会阻塞 supervisor 接受其他请求
+ */
+[[noreturn]] static void run_worker(int conn) {
+    // 请求方连接后立即发送请求，超时未发送完整的请求则放弃
+    struct timeval timeout = {1, 0};
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    run_request_message req;
+    if (!receive_request(conn, req)) {
+        LOG(WARNING) << "dropping malformed runguard request";
+        _exit(EXIT_FAILURE);
+    }
+
+    runguard_options opt;
+    ostringstream out, err;
+    vector<const char *> argv;
+    for (auto &arg : req.args) argv.push_back(arg.c_str());
+    int ret = parse_options(argv.size(), argv.data(), opt, out, err);
+    if (ret >= 0) {  // --help 或者参数错误，不需要运行
+        write_all(req.fds[1], out.str());
+        write_all(req.fds[2], err.str());
+        try {
+            send_result(conn, ret, run_result());
+        } catch (exception &) {
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    try {
+        for (int i = 0; i < 3; ++i) {
+            if (dup2(req.fds[i], i) < 0)
+                throw system_error(errno, system_category(), "redirecting standard streams of request");
+        }
+
+        // 请求方不是 root 时，和直接执行 runguard 命令一样以请求方的身份运行
+        if (req.peer.uid != 0) {
+            struct passwd *pw = getpwuid(req.peer.uid);
+            if (pw ? initgroups(pw->pw_name, req.peer.gid) != 0 : setgroups(0, nullptr) != 0)
+                throw system_error(errno, system_category(), "setting supplementary groups of request");
+            if (setgid(req.peer.gid) != 0 || setuid(req.peer.uid) != 0)
+                throw system_error(errno, system_category(), "switching to user of request");
+        }
+
+        if (chdir(req.cwd.c_str()) != 0)
+            throw system_error(errno, system_category(), fmt::format("changing to working directory {}", req.cwd));
+
+        clearenv();
+        for (auto &var : req.env) putenv(var.data());
+
+        sigset_t emptymask;
+        sigemptyset(&emptymask);
+        sigprocmask(SIG_SETMASK, &emptymask, nullptr);
+        signal(SIGPIPE, SIG_DFL);
+    } catch (exception &e) {
+        run_result result;
+        result.internal_error = e.what();
+        try {
+            send_result(conn, EXIT_FAILURE, result);
+        } catch (exception &) {
+        }
+        _exit(EXIT_FAILURE);
+    }
+
+    set_result_fd(conn);
+    exit(runit(opt));
+}
+
+int run_supervisor(const string &socket_path, const string &socket_group) {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw runtime_error(fmt::format("socket path {} is too long", socket_path));
+    strcpy(addr.sun_path, socket_path.c_str());
+
+    // 进程启动时的初始化只做一次，worker 通过 fork 继承
+    cgroup_backend_init();
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) throw system_error(errno, system_category(), "creating supervisor socket");
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        throw system_error(errno, system_category(), fmt::format("binding supervisor socket {}", socket_path));
+    if (socket_group.empty()) {
+        chmod(socket_path.c_str(), 0600);
+    } else {
+        if (chown(socket_path.c_str(), 0, get_groupid(socket_group.c_str())) != 0 || chmod(socket_path.c_str(), 0660) != 0)
+            throw system_error(errno, system_category(), fmt::format("setting owner of supervisor socket {}", socket_path));
+    }
+    if (listen(listen_fd, SOMAXCONN) != 0)
+        throw system_error(errno, system_category(), "listening on supervisor socket");
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    if (sigprocmask(SIG_BLOCK, &mask, nullptr) != 0)
+        throw system_error(errno, system_category(), "blocking signals of supervisor");
+    int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) throw system_error(errno, system_category(), "creating signalfd of supervisor");
+    // 请求方断开连接时写回运行结果不能杀死 supervisor
+    signal(SIGPIPE, SIG_IGN);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) throw system_error(errno, system_category(), "creating epoll of supervisor");
+    for (int fd : {listen_fd, signal_fd}) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+            throw system_error(errno, system_category(), "registering supervisor events");
+    }
+
+    LOG(INFO) << "runguard supervisor listening on " << socket_path;
+
+    map<int, pid_t> workers;  // 连接 -> 正在处理该连接的 worker
+    bool stopping = false;
+    while (!stopping) {
+        struct epoll_event events[16];
+        int n = epoll_wait(epoll_fd, events, 16, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw system_error(errno, system_category(), "waiting for supervisor events");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                int conn = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (conn < 0) {
+                    if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED)
+                        LOG(ERROR) << "accepting runguard request: " << strerror(errno);
+                    continue;
+                }
+
+                // 读取请求也交给 worker，supervisor 只负责接受连接和回收 worker
+                pid_t pid = fork();
+                if (pid < 0) {
+                    LOG(ERROR) << "unable to fork runguard worker: " << strerror(errno);
+                    close(conn);
+                    continue;
+                }
+                if (pid == 0) {
+                    close(listen_fd);
+                    close(signal_fd);
+                    close(epoll_fd);
+                    for (auto &worker : workers) close(worker.first);
+                    run_worker(conn);
+                }
+
+                workers[conn] = pid;
+                struct epoll_event ev = {};
+                ev.events = EPOLLRDHUP;
+                ev.data.fd = conn;
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn, &ev) != 0)
+                    LOG(ERROR) << "watching runguard request: " << strerror(errno);
+            } else if (fd == signal_fd) {
+                struct signalfd_siginfo info;
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo == SIGTERM || info.ssi_signo == SIGINT) stopping = true;
+                }
+
+                pid_t pid;
+                while ((pid = waitpid(-1, nullptr, WNOHANG)) > 0) {
+                    for (auto it = workers.begin(); it != workers.end(); ++it) {
+                        if (it->second == pid) {
+                            close(it->first);  // 关闭文件描述符时自动从 epoll 中移除
+                            workers.erase(it);
+                            break;
+                        }
+                    }
+                }
+            } else {
+                // 请求方在 worker 结束之前断开了连接，由 watchdog 结束受控程序
+                auto it = workers.find(fd);
+                if (it == workers.end()) continue;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                LOG(WARNING) << "runguard request closed, terminating worker " << it->second;
+                kill(it->second, SIGTERM);
+            }
+        }
+    }
+
+    LOG(INFO) << "runguard supervisor stopping";
+    for (auto &worker : workers) kill(worker.second, SIGTERM);
+    for (auto &worker : workers) {
+        waitpid(worker.second, nullptr, 0);
+        close(worker.first);
+    }
+    close(epoll_fd);
+    close(signal_fd);
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    return 0;
+}
@@ -0,0 +1,151 @@
+#include "timeline.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <system_error>
+#include "limits.hpp"
+
+using namespace std;
+
+static int64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief 读取 /proc/<pid>/ 下 "key: value" 格式的统计文件中的多项，不存在的项为 0
+ * 文件在受控程序开始运行时打开，每次采样用 pread 从头读取，避免反复打开文件
+ * @return false 若无法读取这个文件，比如受控程序已经被回收
+ */
+static bool read_proc_keyed(int fd, initializer_list<pair<const char *, int64_t *>> keys) {
+    for (auto &key : keys) *key.second = 0;
+
+    if (fd < 0) return false;
+    char buffer[4096];
+    ssize_t len = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (len <= 0) return false;
+    buffer[len] = 0;
+
+    for (auto &key : keys) {
+        size_t key_len = strlen(key.first);
+        for (char *line = buffer; line && *line; line = strchr(line, '\n') ? strchr(line, '\n') + 1 : nullptr) {
+            if (strncmp(line, key.first, key_len) == 0 && line[key_len] == ':') {
+                *key.second = strtoll(line + key_len + 1, nullptr, 10);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+timeline_recorder::timeline_recorder(const runguard_options &opt)
+    : opt(opt) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+        throw system_error(errno, system_category(), "creating timeline timerfd");
+}
+
+timeline_recorder::~timeline_recorder() {
+    for (int fd : {timer_fd, status_fd, io_fd})
+        if (fd >= 0) close(fd);
+}
+
+timeline_recorder::counters timeline_recorder::read_counters() {
+    counters c;
+    c.time_ns = monotonic_ns();
+
+    cgroup_sample cg = cgroup_read_sample(opt);
+    c.memory_bytes = cg.memory_bytes;
+    c.cpu_time_ns = cg.cpu_time_ns;
+    c.page_faults = cg.page_faults;
+    c.major_faults = cg.major_faults;
+
+    int64_t voluntary, nonvoluntary;
+    c.process_alive = read_proc_keyed(status_fd, {{"voluntary_ctxt_switches", &voluntary}, {"nonvoluntary_ctxt_switches", &nonvoluntary}});
+    c.context_switches = voluntary + nonvoluntary;
+    // rchar 和 wchar 包括读写管道和终端，比 read_bytes 和 write_bytes 更接近选手关心的输入输出量
+    c.process_alive &= read_proc_keyed(io_fd, {{"rchar", &c.read_bytes}, {"wchar", &c.write_bytes}});
+    return c;
+}
+
+void timeline_recorder::start(pid_t pid) {
+    status_fd = open(fmt::format("/proc/{}/status", pid).c_str(), O_RDONLY | O_CLOEXEC);
+    io_fd = open(fmt::format("/proc/{}/io", pid).c_str(), O_RDONLY | O_CLOEXEC);
+    base = read_counters();
+    base.memory_bytes = 0;
+    // 受控程序还没有 exec，主进程的统计是 runguard 子进程的，不作为基准
+    base.context_switches = base.read_bytes = base.write_bytes = 0;
+
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = opt.timeline_interval / 1000000;
+    spec.it_interval.tv_nsec = opt.timeline_interval % 1000000 * 1000;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(timer_fd, 0, &spec, nullptr) != 0)
+        throw system_error(errno, system_category(), "setting timeline timerfd");
+}
+
+int timeline_recorder::fd() const {
+    return timer_fd;
+}
+
+static uint32_t clamp32(int64_t value) {
+    return (uint32_t)min<int64_t>(max<int64_t>(value, 0), UINT32_MAX);
+}
+
+void timeline_recorder::sample() {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        throw system_error(errno, system_category(), "reading timeline timerfd");
+
+    counters c;
+    try {
+        c = read_counters();
+    } catch (exception &e) {
+        LOG(WARNING) << "unable to sample resource usage: " << e.what();
+        return;
+    }
+
+    timeline_sample s;
+    s.time_us = clamp32((c.time_ns - base.time_ns) / 1000);
+    s.memory_kb = clamp32(c.memory_bytes / 1024);
+    s.cpu_us = clamp32((c.cpu_time_ns - base.cpu_time_ns) / 1000);
+    s.page_faults = clamp32(c.page_faults - base.page_faults);
+    s.major_faults = clamp32(c.major_faults - base.major_faults);
+    if (c.process_alive || samples.empty()) {
+        s.context_switches = clamp32(c.context_switches);
+        s.read_kb = clamp32(c.read_bytes / 1024);
+        s.write_kb = clamp32(c.write_bytes / 1024);
+    } else {
+        // 受控程序退出后 /proc 中的统计随之消失，沿用上一次采样的累计值
+        s.context_switches = samples.back().context_switches;
+        s.read_kb = samples.back().read_kb;
+        s.write_kb = samples.back().write_kb;
+    }
+    samples.push_back(s);
+}
+
+void timeline_recorder::finish() {
+    struct itimerspec stop = {};
+    timerfd_settime(timer_fd, 0, &stop, nullptr);
+    sample();
+
+    timeline_header header;
+    header.interval_us = opt.timeline_interval;
+    header.sample_size = sizeof(timeline_sample);
+
+    ofstream fout(opt.timeline_filename, ios::binary | ios::trunc);
+    fout.write((const char *)&header, sizeof(header));
+    fout.write((const char *)samples.data(), samples.size() * sizeof(timeline_sample));
+    if (!fout)
+        throw system_error(errno, system_category(), fmt::format("unable to write timeline {}", opt.timeline_filename));
+    LOG(INFO) << "recorded " << samples.size() << " resource usage samples";
+}
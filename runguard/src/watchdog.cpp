@@ -0,0 +1,157 @@
+#include "watchdog.hpp"
+#include <errno.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <math.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <system_error>
+#include "limits.hpp"
+
+using namespace std;
+
+// 5.3 之前的内核头文件没有 pidfd_open 的系统调用号，各架构统一为 434，旧内核上调用返回 ENOSYS
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// epoll_event.data.u32 中的事件编号，通过 add 注册的事件从 EVENT_CUSTOM 开始编号
+enum : uint32_t {
+    EVENT_CHILD,
+    EVENT_TIMER,
+    EVENT_SIGNAL,
+    EVENT_CUSTOM
+};
+
+static void epoll_add(int epoll_fd, int fd, uint32_t id) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = id;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+        throw system_error(errno, system_category(), "adding file descriptor to epoll");
+}
+
+watchdog::watchdog(const runguard_options &opt, pid_t child)
+    : opt(opt), child(child) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) throw system_error(errno, system_category(), "creating epoll");
+
+    child_fd = syscall(SYS_pidfd_open, child, 0);
+    if (child_fd < 0) {
+        if (errno != ENOSYS) throw system_error(errno, system_category(), "pidfd_open");
+        // runit 已经屏蔽了 SIGCHLD，可以直接用 signalfd 接收
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        child_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (child_fd < 0) throw system_error(errno, system_category(), "creating signalfd for SIGCHLD");
+        child_fd_is_signalfd = true;
+    }
+    epoll_add(epoll_fd, child_fd, EVENT_CHILD);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &mask, nullptr) != 0)
+        throw system_error(errno, system_category(), "blocking SIGTERM");
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0) throw system_error(errno, system_category(), "creating signalfd for SIGTERM");
+    epoll_add(epoll_fd, signal_fd, EVENT_SIGNAL);
+
+    if (opt.use_wall_limit) {
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_fd < 0) throw system_error(errno, system_category(), "creating timerfd");
+
+        double seconds;
+        struct itimerspec spec = {};
+        spec.it_value.tv_nsec = (long)(modf(opt.wall_limit.hard, &seconds) * 1E9);
+        spec.it_value.tv_sec = (time_t)seconds;
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;  // 全为 0 表示停止计时器
+        if (timerfd_settime(timer_fd, 0, &spec, nullptr) != 0)
+            throw system_error(errno, system_category(), "setting timerfd");
+        epoll_add(epoll_fd, timer_fd, EVENT_TIMER);
+        LOG(INFO) << fmt::format("setting hard wall-time limit to {:.3f} seconds", opt.wall_limit.hard);
+    }
+}
+
+watchdog::~watchdog() {
+    for (int fd : {epoll_fd, child_fd, timer_fd, signal_fd})
+        if (fd >= 0) close(fd);
+}
+
+void watchdog::add(int fd, function<bool()> handler) {
+    epoll_add(epoll_fd, fd, EVENT_CUSTOM + handlers.size());
+    handlers.push_back(move(handler));
+}
+
+void watchdog::kill_command(const char *reason) {
+    if (killed) return;
+    killed = true;
+    LOG(WARNING) << reason << ": aborting command";
+
+    // 进程组内的进程可能已经通过 setsid 离开，cgroup 才包含受控程序的所有进程
+    if (kill(-child, SIGKILL) != 0 && errno != ESRCH)
+        LOG(ERROR) << "unable to send SIGKILL to command: " << strerror(errno);
+    try {
+        cgroup_kill(opt);
+    } catch (exception &e) {
+        LOG(ERROR) << "unable to kill cgroup: " << e.what();
+    }
+}
+
+int watchdog::wait(struct rusage &ru) {
+    struct epoll_event events[8];
+    while (true) {
+        int status;
+        pid_t pid = wait4(child, &status, WNOHANG, &ru);
+        if (pid < 0) throw system_error(errno, system_category(), "wait4");
+        if (pid == child) return status;
+
+        int n = epoll_wait(epoll_fd, events, 8, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw system_error(errno, system_category(), "epoll_wait");
+        }
+
+        for (int i = 0; i < n; ++i) {
+            uint32_t id = events[i].data.u32;
+            if (id == EVENT_CHILD) {
+                // pidfd 在进程退出后保持可读，由循环开头的 wait4 回收进程
+                if (child_fd_is_signalfd) {
+                    struct signalfd_siginfo info;
+                    while (read(child_fd, &info, sizeof(info)) > 0)
+                        ;
+                }
+            } else if (id == EVENT_TIMER) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    wall_timeout = true;
+                    kill_command("timelimit exceeded (hard wall time)");
+                }
+            } else if (id == EVENT_SIGNAL) {
+                struct signalfd_siginfo info;
+                if (read(signal_fd, &info, sizeof(info)) > 0) {
+                    signaled = true;
+                    kill_command(fmt::format("received signal {}", info.ssi_signo).c_str());
+                }
+            } else if (handlers[id - EVENT_CUSTOM]()) {
+                kill_command("resource limit exceeded");
+            }
+        }
+    }
+}
+
+bool watchdog::wall_limit_exceeded() const {
+    return wall_timeout;
+}
+
+bool watchdog::terminated() const {
+    return signaled;
+}
@@ -1,7 +1,7 @@
 #include "asset.hpp"
-#include <curl/curl.h>
 #include <fstream>
-#include "common/exceptions.hpp"
+#include "blob_store.hpp"
+#include "downloader.hpp"
 
 namespace judge {
 using namespace std;
@@ -26,25 +26,58 @@ void text_asset::fetch(const filesystem::path &path) {
 remote_asset::remote_asset(const string &name, const string &url_get)
     : asset(name), url(url_get) {}
 
-// TODO: 针对 CURLcode throw 更加精确的 exception
 void remote_asset::fetch(const filesystem::path &path) {
-    auto filename = path / name;
-    filesystem::create_directories(filename.parent_path());
-    if (CURL *curl = curl_easy_init()) {
-        FILE *fp = fopen(filename.c_str(), "wb");
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, nullptr);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-        CURLcode res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        fclose(fp);
- 
-        if (res != CURLcode::CURLE_OK) {
-            BOOST_THROW_EXCEPTION(network_error() << "unable to download " << url << ", CURLcode=" << res);
+    fetch_assets({{this, path}});
+}
+
+compression remote_asset::encoding() const {
+    if (is_archive()) return compression::NONE;
+    compression type = compression_of(url);
+    // 文件名带有相同的压缩后缀时，选手程序读取的就是压缩文件本身
+    if (type == compression_of(name)) return compression::NONE;
+    return type;
+}
+
+bool remote_asset::is_archive() const {
+    return judge::is_archive(url);
+}
+
+vector<filesystem::path> fetch_assets(const vector<pair<asset *, filesystem::path>> &assets, bool keep_compressed, bool shared, const atomic<bool> *cancelled) {
+    vector<blob_store::request> downloads;
+    vector<filesystem::path> compressed;
+    vector<pair<filesystem::path, filesystem::path>> archives;  // 下载完成后要解压的数据包和解压到的目录
+    for (auto &[file, dir] : assets) {
+        auto remote = dynamic_cast<remote_asset *>(file);
+        if (!remote) {
+            file->fetch(dir);
+            continue;
+        }
+
+        compression type = remote->encoding();
+        if (remote->is_archive()) {
+            // 数据包总是以压缩的形式下载保存，相同的数据包在 blob_store 中只保存一份
+            // 解压后立即删除的数据包不会被评测脚本修改，总是硬链接
+            filesystem::path pack = dir / remote->name;
+            downloads.push_back({remote->url, pack, compression::NONE, shared || !keep_compressed});
+            if (keep_compressed)
+                compressed.push_back(pack);
+            else
+                archives.emplace_back(pack, dir);
+        } else if (type != compression::NONE && keep_compressed) {
+            filesystem::path target = dir / (remote->name + compression_suffix(type));
+            downloads.push_back({remote->url, target, compression::NONE, shared});
+            compressed.push_back(target);
+        } else {
+            downloads.push_back({remote->url, dir / remote->name, type, shared});
         }
-    } else {
-        BOOST_THROW_EXCEPTION(network_error() << "unable to download " << url << ", unable to init curl");
     }
+    if (!downloads.empty()) blob_store::global().fetch(downloader::global(), downloads, cancelled);
+
+    for (auto &[pack, dir] : archives) {
+        extract_archive(pack, dir);
+        filesystem::remove(pack);
+    }
+    return compressed;
 }
 
 }  // namespace judge
@@ -0,0 +1,256 @@
+#include "blob_store.hpp"
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <openssl/evp.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <boost/uuid/uuid_generators.hpp>
+#include <boost/uuid/uuid_io.hpp>
+#include <fstream>
+#include <future>
+#include <memory>
+#include "common/defer.hpp"
+#include "common/exceptions.hpp"
+#include "common/io_utils.hpp"
+#include "config.hpp"
+
+namespace judge {
+using namespace std;
+
+/**
+ * @brief 增量计算 SHA-256
+ */
+struct sha256 {
+    sha256() : ctx(EVP_MD_CTX_new(), EVP_MD_CTX_free) {
+        if (!ctx || EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr) != 1)
+            BOOST_THROW_EXCEPTION(judge_exception("unable to init sha256"));
+    }
+
+    void update(const void *data, size_t size) {
+        EVP_DigestUpdate(ctx.get(), data, size);
+    }
+
+    string hex() {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int size = 0;
+        EVP_DigestFinal_ex(ctx.get(), digest, &size);
+        string result;
+        for (unsigned int i = 0; i < size; ++i) result += fmt::format("{:02x}", digest[i]);
+        return result;
+    }
+
+private:
+    unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx;
+};
+
+string sha256_file(const filesystem::path &file) {
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to open {}", file.string())));
+    sha256 hash;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) hash.update(buffer, n);
+    close(fd);
+    if (n < 0) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to read {}", file.string())));
+    return hash.hex();
+}
+
+static string sha256_string(const string &value) {
+    sha256 hash;
+    hash.update(value.data(), value.size());
+    return hash.hex();
+}
+
+/**
+ * @brief 按 SHA-256 的前两位分散到子文件夹，避免单个文件夹内的文件过多
+ */
+static filesystem::path fanout(const filesystem::path &dir, const string &hash) {
+    return dir / hash.substr(0, 2) / hash;
+}
+
+/**
+ * @brief URL 记录的索引键，URL 中不会出现空格，解压与否分开记录
+ */
+static string index_key(const string &url, compression decode) {
+    return decode == compression::NONE ? url : "decompressed " + url;
+}
+
+blob_store::blob_store(const filesystem::path &root) : root(root) {}
+
+blob_store &blob_store::global() {
+    static blob_store instance(CACHE_DIR / ".blobs");
+    return instance;
+}
+
+bool blob_store::lookup(const string &url, url_entry &entry, compression decode) const {
+    string key = index_key(url, decode);
+    ifstream fin(fanout(root / "urls", sha256_string(key)));
+    string recorded_key;
+    if (!getline(fin, entry.hash) || !getline(fin, entry.validators.etag) ||
+        !getline(fin, entry.validators.last_modified) || !getline(fin, recorded_key))
+        return false;
+    return recorded_key == key && filesystem::exists(blob_path(entry.hash));
+}
+
+void blob_store::record(const string &url, const url_entry &entry, compression decode) {
+    string key = index_key(url, decode);
+    filesystem::path index = fanout(root / "urls", sha256_string(key));
+    filesystem::path temp = temp_path();
+    {
+        ofstream fout(temp);
+        fout << entry.hash << '\n'
+             << entry.validators.etag << '\n'
+             << entry.validators.last_modified << '\n'
+             << key << '\n';
+        if (!fout) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to write index of {}", url)));
+    }
+    // 先写临时文件再 rename，并发获取同一个 URL 的 worker 不会读到写了一半的记录
+    filesystem::create_directories(index.parent_path());
+    filesystem::rename(temp, index);
+}
+
+string blob_store::put(const filesystem::path &file) {
+    string hash = sha256_file(file);
+    filesystem::path blob = blob_path(hash);
+    if (filesystem::exists(blob)) {
+        filesystem::remove(file);
+    } else {
+        filesystem::create_directories(blob.parent_path());
+        filesystem::permissions(file, filesystem::perms::owner_read | filesystem::perms::group_read | filesystem::perms::others_read);
+        // 同时存入相同内容的文件时后一个 rename 覆盖前一个，内容不变
+        filesystem::rename(file, blob);
+    }
+    return hash;
+}
+
+filesystem::path blob_store::blob_path(const string &hash) const {
+    return fanout(root / "objects", hash);
+}
+
+filesystem::path blob_store::temp_path() const {
+    filesystem::create_directories(root / "tmp");
+    return root / "tmp" / boost::lexical_cast<string>(boost::uuids::random_generator()());
+}
+
+void blob_store::fetch(downloader &engine, const vector<request> &files, const atomic<bool> *cancelled) {
+    struct job {
+        bool cached;
+        url_entry entry;
+        filesystem::path temp;
+        future<download_result> result;
+    };
+
+    // 回收文件时持有独占锁，避免查找到的文件在链接前被删除
+    scoped_file_lock lock = lock_directory(root, true);
+
+    vector<job> jobs(files.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto &j = jobs[i];
+        auto &file = files[i];
+        j.cached = lookup(file.url, j.entry, file.decode);
+        j.temp = temp_path();
+        j.result = engine.download(file.url, j.temp, j.cached ? j.entry.validators : cache_validators(), file.decode, cancelled);
+    }
+
+    // 和 downloader::download_all 一样等待所有下载结束后再抛出异常
+    exception_ptr error;
+    for (size_t i = 0; i < files.size(); ++i) {
+        auto &file = files[i];
+        auto &j = jobs[i];
+        try {
+            download_result result = j.result.get();
+            if (result.modified) {
+                j.entry.hash = put(j.temp);
+                j.entry.validators = result.validators;
+                record(file.url, j.entry, file.decode);
+            } else {
+                DLOG(INFO) << file.url << " is not modified, reusing blob " << j.entry.hash;
+            }
+            if (file.shared)
+                link(blob_path(j.entry.hash), file.target);
+            else
+                copy(blob_path(j.entry.hash), file.target);
+        } catch (...) {
+            error_code ec;
+            filesystem::remove(j.temp, ec);
+            if (!error) error = current_exception();
+        }
+    }
+    if (error) rethrow_exception(error);
+}
+
+void blob_store::link(const filesystem::path &blob, const filesystem::path &target) {
+    filesystem::create_directories(target.parent_path());
+    filesystem::remove(target);
+    error_code ec;
+    filesystem::create_hard_link(blob, target, ec);
+    if (ec) {
+        LOG(WARNING) << "Unable to link " << blob << " to " << target << ": " << ec.message() << ", copying instead";
+        filesystem::copy_file(blob, target);
+    }
+}
+
+void blob_store::copy(const filesystem::path &blob, const filesystem::path &target) {
+    filesystem::create_directories(target.parent_path());
+    filesystem::remove(target);
+    filesystem::copy_file(blob, target);
+    // 存储中的文件是只读的，拷贝得到的文件恢复为普通文件的权限
+    filesystem::permissions(target, filesystem::perms::owner_write, filesystem::perm_options::add);
+}
+
+/**
+ * @brief 文件的 ctime，增删硬链接都会更新 ctime
+ */
+static bool status_change_time(const filesystem::path &path, nlink_t &links, time_t &ctime) {
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) return false;
+    links = st.st_nlink;
+    ctime = st.st_ctime;
+    return true;
+}
+
+bool blob_store::collect(chrono::seconds interval, chrono::seconds grace) {
+    int64_t now = chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t next = next_collect;
+    if (now < next || !next_collect.compare_exchange_strong(next, now + interval.count())) return false;
+
+    filesystem::create_directories(root);
+    int fd = open((root / ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to open {}", (root / ".lock").string())));
+    defer { close(fd); };
+    // 不等待正在获取文件的 worker，下一次再回收
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) return false;
+
+    time_t deadline = time(nullptr) - grace.count();
+    size_t removed = 0;
+    error_code ec;
+    for (auto &dir : {root / "objects", root / "tmp"}) {
+        if (!filesystem::exists(dir)) continue;
+        for (auto &entry : filesystem::recursive_directory_iterator(dir, ec)) {
+            nlink_t links;
+            time_t ctime;
+            if (!entry.is_regular_file(ec) || !status_change_time(entry.path(), links, ctime)) continue;
+            if (links == 1 && ctime <= deadline && filesystem::remove(entry.path(), ec)) ++removed;
+        }
+    }
+
+    // URL 记录指向的文件已经被回收时，下次获取总是重新下载，记录没有用了
+    if (filesystem::exists(root / "urls")) {
+        for (auto &entry : filesystem::recursive_directory_iterator(root / "urls", ec)) {
+            if (!entry.is_regular_file(ec)) continue;
+            ifstream fin(entry.path());
+            string hash;
+            if (!getline(fin, hash) || !filesystem::exists(blob_path(hash)))
+                filesystem::remove(entry.path(), ec);
+        }
+    }
+
+    if (removed) LOG(INFO) << "Collected " << removed << " unused blobs in " << root;
+    return true;
+}
+
+}  // namespace judge
@@ -0,0 +1,246 @@
+#include "common/compression.hpp"
+#include <archive.h>
+#include <archive_entry.h>
+#include <fmt/core.h>
+#include <lzma.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <cstring>
+#include "common/defer.hpp"
+#include "common/exceptions.hpp"
+
+namespace judge {
+using namespace std;
+
+static bool ends_with(const string &str, const string &suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/**
+ * @brief 去掉 URL 的查询字符串和片段，只保留路径
+ */
+static string strip_query(const string &url) {
+    return url.substr(0, url.find_first_of("?#"));
+}
+
+compression compression_of(const string &url) {
+    string path = strip_query(url);
+    if (ends_with(path, ".gz")) return compression::GZIP;
+    if (ends_with(path, ".zst")) return compression::ZSTD;
+    if (ends_with(path, ".xz")) return compression::XZ;
+    return compression::NONE;
+}
+
+string compression_suffix(compression type) {
+    switch (type) {
+        case compression::GZIP: return ".gz";
+        case compression::ZSTD: return ".zst";
+        case compression::XZ: return ".xz";
+        default: return "";
+    }
+}
+
+bool is_archive(const string &url) {
+    string path = strip_query(url);
+    for (const char *suffix : {".tar", ".tar.gz", ".tgz", ".tar.zst", ".tar.xz"})
+        if (ends_with(path, suffix)) return true;
+    return false;
+}
+
+static void write_all(const void *data, size_t size, FILE *out) {
+    if (size > 0 && fwrite(data, 1, size, out) != size)
+        BOOST_THROW_EXCEPTION(judge_exception("unable to write decompressed data"));
+}
+
+struct zstd_decompressor : public decompressor {
+    zstd_decompressor() : stream(ZSTD_createDStream()) {
+        if (!stream) BOOST_THROW_EXCEPTION(judge_exception("unable to create zstd stream"));
+        ZSTD_initDStream(stream);
+    }
+
+    ~zstd_decompressor() {
+        ZSTD_freeDStream(stream);
+    }
+
+    void write(const void *data, size_t size, FILE *out) override {
+        ZSTD_inBuffer in = {data, size, 0};
+        ZSTD_outBuffer output;
+        // 输出缓冲区写满时解压器内部可能还有数据，即使输入已经读完也要继续取出
+        do {
+            output = {buffer, sizeof(buffer), 0};
+            // 返回 0 表示一个 frame 已经结束，随后的输入是下一个 frame（如 zstd 拼接的文件）
+            pending = ZSTD_decompressStream(stream, &output, &in);
+            if (ZSTD_isError(pending))
+                BOOST_THROW_EXCEPTION(judge_exception(fmt::format("invalid zstd data: {}", ZSTD_getErrorName(pending))));
+            write_all(buffer, output.pos, out);
+        } while (in.pos < in.size || output.pos == output.size);
+    }
+
+    void finish() override {
+        if (pending != 0) BOOST_THROW_EXCEPTION(judge_exception("truncated zstd data"));
+    }
+
+private:
+    ZSTD_DStream *stream;
+    size_t pending = 1;
+    char buffer[1 << 17];
+};
+
+struct gzip_decompressor : public decompressor {
+    gzip_decompressor() {
+        memset(&stream, 0, sizeof(stream));
+        // 15 + 32: 最大窗口，自动识别 gzip 和 zlib 头
+        if (inflateInit2(&stream, 15 + 32) != Z_OK)
+            BOOST_THROW_EXCEPTION(judge_exception("unable to create zlib stream"));
+    }
+
+    ~gzip_decompressor() {
+        inflateEnd(&stream);
+    }
+
+    void write(const void *data, size_t size, FILE *out) override {
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = size;
+        do {
+            if (ended && stream.avail_in > 0) {
+                // gzip 允许多个成员拼接
+                inflateReset(&stream);
+                ended = false;
+            }
+            stream.next_out = (Bytef *)buffer;
+            stream.avail_out = sizeof(buffer);
+            int ret = inflate(&stream, Z_NO_FLUSH);
+            if (ret == Z_BUF_ERROR) break;  // 没有可以处理的输入
+            if (ret != Z_OK && ret != Z_STREAM_END)
+                BOOST_THROW_EXCEPTION(judge_exception(fmt::format("invalid gzip data: {}", stream.msg ? stream.msg : zError(ret))));
+            write_all(buffer, sizeof(buffer) - stream.avail_out, out);
+            if (ret == Z_STREAM_END) ended = true;
+        } while (stream.avail_in > 0 || stream.avail_out == 0);
+    }
+
+    void finish() override {
+        if (!ended) BOOST_THROW_EXCEPTION(judge_exception("truncated gzip data"));
+    }
+
+private:
+    z_stream stream;
+    bool ended = false;
+    char buffer[1 << 17];
+};
+
+struct xz_decompressor : public decompressor {
+    xz_decompressor() {
+        if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK)
+            BOOST_THROW_EXCEPTION(judge_exception("unable to create xz stream"));
+    }
+
+    ~xz_decompressor() {
+        lzma_end(&stream);
+    }
+
+    void write(const void *data, size_t size, FILE *out) override {
+        stream.next_in = (const uint8_t *)data;
+        stream.avail_in = size;
+        while (stream.avail_in > 0) code(LZMA_RUN, out);
+        last_out = out;
+    }
+
+    void finish() override {
+        // LZMA_CONCATENATED 模式下只有输入结束后才能确认最后一个 stream 是完整的
+        if (code(LZMA_FINISH, last_out) != LZMA_STREAM_END)
+            BOOST_THROW_EXCEPTION(judge_exception("truncated xz data"));
+    }
+
+private:
+    lzma_ret code(lzma_action action, FILE *out) {
+        lzma_ret ret;
+        do {
+            stream.next_out = (uint8_t *)buffer;
+            stream.avail_out = sizeof(buffer);
+            ret = lzma_code(&stream, action);
+            if (ret != LZMA_OK && ret != LZMA_STREAM_END)
+                BOOST_THROW_EXCEPTION(judge_exception(fmt::format("invalid xz data, lzma_ret={}", (int)ret)));
+            if (out) write_all(buffer, sizeof(buffer) - stream.avail_out, out);
+        } while (stream.avail_out == 0);
+        return ret;
+    }
+
+    lzma_stream stream = LZMA_STREAM_INIT;
+    FILE *last_out = nullptr;
+    char buffer[1 << 17];
+};
+
+unique_ptr<decompressor> make_decompressor(compression type) {
+    switch (type) {
+        case compression::GZIP: return make_unique<gzip_decompressor>();
+        case compression::ZSTD: return make_unique<zstd_decompressor>();
+        case compression::XZ: return make_unique<xz_decompressor>();
+        default: BOOST_THROW_EXCEPTION(judge_exception("no decompressor for uncompressed data"));
+    }
+}
+
+void decompress_file(const filesystem::path &from, const filesystem::path &to, compression type) {
+    FILE *in = fopen(from.c_str(), "rb");
+    if (!in) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to open {}", from.string())));
+    defer { fclose(in); };
+    // 目标文件可能是指向 blob_store 的硬链接，必须先删除再写入，否则会修改共用的文件
+    filesystem::remove(to);
+    FILE *out = fopen(to.c_str(), "wb");
+    if (!out) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to open {}", to.string())));
+    defer { fclose(out); };
+
+    auto decoder = make_decompressor(type);
+    char buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        decoder->write(buffer, n, out);
+    if (ferror(in)) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to read {}", from.string())));
+    decoder->finish();
+}
+
+void extract_archive(const filesystem::path &archive_path, const filesystem::path &dir) {
+    struct archive *a = archive_read_new();
+    defer { archive_read_free(a); };
+    archive_read_support_filter_all(a);
+    archive_read_support_format_tar(a);
+    if (archive_read_open_filename(a, archive_path.c_str(), 1 << 16) != ARCHIVE_OK)
+        BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to open {}: {}", archive_path.string(), archive_error_string(a))));
+
+    struct archive_entry *entry;
+    int ret;
+    while ((ret = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+        filesystem::path name = filesystem::path(archive_entry_pathname(entry)).lexically_normal();
+        // 和可执行文件包一样拒绝链接，链接和 .. 都可能让选手程序或评测脚本访问到数据文件夹之外的文件
+        bool escapes = name.is_absolute() || (!name.empty() && *name.begin() == "..");
+        auto type = archive_entry_filetype(entry);
+        if (escapes || (type != AE_IFREG && type != AE_IFDIR))
+            BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unsafe entry {} in {}", archive_entry_pathname(entry), archive_path.string())));
+
+        filesystem::path target = dir / name;
+        if (type == AE_IFDIR) {
+            filesystem::create_directories(target);
+            continue;
+        }
+
+        filesystem::create_directories(target.parent_path());
+        filesystem::remove(target);  // 同 decompress_file，不能写入已有的硬链接
+        FILE *out = fopen(target.c_str(), "wb");
+        if (!out) BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to open {}", target.string())));
+        defer { fclose(out); };
+        const void *block;
+        size_t size;
+        la_int64_t offset;
+        while ((ret = archive_read_data_block(a, &block, &size, &offset)) == ARCHIVE_OK) {
+            // 稀疏文件的数据块之间有空洞
+            if (fseeko(out, offset, SEEK_SET) != 0)
+                BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to write {}", target.string())));
+            write_all(block, size, out);
+        }
+        if (ret != ARCHIVE_EOF)
+            BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to extract {}: {}", archive_path.string(), archive_error_string(a))));
+    }
+    if (ret != ARCHIVE_EOF)
+        BOOST_THROW_EXCEPTION(judge_exception(fmt::format("unable to read {}: {}", archive_path.string(), archive_error_string(a))));
+}
+
+}  // namespace judge
@@ -0,0 +1,58 @@
+#include "common/numa.hpp"
+#include <glog/logging.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+namespace judge {
+using namespace std;
+
+int numa_node_of_cpu(size_t cpu) {
+    error_code ec;
+    filesystem::directory_iterator it("/sys/devices/system/cpu/cpu" + to_string(cpu), ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        string name = it->path().filename();
+        if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+            name.find_first_not_of("0123456789", 4) == string::npos)
+            return stoi(name.substr(4));
+    }
+    return 0;
+}
+
+void prefer_numa_node(int node) {
+    unsigned long nodemask = 0;
+    if (node < 0 || node >= (int)sizeof(nodemask) * 8) return;
+    nodemask = 1UL << node;
+    // glibc 没有封装 set_mempolicy，为此引入 libnuma 不值得
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8) != 0)
+        LOG(WARNING) << "Unable to prefer memory of NUMA node " << node << ": " << strerror(errno);
+}
+
+void interleave_numa_nodes() {
+    // 在线节点的格式形如 0-1,3
+    ifstream fin("/sys/devices/system/node/online");
+    string ranges;
+    if (!getline(fin, ranges)) return;
+
+    unsigned long nodemask = 0;
+    size_t pos = 0;
+    while (pos < ranges.size()) {
+        size_t end = ranges.find(',', pos);
+        if (end == string::npos) end = ranges.size();
+        string range = ranges.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        int first = stoi(range), last = dash == string::npos ? first : stoi(range.substr(dash + 1));
+        for (int node = first; node <= last && node < (int)sizeof(nodemask) * 8; ++node) nodemask |= 1UL << node;
+        pos = end + 1;
+    }
+    if ((nodemask & (nodemask - 1)) == 0) return;  // 只有一个节点
+
+    if (syscall(SYS_set_mempolicy, MPOL_INTERLEAVE, &nodemask, sizeof(nodemask) * 8) != 0)
+        LOG(WARNING) << "Unable to interleave memory across NUMA nodes " << ranges << ": " << strerror(errno);
+}
+
+}  // namespace judge
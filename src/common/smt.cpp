@@ -0,0 +1,69 @@
+#include "common/smt.hpp"
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <fstream>
+#include <map>
+
+namespace judge {
+using namespace std;
+
+// worker 核心到 SHARED 策略下登记的兄弟核心，只在启动 worker 之前写入，之后只读，不需要加锁
+static map<size_t, vector<size_t>> auxiliary_cores;
+
+set<size_t> smt_siblings_of_cpu(size_t cpu) {
+    set<size_t> siblings;
+    ifstream fin("/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/thread_siblings_list");
+    string list;
+    if (!getline(fin, list)) return siblings;
+
+    // 格式和 cpuset 相同，如 "0,4" 或 "0-1"
+    vector<string> tokens;
+    boost::split(tokens, list, boost::is_any_of(","));
+    try {
+        for (auto &token : tokens) {
+            size_t dash = token.find('-');
+            size_t first = boost::lexical_cast<size_t>(token.substr(0, dash));
+            size_t last = dash == string::npos ? first : boost::lexical_cast<size_t>(token.substr(dash + 1));
+            for (size_t i = first; i <= last; ++i) siblings.insert(i);
+        }
+    } catch (boost::bad_lexical_cast &) {
+        return {};
+    }
+    siblings.erase(cpu);
+    return siblings;
+}
+
+vector<size_t> select_worker_cores(const set<unsigned> &cores, smt_policy policy) {
+    vector<size_t> workers;
+    if (policy == smt_policy::ALL) {
+        workers.assign(cores.begin(), cores.end());
+        return workers;
+    }
+
+    set<size_t> claimed;
+    for (size_t core : cores) {
+        if (claimed.count(core)) continue;
+        workers.push_back(core);
+        for (size_t sibling : smt_siblings_of_cpu(core)) {
+            if (!cores.count(sibling)) continue;
+            claimed.insert(sibling);
+            if (policy == smt_policy::SHARED) auxiliary_cores[core].push_back(sibling);
+        }
+    }
+    return workers;
+}
+
+string auxiliary_cpuset(const string &execcpuset) {
+    if (auxiliary_cores.empty()) return execcpuset;
+
+    vector<string> cores, result;
+    boost::split(cores, execcpuset, boost::is_any_of(","));
+    for (auto &core : cores) {
+        auto it = auxiliary_cores.find(boost::lexical_cast<size_t>(core));
+        if (it == auxiliary_cores.end()) return execcpuset;  // 有核心没有兄弟核心时保持原样
+        for (size_t sibling : it->second) result.push_back(to_string(sibling));
+    }
+    return boost::algorithm::join(result, ",");
+}
+
+}  // namespace judge
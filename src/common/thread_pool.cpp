@@ -0,0 +1,29 @@
+#include "common/thread_pool.hpp"
+#include <algorithm>
+
+namespace judge {
+using namespace std;
+
+thread_pool::thread_pool(size_t count, function<void()> init) {
+    for (size_t i = 0; i < max(count, (size_t)1); ++i)
+        threads.emplace_back(&thread_pool::loop, this, init);
+}
+
+thread_pool::~thread_pool() {
+    for (size_t i = 0; i < threads.size(); ++i) tasks.push(nullptr);
+    for (auto &thd : threads) thd.join();
+}
+
+future<void> thread_pool::submit(function<void()> task) {
+    auto packaged = make_shared<packaged_task<void()>>(move(task));
+    future<void> result = packaged->get_future();
+    tasks.push(packaged);
+    return result;
+}
+
+void thread_pool::loop(function<void()> init) {
+    if (init) init();
+    while (auto task = tasks.pop()) (*task)();
+}
+
+}  // namespace judge
@@ -7,11 +7,16 @@ int MAX_RANDOM_DATA_NUM = 100;
 int SCRIPT_MEM_LIMIT = 1 << 18;   // 256M
 int SCRIPT_TIME_LIMIT = 10;       // 10s
 int SCRIPT_FILE_LIMIT = 1 << 19;  // 512M
+int DOWNLOAD_CONCURRENCY = 8;
+int DOWNLOAD_RETRIES = 2;
+int DOWNLOAD_TIMEOUT = 30;  // 30s
+int PREFETCH_THREADS = 4;
 
 filesystem::path EXEC_DIR;
 filesystem::path CACHE_DIR;
 filesystem::path DATA_DIR;
 bool USE_DATA_DIR = false;
+bool KEEP_COMPRESSED_DATA = false;
 filesystem::path RUN_DIR;
 filesystem::path CHROOT_DIR;
 filesystem::path SCRIPT_DIR;
@@ -0,0 +1,409 @@
+#include "downloader.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <glog/logging.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include "common/exceptions.hpp"
+#include "config.hpp"
+
+namespace judge {
+using namespace std;
+
+/**
+ * @brief 边下载边解压时 curl 写入回调的状态
+ */
+struct decode_sink {
+    unique_ptr<decompressor> decoder;
+    FILE *fp = nullptr;
+    string error;
+};
+
+struct downloader::transfer {
+    string url;
+    filesystem::path file;
+    cache_validators known;
+    compression decode = compression::NONE;
+    const atomic<bool> *cancelled = nullptr;
+    download_result result;
+    promise<download_result> done;
+
+    CURL *curl = nullptr;
+    FILE *fp = nullptr;
+    curl_slist *headers = nullptr;
+    decode_sink sink;
+    unsigned attempts = 0;
+    bool completed = false;
+
+    // 下一次尝试的时间，新加入的下载为 time_point 的初始值，即立即开始
+    chrono::steady_clock::time_point retry_at;
+
+    bool aborted() const {
+        return cancelled && *cancelled;
+    }
+};
+
+static once_flag curl_initialized;
+
+static void reject(promise<download_result> &done, const string &message) {
+    try {
+        BOOST_THROW_EXCEPTION(network_error(message));
+    } catch (...) {
+        done.set_exception(current_exception());
+    }
+}
+
+bool cache_validators::empty() const {
+    return etag.empty() && last_modified.empty();
+}
+
+/**
+ * @brief 记录响应头中的 ETag 和 Last-Modified
+ * 跟随重定向时每个响应的头部都会传入，以状态行为界只保留最后一个响应的校验信息
+ */
+static size_t on_header(char *buffer, size_t size, size_t nitems, void *userdata) {
+    auto &validators = *reinterpret_cast<cache_validators *>(userdata);
+    size_t length = size * nitems;
+    string line(buffer, length);
+    while (!line.empty() && (line.back() == '\r' || line.back() == '\n')) line.pop_back();
+
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        validators = {};
+        return length;
+    }
+
+    size_t colon = line.find(':');
+    if (colon == string::npos) return length;
+    size_t begin = line.find_first_not_of(" \t", colon + 1);
+    string value = begin == string::npos ? "" : line.substr(begin);
+    if (colon == 4 && strncasecmp(line.c_str(), "ETag", 4) == 0)
+        validators.etag = value;
+    else if (colon == 13 && strncasecmp(line.c_str(), "Last-Modified", 13) == 0)
+        validators.last_modified = value;
+    return length;
+}
+
+/**
+ * @brief 将收到的压缩数据解压后写入文件，解压失败时返回 0 让 curl 以 CURLE_WRITE_ERROR 结束传输
+ */
+static size_t on_compressed_data(char *data, size_t size, size_t nmemb, void *userdata) {
+    auto &sink = *reinterpret_cast<decode_sink *>(userdata);
+    try {
+        sink.decoder->write(data, size * nmemb, sink.fp);
+        return size * nmemb;
+    } catch (judge_exception &e) {
+        sink.error = e.what();
+        return 0;
+    }
+}
+
+/**
+ * @brief 调用方放弃下载时返回非 0，curl 以 CURLE_ABORTED_BY_CALLBACK 结束传输
+ * 传输停滞时 curl 仍然大约每秒调用一次，因此等待服务器响应的下载也能及时中止
+ */
+static int on_progress(void *userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    auto &cancelled = *reinterpret_cast<const atomic<bool> *>(userdata);
+    return cancelled ? 1 : 0;
+}
+
+/**
+ * @brief 连接失败、超时、服务器暂时不可用时值得重试，地址错误、404 等重试也不会成功
+ */
+static bool retryable(CURLcode code, long status) {
+    switch (code) {
+        case CURLE_HTTP_RETURNED_ERROR:
+            return status >= 500 || status == 408 || status == 429;
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+downloader::downloader(const download_options &options) : options(options) {
+    call_once(curl_initialized, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+    this->options.concurrency = max(options.concurrency, 1u);
+
+    multi = curl_multi_init();
+    if (!multi) BOOST_THROW_EXCEPTION(network_error("unable to init curl multi handle"));
+    long concurrency = this->options.concurrency;
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, concurrency);
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, concurrency);
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, concurrency);  // 连接缓存的大小
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+#if LIBCURL_VERSION_NUM < 0x074400
+    if (pipe2(wakeup_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        curl_multi_cleanup(multi);
+        BOOST_THROW_EXCEPTION(network_error("unable to create wakeup pipe of downloader"));
+    }
+#endif
+
+    worker = thread(&downloader::loop, this);
+}
+
+downloader::~downloader() {
+    {
+        lock_guard<std::mutex> guard(pending_mutex);
+        stopping = true;
+    }
+    wakeup();
+    worker.join();
+    curl_multi_cleanup(multi);
+    for (int fd : wakeup_pipe)
+        if (fd >= 0) close(fd);
+}
+
+downloader &downloader::global() {
+    static downloader instance({(unsigned)DOWNLOAD_CONCURRENCY, (unsigned)DOWNLOAD_RETRIES, DOWNLOAD_TIMEOUT});
+    return instance;
+}
+
+future<download_result> downloader::download(const string &url, const filesystem::path &file, const cache_validators &known, compression decode, const atomic<bool> *cancelled) {
+    filesystem::create_directories(file.parent_path());
+
+    auto t = make_unique<transfer>();
+    t->url = url;
+    t->file = file;
+    t->known = known;
+    t->decode = decode;
+    t->cancelled = cancelled;
+    future<download_result> result = t->done.get_future();
+    {
+        lock_guard<std::mutex> guard(pending_mutex);
+        if (stopping) BOOST_THROW_EXCEPTION(network_error("downloader is stopped"));
+        pending.push_back(move(t));
+    }
+    wakeup();
+    return result;
+}
+
+void downloader::download_all(const vector<pair<string, filesystem::path>> &files) {
+    vector<future<download_result>> futures;
+    for (auto &[url, file] : files)
+        futures.push_back(download(url, file));
+
+    // 等待所有下载结束后再抛出异常，避免调用方清理文件夹时仍有文件在写入
+    exception_ptr error;
+    for (auto &result : futures) {
+        try {
+            result.get();
+        } catch (...) {
+            if (!error) error = current_exception();
+        }
+    }
+    if (error) rethrow_exception(error);
+}
+
+void downloader::start(transfer &t) {
+    ++t.attempts;
+    t.fp = fopen(t.file.c_str(), "wb");
+    if (!t.fp) {
+        reject(t.done, fmt::format("unable to download {}, cannot open {}", t.url, t.file.string()));
+        t.completed = true;
+        return;
+    }
+
+    CURL *curl = t.curl = curl_easy_init();
+    if (!curl) {
+        fclose(t.fp);
+        t.fp = nullptr;
+        reject(t.done, fmt::format("unable to download {}, unable to init curl", t.url));
+        t.completed = true;
+        return;
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, t.url.c_str());
+    if (t.decode != compression::NONE) {
+        // 重试时从头开始解压
+        t.sink = {make_decompressor(t.decode), t.fp, ""};
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_compressed_data);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &t.sink);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, t.fp);
+        // 服务器支持时使用 gzip、zstd 等传输编码，curl 自动解码。
+        // 压缩文件不请求传输编码，避免服务器为 .gz 文件加上 Content-Encoding 后被 curl 提前解压
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    }
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, &t);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    // 优先等待可以复用的连接（HTTP/2 多路复用），而不是立即建立新连接
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+    // 大文件的下载时间没有上限，只有连接和传输停滞超时
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, options.timeout);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, options.timeout);
+
+    t.result = {};
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, on_header);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &t.result.validators);
+    if (!t.known.etag.empty())
+        t.headers = curl_slist_append(t.headers, ("If-None-Match: " + t.known.etag).c_str());
+    if (!t.known.last_modified.empty())
+        t.headers = curl_slist_append(t.headers, ("If-Modified-Since: " + t.known.last_modified).c_str());
+    if (t.headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, t.headers);
+    if (t.cancelled) {
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, on_progress);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, t.cancelled);
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
+    curl_multi_add_handle(multi, curl);
+    ++active;
+}
+
+void downloader::finish(transfer &t, CURLcode code) {
+    long status = 0;
+    curl_easy_getinfo(t.curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_multi_remove_handle(multi, t.curl);
+    curl_easy_cleanup(t.curl);
+    t.curl = nullptr;
+    curl_slist_free_all(t.headers);
+    t.headers = nullptr;
+    if (code == CURLE_OK && t.sink.decoder && status != 304) {
+        try {
+            t.sink.decoder->finish();
+        } catch (judge_exception &e) {
+            t.sink.error = e.what();
+        }
+    }
+    t.sink.decoder.reset();
+    bool flushed = fclose(t.fp) == 0;
+    t.fp = nullptr;
+    --active;
+
+    if (!t.sink.error.empty()) {
+        // 压缩数据损坏时重试也不会成功
+        reject(t.done, fmt::format("unable to decompress {}: {}", t.url, t.sink.error));
+        t.completed = true;
+        return;
+    }
+
+    if (code == CURLE_OK && flushed) {
+        if (status == 304) {
+            // 本地版本仍然有效，304 响应没有内容，删除打开目标文件时创建的空文件
+            error_code ec;
+            filesystem::remove(t.file, ec);
+            t.result.modified = false;
+            if (t.result.validators.empty()) t.result.validators = t.known;
+        }
+        t.done.set_value(t.result);
+        t.completed = true;
+        return;
+    }
+
+    if (t.aborted()) {
+        reject(t.done, fmt::format("download of {} is cancelled", t.url));
+    } else if (code == CURLE_OK) {
+        reject(t.done, fmt::format("unable to download {}, cannot write {}", t.url, t.file.string()));
+    } else if (retryable(code, status) && t.attempts <= options.retries) {
+        auto delay = chrono::milliseconds(100 << min(t.attempts - 1, 6u));
+        t.retry_at = chrono::steady_clock::now() + delay;
+        LOG(WARNING) << "Downloading " << t.url << " failed (" << curl_easy_strerror(code) << ", HTTP " << status
+                     << "), retrying in " << delay.count() << "ms";
+        return;
+    } else {
+        reject(t.done, fmt::format("unable to download {}, CURLcode={} ({}), HTTP status {}",
+                                   t.url, (int)code, curl_easy_strerror(code), status));
+    }
+    t.completed = true;
+}
+
+void downloader::wakeup() {
+#if LIBCURL_VERSION_NUM >= 0x074400
+    curl_multi_wakeup(multi);
+#else
+    // 管道已满时后台线程一定会被唤醒，忽略 EAGAIN
+    char c = 0;
+    if (write(wakeup_pipe[1], &c, 1) < 0 && errno != EAGAIN)
+        LOG(ERROR) << "unable to wake up downloader: " << strerror(errno);
+#endif
+}
+
+void downloader::wait(int timeout_ms) {
+#if LIBCURL_VERSION_NUM >= 0x074400
+    curl_multi_poll(multi, nullptr, 0, timeout_ms, nullptr);
+#else
+    struct curl_waitfd extra = {wakeup_pipe[0], CURL_WAIT_POLLIN, 0};
+    curl_multi_wait(multi, &extra, 1, timeout_ms, nullptr);
+    char buffer[64];
+    while (read(wakeup_pipe[0], buffer, sizeof(buffer)) > 0)
+        ;
+#endif
+}
+
+void downloader::loop() {
+    while (true) {
+        {
+            lock_guard<std::mutex> guard(pending_mutex);
+            if (stopping) break;
+            for (auto &t : pending) transfers.push_back(move(t));
+            pending.clear();
+        }
+
+        // 按加入的顺序开始下载，等待重试的下载到时间后才重新开始；
+        // 已经放弃的下载即使在排队也立即结束，在下面和完成的下载一起移除
+        auto now = chrono::steady_clock::now();
+        int timeout_ms = 1000;
+        for (auto &t : transfers) {
+            if (t->curl || t->completed) continue;
+            if (t->aborted()) {
+                reject(t->done, fmt::format("download of {} is cancelled", t->url));
+                t->completed = true;
+            } else if (active < options.concurrency) {
+                if (t->retry_at <= now)
+                    start(*t);
+                else
+                    timeout_ms = min(timeout_ms, (int)chrono::duration_cast<chrono::milliseconds>(t->retry_at - now).count() + 1);
+            }
+        }
+
+        int running, queued;
+        bool finished = false;
+        curl_multi_perform(multi, &running);
+        while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            transfer *t;
+            CURLcode code = msg->data.result;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &t);
+            finish(*t, code);
+            finished = true;
+        }
+        transfers.remove_if([](const unique_ptr<transfer> &t) { return t->completed; });
+
+        // 有下载结束时立即用空出的连接开始排队的下载；
+        // 否则等待 socket 事件，wakeup 在有新的下载或者需要结束时唤醒
+        if (!finished)
+            wait(timeout_ms);
+    }
+
+    for (auto &t : transfers) {
+        if (t->curl) {
+            curl_multi_remove_handle(multi, t->curl);
+            curl_easy_cleanup(t->curl);
+        }
+        curl_slist_free_all(t->headers);
+        if (t->fp) fclose(t->fp);
+        if (!t->completed) reject(t->done, fmt::format("unable to download {}, downloader is stopped", t->url));
+    }
+    transfers.clear();
+    lock_guard<std::mutex> guard(pending_mutex);
+    for (auto &t : pending) reject(t->done, fmt::format("unable to download {}, downloader is stopped", t->url));
+    pending.clear();
+}
+
+}  // namespace judge
@@ -3,6 +3,10 @@
 namespace judge {
 using namespace std;
 
+bool judger::run_background_task(const string &) const {
+    return false;
+}
+
 void judger::on_judge_finished(function<void(submission &)> callback) {
     judge_finished.push_back(callback);
 }
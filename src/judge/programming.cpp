@@ -10,14 +10,25 @@
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <fstream>
+#include <nlohmann/json.hpp>
+#include <regex>
+#include <set>
+#include "blob_store.hpp"
+#include "common/compression.hpp"
+#include "common/defer.hpp"
+#include "common/numa.hpp"
+#include "common/smt.hpp"
+#include "common/thread_pool.hpp"
 #include "common/stl_utils.hpp"
 #include "common/utils.hpp"
 #include "config.hpp"
 #include "runguard.hpp"
 #include "server/judge_server.hpp"
+#include "worker.hpp"
 
 namespace judge {
 using namespace std;
+using namespace nlohmann;
 
 test_case_data::test_case_data() {}
 
@@ -28,15 +39,144 @@ judge_task_result::judge_task_result() : judge_task_result(0) {}
 judge_task_result::judge_task_result(size_t id)
     : id(id), score(0), run_time(0), memory_used(0) {}
 
+/**
+ * @brief 根据随机测试的评测任务构造随机测试数据的生成方式
+ * @param submit 评测任务归属的选手提交信息，需要 submit.random 和 submit.standard 已经编译完成
+ * @param task 随机测试的评测任务
+ */
+static random_data_spec make_random_data_spec(programming_submission &submit, const judge_task &task) {
+    filesystem::path cachedir = CACHE_DIR / submit.category / submit.prob_id;
+    random_data_spec spec;
+    spec.cachedir = cachedir;
+    spec.updated_at = submit.updated_at;
+    spec.testcase_id = task.testcase_id;
+    spec.random_path = submit.random->get_run_path(cachedir / "random");
+    spec.standard_path = submit.standard->get_run_path(cachedir / "standard");
+    spec.run_script = task.run_script;
+    spec.exec_mgr = &submit.judge_server->get_executable_manager();
+    spec.time_limit = task.time_limit;
+    spec.run_args = task.run_args;
+    return spec;
+}
+
+/**
+ * @brief 将 runguard 记录的选手程序资源使用时间线降采样后附加到评测报告的 timeline 中
+ * 评测报告为空时新建一个 JSON 对象；评测报告不是 JSON 对象（比如比较器输出的纯文本）时保持不变
+ */
+static void attach_timeline(judge_task_result &result, const filesystem::path &timeline_file) {
+    const size_t MAX_TIMELINE_POINTS = 50;
+    auto timeline = downsample_timeline(read_runguard_timeline(timeline_file), MAX_TIMELINE_POINTS);
+    if (timeline.empty()) return;
+
+    json report;
+    if (!result.report.empty()) {
+        try {
+            report = json::parse(result.report);
+        } catch (json::exception &) {
+            return;
+        }
+        if (!report.is_object()) return;
+    }
+
+    // 按列存储，比每个采样点一个对象紧凑得多
+    json columns = {{"time", json::array()},
+                    {"memory", json::array()},
+                    {"cpu_time", json::array()},
+                    {"page_faults", json::array()},
+                    {"major_faults", json::array()},
+                    {"context_switches", json::array()},
+                    {"read_bytes", json::array()},
+                    {"write_bytes", json::array()}};
+    for (auto &point : timeline) {
+        columns["time"].push_back(point.time);
+        columns["memory"].push_back(point.memory);
+        columns["cpu_time"].push_back(point.cpu_time);
+        columns["page_faults"].push_back(point.page_faults);
+        columns["major_faults"].push_back(point.major_faults);
+        columns["context_switches"].push_back(point.context_switches);
+        columns["read_bytes"].push_back(point.read_bytes);
+        columns["write_bytes"].push_back(point.write_bytes);
+    }
+    report["timeline"] = columns;
+    result.report = report.dump();
+}
+
+// 标准测试数据文件夹中保存为压缩文件的路径列表，参见 KEEP_COMPRESSED_DATA
+static const char *COMPRESSED_MANIFEST = ".compressed";
+
+/**
+ * @brief 将测试数据拷贝到 to，并解压压缩保存的文件和数据包
+ * @param from 标准测试数据文件夹
+ * @param to DATA_DIR 中本测试点的数据文件夹
+ */
+static void expand_data_dir(const filesystem::path &from, const filesystem::path &to) {
+    set<filesystem::path> compressed;
+    ifstream fin(from / COMPRESSED_MANIFEST);
+    for (string line; getline(fin, line);)
+        if (!line.empty()) compressed.insert(line);
+
+    filesystem::create_directories(to);
+    for (auto &entry : filesystem::recursive_directory_iterator(from)) {
+        filesystem::path relative = entry.path().lexically_relative(from);
+        filesystem::path target = to / relative;
+        if (entry.is_directory())
+            filesystem::create_directories(target);
+        else if (relative == COMPRESSED_MANIFEST)
+            continue;
+        else if (!compressed.count(relative))
+            filesystem::copy_file(entry.path(), target);
+        else if (is_archive(relative.string()))
+            extract_archive(entry.path(), target.parent_path());
+        else  // 去掉压缩后缀，还原为选手程序打开的文件名
+            decompress_file(entry.path(), target.replace_extension(), compression_of(relative.string()));
+    }
+}
+
+/**
+ * @brief 下载一组标准测试数据到题目的缓存文件夹
+ * 每组测试数据单独加锁，不同测试数据可以同时下载，已经下载完成的测试数据直接返回
+ * @param submit 测试数据所属的提交
+ * @param testcase_id 测试数据在 submit.test_data 中的下标
+ * @param cancelled 预取时为提交的放弃标志，置位后中止下载，参见 test_data_prefetch
+ * @return 测试数据文件夹
+ */
+static filesystem::path fetch_standard_data(programming_submission &submit, int testcase_id, const atomic<bool> *cancelled = nullptr) {
+    filesystem::path datadir = CACHE_DIR / submit.category / submit.prob_id / "standard_data" / to_string(testcase_id);
+    filesystem::path fetched = datadir / ".fetched";
+    scoped_file_lock lock = lock_directory(datadir, false);
+    if (filesystem::exists(fetched)) return datadir;
+
+    filesystem::create_directories(datadir / "input");
+    filesystem::create_directories(datadir / "output");
+    // 同时下载这组测试数据的所有文件
+    auto &test_data = submit.test_data[testcase_id];
+    vector<pair<asset *, filesystem::path>> assets;
+    for (auto &asset : test_data.inputs)
+        assets.emplace_back(asset.get(), datadir / "input");
+    for (auto &asset : test_data.outputs)
+        assets.emplace_back(asset.get(), datadir / "output");
+    // 标准测试数据以只读方式挂载到沙箱中，可以直接硬链接 blob_store 中的文件
+    auto compressed = fetch_assets(assets, KEEP_COMPRESSED_DATA, true, cancelled);
+    if (!compressed.empty()) {
+        ofstream fout(datadir / COMPRESSED_MANIFEST);
+        for (auto &file : compressed)
+            fout << file.lexically_relative(datadir).string() << endl;
+    }
+
+    // 下载中断（如评测系统崩溃）时没有标记，下次使用时重新下载
+    ofstream fout(fetched);
+    return datadir;
+}
+
 /**
  * @brief 执行程序评测任务
  * @param client_task 当前评测任务信息
  * @param submit 当前评测任务归属的选手提交信息
  * @param task 当前评测任务数据点的信息
  * @param execcpuset 当前评测任务能允许运行在那些 cpu 核心上
- * @param result_queue 评测结果队列
+ * @param shard 如果是 GTest 评测任务的分片，只运行该分片负责的测试
  */
-static judge_task_result judge_impl(const message::client_task &client_task, programming_submission &submit, judge_task &task, const string &execcpuset) {
+static judge_task_result judge_impl(const message::client_task &client_task, programming_submission &submit, judge_task &task, const string &execcpuset, const gtest_shard *shard = nullptr) {
     string uuid = boost::lexical_cast<string>(boost::uuids::random_generator()());
     filesystem::path cachedir = CACHE_DIR / submit.category / submit.prob_id;               // 题目的缓存文件夹
     filesystem::path workdir = RUN_DIR / submit.category / submit.prob_id / submit.sub_id;  // 本提交的工作文件夹
@@ -47,12 +187,15 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
 
     auto &exec_mgr = submit.judge_server->get_executable_manager();
 
+    // 编译脚本、生成随机数据和运行比较器对运行时间不敏感，可以放在超线程兄弟核心上，参见 --smt-policy
+    string auxcpuset = auxiliary_cpuset(execcpuset);
+
     // <check-script> <std.in> <std.out> <timelimit> <chrootdir> <workdir> <run-id> <run-script> <compare-script>
     auto check_script = exec_mgr.get_check_script(task.check_script);
-    check_script->fetch(execcpuset, CHROOT_DIR);
+    check_script->fetch(auxcpuset, CHROOT_DIR);
 
     auto run_script = exec_mgr.get_run_script(task.run_script);
-    run_script->fetch(execcpuset, CHROOT_DIR);
+    run_script->fetch(auxcpuset, CHROOT_DIR);
 
     unique_ptr<judge::program> exec_compare_script = task.compare_script.empty() ? nullptr : exec_mgr.get_compare_script(task.compare_script);
     auto &compare_script = task.compare_script.empty() ? submit.compare : exec_compare_script;
@@ -62,7 +205,14 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
         return result;
     }
 
-    compare_script->fetch(execcpuset, cachedir / "compare", CHROOT_DIR);
+    compare_script->fetch(auxcpuset, cachedir / "compare", CHROOT_DIR);
+
+    // sanitizer 版本编译失败时 compile.sh 不会让整个编译失败，只有内存检查的测试点报错
+    if (task.run_script == "sanitizer" && !filesystem::exists(workdir / "compile" / "run.asan")) {
+        result.status = status::SYSTEM_ERROR;
+        result.error_log = read_file_content(workdir / "compile" / "compile-sanitizer.tmp", "Sanitizer build does not exist");
+        return result;
+    }
 
     filesystem::path datadir;
 
@@ -82,59 +232,58 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
             datadir = random_data_dir / to_string(task.testcase_id) / to_string(task.subcase_id);
         } else {
             // 创建一组随机数据
-            random_data_dir /= to_string(task.testcase_id);
-
-            scoped_file_lock lock = lock_directory(random_data_dir, false);
-            // 检查已经产生了多少组随机测试数据
-            int number = count_directories_in_directory(random_data_dir);
-            if (number < MAX_RANDOM_DATA_NUM) {  // 如果没有达到创建上限，则生成随机测试数据
-                datadir = random_data_dir / to_string(number);
-                scoped_file_lock case_lock = lock_directory(datadir, false);  // 随机目录的写入必须加锁
-                lock.release();
-
-                elapsed_time random_time;
-
-                filesystem::path errorpath = datadir / ".error";  // 文件存在表示该组测试数据生成失败
-                // 随机生成器和标准程序已经在编译阶段完成下载和编译
-                filesystem::path randomdir = cachedir / "random";
-                filesystem::path standarddir = cachedir / "standard";
-                task.subcase_id = number;  // 标记当前测试点使用了哪个随机测试点
-                // random_generator.sh <random_case> <random_gen> <std_program> <timelimit> <chrootdir> <datadir> <run> <std_program run_args...>
-                int ret = call_process(EXEC_DIR / "random_generator.sh", "-n", execcpuset, task.testcase_id, submit.random->get_run_path(randomdir), submit.standard->get_run_path(standarddir), task.time_limit, CHROOT_DIR, datadir, run_script->get_run_path(), task.run_args);
-                switch (ret) {
-                    case E_SUCCESS: {
-                        // 随机数据已经准备好
-                    } break;
-                    case E_RANDOM_GEN_ERROR: {
-                        // 随机数据生成器出错，返回 RANDOM_GEN_ERROR 并携带错误信息
-                        result.status = status::RANDOM_GEN_ERROR;
-                        result.error_log = read_file_content(datadir / "system.out", "No information");
-                        ofstream to_be_created(errorpath);  // 标记该组随机测试数据生成失败
-                        return result;
-                    } break;
-                    default: {  // INTERNAL_ERROR
-                        // 随机数据生成器出错，返回 SYSTEM_ERROR 并携带错误信息
-                        result.status = status::SYSTEM_ERROR;
-                        result.error_log = read_file_content(datadir / "system.out", "No information");
-                        ofstream to_be_created(errorpath);  // 标记该组随机测试数据生成失败
-                        return result;
-                    } break;
+            auto slots = get_random_data_slots(cachedir, task.testcase_id);
+            while (true) {
+                // 如果没有达到创建上限，则申请一个新的编号生成随机测试数据
+                int number = slots->claim();
+                if (number >= 0) {
+                    datadir = slots->slot_dir(number);
+                    task.subcase_id = number;  // 标记当前测试点使用了哪个随机测试点
+
+                    elapsed_time random_time;
+                    int ret;
+                    try {
+                        // 随机生成器和标准程序已经由内部编译任务完成下载和编译
+                        ret = generate_random_data(make_random_data_spec(submit, task), datadir, auxcpuset);
+                    } catch (...) {
+                        slots->release(number);
+                        throw;
+                    }
+                    slots->commit(number, ret == E_SUCCESS);  // 生成失败的编号将被标记为 FAILED
+                    switch (ret) {
+                        case E_SUCCESS: {
+                            // 随机数据已经准备好
+                        } break;
+                        case E_RANDOM_GEN_ERROR: {
+                            // 随机数据生成器出错，返回 RANDOM_GEN_ERROR 并携带错误信息
+                            result.status = status::RANDOM_GEN_ERROR;
+                            result.error_log = read_file_content(datadir / "system.out", "No information");
+                            return result;
+                        } break;
+                        default: {  // INTERNAL_ERROR
+                            // 随机数据生成器出错，返回 SYSTEM_ERROR 并携带错误信息
+                            result.status = status::SYSTEM_ERROR;
+                            result.error_log = read_file_content(datadir / "system.out", "No information");
+                            return result;
+                        } break;
+                    }
+
+                    LOG(INFO) << "Generated random data case [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "-" << number << "] in " << random_time.template duration<chrono::milliseconds>().count() << "ms";
+                    break;
                 }
 
-                LOG(INFO) << "Generated random data case [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "-" << number << "] in " << random_time.template duration<chrono::milliseconds>().count() << "ms";
-            } else {
-                int number = random(0, MAX_RANDOM_DATA_NUM - 1);
+                // 已经达到创建上限，从生成好的数据中随机选取，如果都在生成中则等待生成完成
+                bool failed;
+                number = slots->pick(failed);
+                if (number < 0) continue;  // 正在生成的编号都被放弃了，重新申请编号
                 task.subcase_id = number;  // 标记当前测试点使用了哪个随机测试
-                datadir = random_data_dir / to_string(number);
-                // 加锁：可能出现某个进程正在生成随机数据的情况，此时需要等待数据生成完成。
-                scoped_file_lock case_lock = lock_directory(datadir, false);
-                lock.release();
-                filesystem::path errorpath = datadir / ".error";  // 文件存在表示该组测试数据生成失败
-                if (filesystem::exists(errorpath)) {              // 该组测试数据生成失败则直接返回 RANDOM_GEN_ERROR
+                datadir = slots->slot_dir(number);
+                if (failed) {  // 该组测试数据生成失败则直接返回 RANDOM_GEN_ERROR
                     result.status = status::RANDOM_GEN_ERROR;
                     result.error_log = read_file_content(datadir / "system.out", "No information");
                     return result;
                 }
+                break;
             }
         }
     } else {
@@ -146,17 +295,8 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
             if (number < 0) LOG(FATAL) << "Unknown test case";
             datadir = standard_data_dir / to_string(number);
         } else if (task.testcase_id >= 0) {  // 使用对应的标准测试数据
-            datadir = standard_data_dir / to_string(task.testcase_id);
-            scoped_file_lock lock = lock_directory(standard_data_dir, false);
-            auto &test_data = submit.test_data[task.testcase_id];
-            if (!filesystem::exists(datadir)) {
-                filesystem::create_directories(datadir / "input");
-                filesystem::create_directories(datadir / "output");
-                for (auto &asset : test_data.inputs)
-                    asset->fetch(datadir / "input");
-                for (auto &asset : test_data.outputs)
-                    asset->fetch(datadir / "output");
-            }
+            // 一般已经由 distribute 预取，正在预取时只等待这一组测试数据
+            datadir = fetch_standard_data(submit, task.testcase_id);
         } else {  // 该数据点不需要测试数据
             datadir = standard_data_dir / "-1";
             // 创建一个空的数据文件夹提供给测试点使用
@@ -166,7 +306,11 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
         }
     }
 
-    if (USE_DATA_DIR) {  // 如果要拷贝测试数据，我们随机 UUID 并创建文件夹拷贝数据
+    if (filesystem::exists(datadir / COMPRESSED_MANIFEST)) {  // 压缩保存的测试数据只在评测期间解压到 DATA_DIR
+        filesystem::path newdir = DATA_DIR / uuid;
+        expand_data_dir(datadir, newdir);
+        datadir = newdir;
+    } else if (USE_DATA_DIR) {  // 如果要拷贝测试数据，我们随机 UUID 并创建文件夹拷贝数据
         filesystem::path newdir = DATA_DIR / uuid;
         filesystem::copy(datadir, newdir, filesystem::copy_options::recursive);
         datadir = newdir;
@@ -176,6 +320,18 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
     if (task.file_limit > 0) env["FILELIMIT"] = to_string(task.file_limit);
     if (task.memory_limit > 0) env["MEMLIMIT"] = to_string(task.memory_limit);
     if (task.proc_limit > 0) env["PROCLIMIT"] = to_string(task.proc_limit);
+    env["CACHEDIR"] = cachedir.string();  // 静态测试将每个源文件的分析结果缓存在题目的缓存文件夹中
+    // 标准运行脚本配合 diff 比较脚本时，由 runguard 边运行边比较，出现 Wrong Answer 时可以立即结束选手程序
+    // standard-trusted 总是使用标准运行脚本
+    if ((task.check_script == "standard-trusted" || (task.check_script == "standard" && task.run_script == "standard")) &&
+        (task.compare_script == "diff-all" || task.compare_script == "diff-ign-space"))
+        env["STREAM_COMPARE"] = task.compare_script;
+    if (task.timeline_interval > 0) env["TIMELINEINTERVAL"] = fmt::format("{}", max(task.timeline_interval, 1.0));
+    if (auxcpuset != execcpuset) env["COMPARECPUSET"] = auxcpuset;
+    if (shard) {  // check script 会将分片信息传给 GTest 程序
+        env["GTEST_TOTAL_SHARDS"] = to_string(shard->total);
+        env["GTEST_SHARD_INDEX"] = to_string(shard->index);
+    }
 
     optional<string> walltime;
     if (execcpuset.find(",") != string::npos || execcpuset.find("-") != string::npos)
@@ -248,7 +404,7 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
     }
 
     if (USE_DATA_DIR) {  // 评测结束后删除拷贝的评测数据
-        filesystem::remove(datadir);
+        filesystem::remove_all(datadir);
     }
 
     auto metadata = read_runguard_result(rundir / "program.meta");
@@ -256,6 +412,7 @@ static judge_task_result judge_impl(const message::client_task &client_task, pro
     result.data_dir = datadir;
     result.run_time = metadata.wall_time;  // TODO: 支持题目选择 cpu_time 或者 wall_time 进行时间
     result.memory_used = metadata.memory / 1024;
+    if (task.timeline_interval > 0) attach_timeline(result, rundir / "program.timeline");
     return result;
 }
 
@@ -280,54 +437,134 @@ static void compile(judge::program *program, const filesystem::path &workdir, co
 }
 
 /**
- * @brief 执行程序编译任务
+ * @brief 估计选手程序包含的 GTest 测试数量
+ * 统计选手程序源文件中 TEST、TEST_F、TEST_P 等宏的出现次数。参数化测试的实例数
+ * 无法从源代码得知，因此只是一个用于选择分片数的估计值
+ */
+static size_t count_gtest_cases(programming_submission &submit) {
+    static const regex test_macro(R"(\b(TEST|TEST_F|TEST_P|TYPED_TEST|TYPED_TEST_P)\s*\()");
+    filesystem::path compilepath = RUN_DIR / submit.category / submit.prob_id / submit.sub_id / "compile";
+    size_t count = 0;
+    auto count_file = [&](const asset_uptr &file) {
+        string content = read_file_content(compilepath / file->name, "");
+        count += distance(sregex_iterator(content.begin(), content.end(), test_macro), sregex_iterator());
+    };
+    for (auto &file : submit.submission->source_files) count_file(file);
+    for (auto &file : submit.submission->assist_files) count_file(file);
+    return count;
+}
+
+/**
+ * @brief 执行选手程序编译任务
+ * 题目级程序（随机数据生成器、标准程序、比较器）由独立的内部编译任务编译，参见 build
  * @param client_task 当前评测任务信息
  * @param submit 当前评测任务归属的选手提交信息
  * @param task 当前评测任务的编译信息
  * @param execcpuset 当前评测任务能允许运行在那些 cpu 核心上
- * @param result_queue 评测结果队列
  */
-static judge_task_result compile(const message::client_task &client_task, programming_submission &submit, judge_task &task, const string &execcpuset) {
-    filesystem::path cachedir = CACHE_DIR / submit.category / submit.prob_id;
-
+static judge_task_result compile(const message::client_task &client_task, programming_submission &submit, judge_task &, const string &execcpuset) {
     judge_task_result result{client_task.id};
 
     // 编译选手程序，submit.submission 都为非空，否则在 server.cpp 中的 fetch_submission 会阻止该提交的评测
     if (submit.submission) {
         filesystem::path workdir = RUN_DIR / submit.category / submit.prob_id / submit.sub_id;
-        compile(submit.submission.get(), workdir, execcpuset, result, false);
+        // sanitizer 内存检查需要额外编译一个启用 AddressSanitizer 的可执行文件（LeakSanitizer 包含在内）
+        auto code = dynamic_cast<source_code *>(submit.submission.get());
+        if (code && (code->language == "c" || code->language == "cpp")) {
+            for (auto &kase : submit.judge_tasks)
+                if (kase.run_script == "sanitizer") code->sanitize = "address";
+        }
+        compile(submit.submission.get(), workdir, auxiliary_cpuset(execcpuset), result, false);
         auto metadata = read_runguard_result(workdir / "compile" / "compile.meta");
         result.run_time = metadata.wall_time;
         result.memory_used = metadata.memory / 1024;
-        if (result.status != status::ACCEPTED) return result;
+
+        // 分发评测任务时需要持有 submit.mut，因此在编译任务中读取源文件统计 GTest 测试数
+        for (auto &kase : submit.judge_tasks)
+            if (kase.run_script == "gtest" && kase.compare_script == "gtest" && kase.shards == 0) {
+                submit.gtest_cases = count_gtest_cases(submit);
+                break;
+            }
+    } else {
+        result.status = status::ACCEPTED;
     }
+    return result;
+}
 
-    // 编译随机数据生成器
-    if (submit.random) {
-        filesystem::path randomdir = cachedir / "random";
-        compile(submit.random.get(), randomdir, execcpuset, result, true);
-        if (result.status == status::COMPILATION_ERROR)
-            result.status = status::EXECUTABLE_COMPILATION_ERROR;
-        if (result.status != status::ACCEPTED) return result;
+/**
+ * @brief 获得内部编译任务对应的程序
+ */
+static judge::program *get_artifact(programming_submission &submit, build_task::artifact_type artifact) {
+    switch (artifact) {
+        case build_task::artifact_type::RANDOM:
+            return submit.random.get();
+        case build_task::artifact_type::STANDARD:
+            return submit.standard.get();
+        case build_task::artifact_type::COMPARE:
+            return submit.compare.get();
     }
+    return nullptr;
+}
 
-    // 编译标准程序
-    if (submit.standard) {
-        filesystem::path standarddir = cachedir / "standard";
-        compile(submit.standard.get(), standarddir, execcpuset, result, true);
-        if (result.status == status::COMPILATION_ERROR)
-            result.status = status::EXECUTABLE_COMPILATION_ERROR;
-        if (result.status != status::ACCEPTED) return result;
+/**
+ * @brief 获得内部编译任务的显示名称，提供给监控系统
+ */
+static string get_artifact_name(build_task::artifact_type artifact) {
+    switch (artifact) {
+        case build_task::artifact_type::RANDOM:
+            return "Build random generator";
+        case build_task::artifact_type::STANDARD:
+            return "Build standard program";
+        case build_task::artifact_type::COMPARE:
+            return "Build compare program";
     }
+    return "Build";
+}
 
-    // 编译比较器
-    if (submit.compare) {
-        filesystem::path comparedir = cachedir / "compare";
-        compile(submit.compare.get(), comparedir, execcpuset, result, true);
-        if (result.status == status::COMPILATION_ERROR)
-            result.status = status::EXECUTABLE_COMPILATION_ERROR;
-        if (result.status != status::ACCEPTED) return result;
+/**
+ * @brief 获得内部编译任务对应程序在题目缓存文件夹中的存放路径
+ */
+static filesystem::path get_artifact_dir(programming_submission &submit, build_task::artifact_type artifact) {
+    filesystem::path cachedir = CACHE_DIR / submit.category / submit.prob_id;
+    switch (artifact) {
+        case build_task::artifact_type::RANDOM:
+            return cachedir / "random";
+        case build_task::artifact_type::STANDARD:
+            return cachedir / "standard";
+        case build_task::artifact_type::COMPARE:
+            return cachedir / "compare";
     }
+    return cachedir;
+}
+
+/**
+ * @brief 判断评测任务是否需要使用某个题目级程序
+ * 随机测试需要随机数据生成器和标准程序生成数据，没有指定比较脚本的测试需要题目的比较器
+ */
+static bool requires_artifact(const judge_task &task, build_task::artifact_type artifact) {
+    if (task.check_script == "compile") return false;
+    switch (artifact) {
+        case build_task::artifact_type::RANDOM:
+        case build_task::artifact_type::STANDARD:
+            return task.is_random;
+        case build_task::artifact_type::COMPARE:
+            return task.compare_script.empty();
+    }
+    return false;
+}
+
+/**
+ * @brief 执行题目级程序的内部编译任务
+ * @param client_task 当前编译任务信息
+ * @param submit 编译任务归属的选手提交信息
+ * @param build 要执行的编译任务
+ * @param execcpuset 编译任务能允许运行在那些 cpu 核心上
+ */
+static judge_task_result build(const message::client_task &client_task, programming_submission &submit, build_task &build, const string &execcpuset) {
+    judge_task_result result{client_task.id};
+    compile(get_artifact(submit, build.artifact), get_artifact_dir(submit, build.artifact), auxiliary_cpuset(execcpuset), result, true);
+    if (result.status == status::COMPILATION_ERROR)
+        result.status = status::EXECUTABLE_COMPILATION_ERROR;
     return result;
 }
 
@@ -361,7 +598,10 @@ static void verify_timeliness(programming_submission &submit) {
         if (submit.updated_at > modified_time) {
             // 清理文件夹，因为如果删除该文件夹前必须释放锁，如果有两个提交一起竞争
             // 该文件夹，会导致删除该文件夹两次，可能导致已经下载的部分文件丢失。
+            // blob_store 中的文件仍然保留，重新获取远程文件时没有修改的文件不会重新下载。
             for (auto &subitem : filesystem::directory_iterator(cachedir)) {
+                // 保留锁文件，否则后来者会锁在新建的锁文件上，无法和正在清理的提交互斥
+                if (subitem.path().filename() == ".lock") continue;
                 try {
                     filesystem::remove_all(subitem.path());
                 } catch (std::exception &e) {
@@ -372,6 +612,9 @@ static void verify_timeliness(programming_submission &submit) {
             {
                 ofstream fout(time_file);
             }
+
+            // 随机测试数据已经被清空，丢弃内存中的编号索引
+            invalidate_random_data_slots(cachedir);
         }
     }
 
@@ -379,25 +622,77 @@ static void verify_timeliness(programming_submission &submit) {
     judge::last_write_time(time_file, submit.updated_at);
 }
 
+/**
+ * @brief 获得评测任务的所有依赖，包括 depends_on 和 dependencies
+ */
+static vector<judge_task::dependency> get_dependencies(const judge_task &task) {
+    vector<judge_task::dependency> dependencies;
+    if (task.depends_on >= 0) dependencies.push_back({task.depends_on, task.depends_cond});
+    dependencies.insert(dependencies.end(), task.dependencies.begin(), task.dependencies.end());
+    return dependencies;
+}
+
+/**
+ * @brief 根据每个评测任务的依赖构建依赖图，并检查依赖图是否为有向无环图
+ * 构建完成后 submit.children 为每个评测任务的子任务列表，submit.unfinished_parents 为每个评测任务的入度
+ * @return true 若所有依赖都合法且不存在环
+ */
+static bool build_dependency_graph(programming_submission &submit) {
+    size_t n = submit.judge_tasks.size();
+    submit.children.assign(n, {});
+    submit.unfinished_parents.assign(n, 0);
+    for (size_t i = 0; i < n; ++i) {
+        for (auto &dep : get_dependencies(submit.judge_tasks[i])) {
+            if (dep.task < 0 || dep.task >= (int)n || dep.task == (int)i) {
+                LOG(WARNING) << "Submission from [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "] has invalid dependency " << dep.task << " of task " << i;
+                return false;
+            }
+            submit.children[dep.task].push_back({(int)i, dep.condition});
+            ++submit.unfinished_parents[i];
+        }
+    }
+
+    // 拓扑排序，如果有评测任务无法被排序，说明依赖图中存在环
+    vector<size_t> degree = submit.unfinished_parents;
+    vector<size_t> ready;
+    for (size_t i = 0; i < n; ++i)
+        if (degree[i] == 0) ready.push_back(i);
+    if (n > 0 && ready.empty()) {
+        LOG(WARNING) << "Submission from [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "] does not have entry test task.";
+        return false;
+    }
+
+    size_t sorted = 0;
+    while (!ready.empty()) {
+        size_t u = ready.back();
+        ready.pop_back();
+        ++sorted;
+        for (auto &edge : submit.children[u])
+            if (--degree[edge.task] == 0) ready.push_back(edge.task);
+    }
+
+    if (sorted < n) {
+        LOG(WARNING) << "Submission from [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "] contains circular dependency.";
+        return false;
+    }
+    return true;
+}
+
 bool programming_judger::verify(submission &submit) const {
     auto sub = dynamic_cast<programming_submission *>(&submit);
     if (!sub) return false;
     LOG(INFO) << "Judging submission [" << sub->category << "-" << sub->prob_id << "-" << sub->sub_id << "]";
 
+    if (!build_dependency_graph(*sub)) return false;
+
     // 检查 judge_server 获取的 sub 是否包含编译任务，且确保至多一个编译任务
     bool has_compile_case = false;
     for (size_t i = 0; i < sub->judge_tasks.size(); ++i) {
         auto &judge_task = sub->judge_tasks[i];
-
-        if (judge_task.depends_on >= (int)i) {  // 如果每个任务都只依赖前面的任务，那么这个图将是森林，确保不会出现环
-            LOG(WARNING) << "Submission from [" << sub->category << "-" << sub->prob_id << "-" << sub->sub_id << "] may contains circular dependency.";
-            return false;
-        }
-
         if (judge_task.check_script == "compile") {
             if (!has_compile_case) {
                 has_compile_case = true;
-                if (judge_task.depends_on >= 0) {
+                if (sub->unfinished_parents[i] > 0) {
                     LOG(WARNING) << "Submission from [" << sub->category << "-" << sub->prob_id << "-" << sub->sub_id << "] has non-independent compilation task.";
                     return false;
                 }
@@ -410,20 +705,6 @@ bool programming_judger::verify(submission &submit) const {
 
     if (!sub->submission) return false;
 
-    // 检查是否存在可以直接评测的测试点，如果不存在则直接返回
-    bool sent_testcase = false;
-    for (size_t i = 0; i < sub->judge_tasks.size(); ++i)
-        if (sub->judge_tasks[i].depends_on < 0) {
-            sent_testcase = true;
-            break;
-        }
-
-    if (!sent_testcase) {
-        // 如果不存在评测任务，直接返回
-        LOG(WARNING) << "Submission from [" << sub->category << "-" << sub->prob_id << "-" << sub->sub_id << "] does not have entry test task.";
-        return false;
-    }
-
     verify_timeliness(*sub);
 
     filesystem::path workdir = RUN_DIR / submit.category / submit.prob_id / submit.sub_id;
@@ -432,6 +713,140 @@ bool programming_judger::verify(submission &submit) const {
     return true;
 }
 
+// 每个分片至少包含的测试数，测试太少时每个分片启动沙箱的开销会超过并行带来的收益
+static constexpr size_t GTEST_CASES_PER_SHARD = 8;
+
+/**
+ * @brief 选择 GTest 评测任务的分片数
+ * @return 分片数，为 1 时不拆分
+ */
+static size_t choose_gtest_shards(const programming_submission &submit, const judge_task &kase) {
+    if (kase.run_script != "gtest" || kase.compare_script != "gtest") return 1;
+    if (kase.shards > 0) return kase.shards;
+    size_t by_cases = submit.gtest_cases / GTEST_CASES_PER_SHARD;
+    size_t by_cores = idle_worker_count() + 1;  // 分发评测任务的 worker 完成当前任务后也可以评测分片
+    return max<size_t>(1, min(by_cases, by_cores));
+}
+
+/**
+ * @brief 分发一个依赖条件已经满足的评测任务
+ * 如果评测任务需要的题目级程序还在编译，则暂存到 blocked_tasks 中，等待编译完成后再分发。
+ * 调用方需要持有 submit.mut
+ * @param id 评测任务在 submit.judge_tasks 中的下标
+ * @return 如果需要的题目级程序编译失败，则返回该评测任务继承的编译结果，调用方需要通过 process 统计该结果
+ */
+static optional<judge_task_result> dispatch(concurrent_queue<message::client_task> &task_queue, programming_submission &submit, size_t id) {
+    judge_task &kase = submit.judge_tasks[id];
+    for (auto &build : submit.build_tasks) {
+        if (!requires_artifact(kase, build.artifact)) continue;
+        if (build.result.status == status::PENDING) {
+            submit.blocked_tasks.push_back(id);
+            return nullopt;
+        } else if (build.result.status != status::ACCEPTED) {
+            judge_task_result result{id};
+            result.status = build.result.status;
+            result.error_log = build.result.error_log;
+            return result;
+        }
+    }
+
+    if (size_t shards = choose_gtest_shards(submit, kase); shards > 1) {
+        for (size_t i = 0; i < shards; ++i) {
+            gtest_shard shard;
+            shard.task = id;
+            shard.index = i;
+            shard.total = shards;
+            shard.result.status = status::PENDING;
+            shard.result.id = submit.judge_tasks.size() + submit.build_tasks.size() + submit.gtest_shards.size();
+            submit.gtest_shards.push_back(shard);
+
+            judge::message::client_task client_task = {
+                .submit = &submit,
+                .id = shard.result.id,
+                .name = kase.name + " #" + to_string(i),
+                .cores = kase.cores};
+            task_queue.push(client_task);
+        }
+        return nullopt;
+    }
+
+    judge::message::client_task client_task = {
+        .submit = &submit,
+        .id = id,
+        .name = kase.name,
+        .cores = kase.cores};
+    task_queue.push(client_task);
+    return nullopt;
+}
+
+template <typename DurationT>
+void process(const programming_judger &judger, concurrent_queue<message::client_task> &testcase_queue, programming_submission &submit, const judge_task_result &result, DurationT dur);
+
+test_data_prefetch::~test_data_prefetch() {
+    unique_lock<mutex> lock(shared->mut);
+    shared->cancelled = true;
+    shared->cv.wait(lock, [this] { return shared->running == 0; });
+}
+
+void test_data_prefetch::cancel() {
+    shared->cancelled = true;
+}
+
+const atomic<bool> &test_data_prefetch::cancelled() const {
+    return shared->cancelled;
+}
+
+void test_data_prefetch::submit(thread_pool &pool, function<void()> task) {
+    pool.submit([state = shared, task = move(task)] {
+        {
+            scoped_lock lock(state->mut);
+            if (state->cancelled) return;
+            ++state->running;
+        }
+        defer {
+            scoped_lock lock(state->mut);
+            --state->running;
+            state->cv.notify_all();
+        };
+        task();
+    });
+}
+
+/**
+ * @brief 预取标准测试数据的后台 IO 线程池，参见 PREFETCH_THREADS
+ * 分发提交时还不知道测试点会由哪个 NUMA 节点的 worker 评测，预取的测试数据的页缓存分布在所有节点上；
+ * 评测时拷贝到 DATA_DIR 的测试数据仍然由 worker 写入本节点
+ */
+static thread_pool &prefetch_pool() {
+    static thread_pool pool(PREFETCH_THREADS, interleave_numa_nodes);
+    return pool;
+}
+
+/**
+ * @brief 在后台下载提交用到的所有标准测试数据，和编译同时进行
+ * 按测试点的顺序提交预取任务，靠前的测试点需要的测试数据先下载。
+ * 预取失败只记录日志，测试点评测时会重新下载并报告错误
+ */
+static void prefetch_standard_data(programming_submission &submit) {
+    if (PREFETCH_THREADS <= 0) return;
+    set<int> scheduled;
+    for (auto &task : submit.judge_tasks) {
+        int testcase_id = task.testcase_id;
+        if (task.is_random || testcase_id < 0 || testcase_id >= (int)submit.test_data.size()) continue;
+        if (!scheduled.insert(testcase_id).second) continue;
+
+        submit.prefetch.submit(prefetch_pool(), [&submit, testcase_id] {
+            auto &cancelled = submit.prefetch.cancelled();
+            try {
+                fetch_standard_data(submit, testcase_id, &cancelled);
+            } catch (exception &e) {
+                // 放弃预取导致的下载失败不是错误
+                if (!cancelled) LOG(WARNING) << "Unable to prefetch test data " << testcase_id << " of submission [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "]: " << e.what();
+            }
+        });
+    }
+}
+
 bool programming_judger::distribute(concurrent_queue<message::client_task> &task_queue, submission &submit) const {
     auto &sub = dynamic_cast<programming_submission &>(submit);
 
@@ -442,15 +857,34 @@ bool programming_judger::distribute(concurrent_queue<message::client_task> &task
         sub.results[i].id = i;
     }
 
+    // 编译期间评测核心不需要等待网络，先开始下载测试数据
+    prefetch_standard_data(sub);
+
+    // 题目级程序的编译不依赖任何任务，优先分发以便空闲的核心并行编译
+    for (auto artifact : {build_task::artifact_type::RANDOM, build_task::artifact_type::STANDARD, build_task::artifact_type::COMPARE}) {
+        if (!get_artifact(sub, artifact)) continue;
+        build_task build;
+        build.artifact = artifact;
+        build.result.status = judge::status::PENDING;
+        build.result.id = sub.judge_tasks.size() + sub.build_tasks.size();
+        sub.build_tasks.push_back(build);
+    }
+
+    scoped_lock guard(sub.mut);
+    for (auto &build : sub.build_tasks) {
+        judge::message::client_task client_task = {
+            .submit = &submit,
+            .id = build.result.id,
+            .name = get_artifact_name(build.artifact),
+            .cores = 1};
+        task_queue.push(client_task);
+    }
+
     // 寻找没有依赖的评测点，并发送评测消息
     for (size_t i = 0; i < sub.judge_tasks.size(); ++i) {
-        if (sub.judge_tasks[i].depends_on < 0) {  // 不依赖任何任务的任务可以直接开始评测
-            judge::message::client_task client_task = {
-                .submit = &submit,
-                .id = i,
-                .name = sub.judge_tasks[i].name,
-                .cores = sub.judge_tasks[i].cores};
-            task_queue.push(client_task);
+        if (sub.unfinished_parents[i] == 0) {  // 不依赖任何任务的任务可以直接开始评测
+            if (auto result = dispatch(task_queue, sub, i))
+                process(*this, task_queue, sub, *result, chrono::milliseconds());
         }
     }
     return true;
@@ -469,70 +903,86 @@ static void summarize(programming_submission &submit) {
     }
 }
 
+/**
+ * @brief 判断评测结果是否满足依赖条件
+ */
+static bool is_satisfied(judge_task::dependency_condition condition, status result) {
+    switch (condition) {
+        case judge_task::dependency_condition::ACCEPTED:
+            return result == status::ACCEPTED;
+        case judge_task::dependency_condition::PARTIAL_CORRECT:
+            return result == status::PARTIAL_CORRECT ||
+                   result == status::ACCEPTED;
+        case judge_task::dependency_condition::NON_TIME_LIMIT:
+            return result != status::SYSTEM_ERROR &&
+                   result != status::COMPARE_ERROR &&
+                   result != status::COMPILATION_ERROR &&
+                   result != status::DEPENDENCY_NOT_SATISFIED &&
+                   result != status::TIME_LIMIT_EXCEEDED &&
+                   result != status::EXECUTABLE_COMPILATION_ERROR &&
+                   result != status::OUT_OF_CONTEST_TIME &&
+                   result != status::RANDOM_GEN_ERROR;
+    }
+    return false;
+}
+
 /**
  * @brief 完成评测结果的统计，如果统计的是编译任务，则会分发具体的评测任务
  * 在评测完成后，通过调用 process 函数来完成数据点的统计，如果发现评测完了一个提交，则立刻返回。
  * 因此大部分情况下评测队列不会过长：只会拉取适量的评测，确保评测队列不会过长。
  * 
+ * 评测结果沿着依赖图的边传播：子任务的所有父任务都满足依赖条件后分发子任务，
+ * 任意一个父任务不满足依赖条件时子任务立即以 DEPENDENCY_NOT_SATISFIED 结束，
+ * 并继续传播给子任务的子任务。传播使用工作栈迭代完成，每条边只会被访问一次。
+ * 
  * @param result 评测结果
  */
 template <typename DurationT>
 void process(const programming_judger &judger, concurrent_queue<message::client_task> &testcase_queue, programming_submission &submit, const judge_task_result &result, DurationT dur) {
-    // 记录测试信息
-    submit.results[result.id] = result;
-
-    DLOG(INFO) << "Testcase [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "-" << result.id
-               << ", type: " << (int)submit.judge_tasks[result.id].check_type
-               << ", status: " << get_display_message(result.status) << ", runtime: " << result.run_time
-               << ", memory: " << result.memory_used << ", run_dir: " << result.run_dir
-               << ", data_dir: " << result.data_dir << "] in " << chrono::duration_cast<chrono::milliseconds>(dur).count() << "ms";
-    if (result.status == status::SYSTEM_ERROR)
-        LOG(ERROR) << "Testcase [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "-" << result.id << "]: error: " << result.error_log;
-
-    for (size_t i = 0; i < submit.judge_tasks.size(); ++i) {
-        judge_task &kase = submit.judge_tasks[i];
-        // 寻找依赖当前评测点的评测点
-        if (kase.depends_on == (int)result.id) {
-            bool satisfied;
-            switch (kase.depends_cond) {
-                case judge_task::dependency_condition::ACCEPTED:
-                    satisfied = result.status == status::ACCEPTED;
-                    break;
-                case judge_task::dependency_condition::PARTIAL_CORRECT:
-                    satisfied = result.status == status::PARTIAL_CORRECT ||
-                                result.status == status::ACCEPTED;
-                    break;
-                case judge_task::dependency_condition::NON_TIME_LIMIT:
-                    satisfied = result.status != status::SYSTEM_ERROR &&
-                                result.status != status::COMPARE_ERROR &&
-                                result.status != status::COMPILATION_ERROR &&
-                                result.status != status::DEPENDENCY_NOT_SATISFIED &&
-                                result.status != status::TIME_LIMIT_EXCEEDED &&
-                                result.status != status::EXECUTABLE_COMPILATION_ERROR &&
-                                result.status != status::OUT_OF_CONTEST_TIME &&
-                                result.status != status::RANDOM_GEN_ERROR;
-                    break;
-            }
-
-            if (satisfied) {
-                judge::message::client_task client_task = {
-                    .submit = &submit,
-                    .id = i,
-                    .name = kase.name,
-                    .cores = kase.cores};
-                testcase_queue.push(client_task);
+    vector<judge_task_result> finished_results = {result};
+    while (!finished_results.empty()) {
+        judge_task_result current = move(finished_results.back());
+        finished_results.pop_back();
+
+        // 记录测试信息
+        submit.results[current.id] = current;
+
+        DLOG(INFO) << "Testcase [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "-" << current.id
+                   << ", type: " << (int)submit.judge_tasks[current.id].check_type
+                   << ", status: " << get_display_message(current.status) << ", runtime: " << current.run_time
+                   << ", memory: " << current.memory_used << ", run_dir: " << current.run_dir
+                   << ", data_dir: " << current.data_dir << "] in " << chrono::duration_cast<chrono::milliseconds>(dur).count() << "ms";
+        if (current.status == status::SYSTEM_ERROR)
+            LOG(ERROR) << "Testcase [" << submit.category << "-" << submit.prob_id << "-" << submit.sub_id << "-" << current.id << "]: error: " << current.error_log;
+        dur = DurationT();
+
+        for (auto &edge : submit.children[current.id]) {
+            // 子任务已经因为其他父任务不满足依赖条件而结束
+            if (submit.results[edge.task].status != status::PENDING) continue;
+
+            if (is_satisfied(edge.condition, current.status)) {
+                if (--submit.unfinished_parents[edge.task] == 0) {
+                    if (auto next_result = dispatch(testcase_queue, submit, edge.task))
+                        finished_results.push_back(*next_result);
+                }
             } else {
-                judge_task_result next_result = result;
+                judge_task_result next_result = current;
                 next_result.status = status::DEPENDENCY_NOT_SATISFIED;
-                next_result.id = i;
-                process(judger, testcase_queue, submit, next_result, DurationT());
+                next_result.id = edge.task;
+                submit.results[edge.task].status = status::DEPENDENCY_NOT_SATISFIED;  // 避免其他父任务再次处理该子任务
+                finished_results.push_back(next_result);
             }
         }
+
+        ++submit.finished;
     }
 
-    size_t finished = ++submit.finished;
+    size_t finished = submit.finished;
     // 如果当前提交的所有测试点都完成测试，则返回评测结果
     if (finished == submit.judge_tasks.size()) {
+        // 还有题目级程序在编译时不能结束提交，由最后完成的编译任务负责结束提交
+        if (submit.build_finished < submit.build_tasks.size()) return;
+        submit.prefetch.cancel();
         summarize(submit);
         judger.fire_judge_finished(submit);
         return;  // 跳过本次评测过程
@@ -545,8 +995,185 @@ void process(const programming_judger &judger, concurrent_queue<message::client_
     }
 }
 
+void programming_judger::schedule_random_data(programming_submission &submit) const {
+    // 随机数据生成器和标准程序都编译完成后才能开始生成随机测试数据
+    size_t ready = 0;
+    for (auto &build : submit.build_tasks)
+        if (build.artifact != build_task::artifact_type::COMPARE && build.result.status == status::ACCEPTED)
+            ++ready;
+    if (ready < 2) return;
+
+    for (auto &task : submit.judge_tasks) {
+        // 依赖随机测试的随机测试复用父测试的数据，不需要单独生成
+        bool reuses_father = task.depends_on >= 0 && submit.judge_tasks[task.depends_on].is_random;
+        if (task.is_random && task.testcase_id >= 0 && !reuses_father)
+            random_data.schedule(make_random_data_spec(submit, task));
+    }
+}
+
+bool programming_judger::run_background_task(const string &execcpuset) const {
+    if (random_data.run(auxiliary_cpuset(execcpuset))) return true;
+    // 没有随机数据需要生成时回收 blob_store 中不再使用的文件，每小时最多一次，
+    // 题目更新后清空缓存的文件保留一天，供重新获取时发送条件请求
+    return blob_store::global().collect(chrono::hours(1), chrono::hours(24));
+}
+
+void programming_judger::judge_build(const message::client_task &client_task, concurrent_queue<message::client_task> &task_queue, const string &execcpuset) const {
+    auto submit = dynamic_cast<programming_submission *>(client_task.submit);
+    build_task &task = submit->build_tasks[client_task.id - submit->judge_tasks.size()];
+    judge_task_result result;
+
+    auto begin = chrono::system_clock::now();
+
+    try {
+        result = build(client_task, *submit, task, execcpuset);
+    } catch (exception &ex) {
+        result = {client_task.id};
+        result.status = status::SYSTEM_ERROR;
+        result.error_log = ex.what();
+    }
+
+    auto end = chrono::system_clock::now();
+
+    scoped_lock guard(submit->mut);
+    task.result = result;
+    size_t build_finished = ++submit->build_finished;
+
+    DLOG(INFO) << "Build [" << submit->category << "-" << submit->prob_id << "-" << submit->sub_id << "-" << client_task.name
+               << ", status: " << get_display_message(result.status) << "] in " << chrono::duration_cast<chrono::milliseconds>(end - begin).count() << "ms";
+    if (result.status != status::ACCEPTED)
+        LOG(ERROR) << "Build [" << submit->category << "-" << submit->prob_id << "-" << submit->sub_id << "-" << client_task.name << "]: error: " << result.error_log;
+
+    if (result.status == status::ACCEPTED && task.artifact != build_task::artifact_type::COMPARE)
+        schedule_random_data(*submit);
+
+    if (submit->finished == submit->judge_tasks.size()) {
+        // 所有评测任务都已经结束，此时不会有评测任务等待编译结果
+        if (build_finished == submit->build_tasks.size()) {
+            submit->prefetch.cancel();
+            summarize(*submit);
+            fire_judge_finished(*submit);
+        }
+        return;
+    }
+
+    // 重新分发等待题目级程序的评测任务，仍然缺少程序的评测任务会重新进入 blocked_tasks
+    vector<size_t> blocked_tasks;
+    swap(blocked_tasks, submit->blocked_tasks);
+    for (size_t id : blocked_tasks)
+        if (auto next_result = dispatch(task_queue, *submit, id))
+            process(*this, task_queue, *submit, *next_result, chrono::milliseconds());
+}
+
+/**
+ * @brief 合并 GTest 评测任务所有分片的评测结果
+ * 各分片报告的测试数量相加、失败测试列表拼接，得到和不拆分时格式相同的报告，
+ * 报告格式参见 exec/compare/gtest/run。有分片超时、运行出错时，以该分片的结果作为评测结果
+ * @param id 评测任务在 judge_tasks 中的下标
+ */
+static judge_task_result merge_gtest_shards(programming_submission &submit, size_t id) {
+    judge_task_result merged{id};
+    optional<judge_task_result> abnormal;
+    json report = {{"total_cases", 0}, {"pass_cases", 0}, {"error_cases", 0}, {"disabled_cases", 0}, {"report", json::array()}, {"type", "gtest"}};
+    double time = 0;
+
+    for (auto &shard : submit.gtest_shards) {
+        if (shard.task != id) continue;
+        auto &result = shard.result;
+        merged.run_time = max(merged.run_time, result.run_time);
+        merged.memory_used = max(merged.memory_used, result.memory_used);
+        if (merged.run_dir.empty()) {
+            merged.run_dir = result.run_dir;
+            merged.data_dir = result.data_dir;
+            merged.error_log = result.error_log;
+        }
+
+        if (result.status != status::ACCEPTED && result.status != status::WRONG_ANSWER && result.status != status::PARTIAL_CORRECT) {
+            if (!abnormal) abnormal = result;
+            continue;
+        }
+
+        try {
+            json shard_report = json::parse(result.report);
+            for (const char *key : {"total_cases", "pass_cases", "error_cases", "disabled_cases"})
+                report[key] = report[key].get<int>() + shard_report.at(key).get<int>();
+            time = max(time, stod(shard_report.at("time").get<string>()));  // 分片并行运行，取最慢的分片
+            for (auto &failure : shard_report.at("report"))
+                if (report["report"].size() < 10) report["report"].push_back(failure);  // 和比较脚本一样最多保留 10 个失败的测试
+        } catch (exception &) {
+            // 分片没有生成报告时比较脚本返回 WRONG_ANSWER，此时无法合并
+            if (!abnormal) abnormal = result;
+        }
+    }
+
+    if (abnormal) {
+        abnormal->id = id;
+        abnormal->run_time = merged.run_time;
+        abnormal->memory_used = merged.memory_used;
+        return *abnormal;
+    }
+
+    int pass_cases = report["pass_cases"], total_cases = report["total_cases"];
+    report["time"] = fmt::format("{}", time);
+    merged.report = report.dump(4);
+    if (report["error_cases"].get<int>() == 0) {
+        merged.status = status::ACCEPTED;
+        merged.score = 1;
+    } else if (pass_cases == 0) {
+        merged.status = status::WRONG_ANSWER;
+    } else {
+        merged.status = status::PARTIAL_CORRECT;
+        merged.score = {pass_cases, total_cases};
+    }
+    return merged;
+}
+
+void programming_judger::judge_shard(const message::client_task &client_task, concurrent_queue<message::client_task> &task_queue, const string &execcpuset) const {
+    auto submit = dynamic_cast<programming_submission *>(client_task.submit);
+    size_t shard_id = client_task.id - submit->judge_tasks.size() - submit->build_tasks.size();
+    gtest_shard shard;
+    {
+        // 分发其他 GTest 评测任务时 gtest_shards 可能扩容，因此在锁内复制一份
+        scoped_lock guard(submit->mut);
+        shard = submit->gtest_shards[shard_id];
+    }
+    judge_task_result result;
+
+    auto begin = chrono::system_clock::now();
+
+    try {
+        result = judge_impl(client_task, *submit, submit->judge_tasks[shard.task], execcpuset, &shard);
+    } catch (exception &ex) {
+        result = {client_task.id};
+        result.status = status::SYSTEM_ERROR;
+        result.error_log = ex.what();
+    }
+
+    auto end = chrono::system_clock::now();
+
+    scoped_lock guard(submit->mut);
+    submit->gtest_shards[shard_id].result = result;
+
+    DLOG(INFO) << "Shard [" << submit->category << "-" << submit->prob_id << "-" << submit->sub_id << "-" << shard.task << ", shard: " << shard.index << "/" << shard.total
+               << ", status: " << get_display_message(result.status) << "] in " << chrono::duration_cast<chrono::milliseconds>(end - begin).count() << "ms";
+
+    // 最后完成的分片负责合并报告
+    for (auto &other : submit->gtest_shards)
+        if (other.task == shard.task && other.result.status == status::PENDING)
+            return;
+    process(*this, task_queue, *submit, merge_gtest_shards(*submit, shard.task), end - begin);
+}
+
 void programming_judger::judge(const message::client_task &client_task, concurrent_queue<message::client_task> &task_queue, const string &execcpuset) const {
     auto submit = dynamic_cast<programming_submission *>(client_task.submit);
+    if (client_task.id >= submit->judge_tasks.size() + submit->build_tasks.size()) {
+        judge_shard(client_task, task_queue, execcpuset);
+        return;
+    } else if (client_task.id >= submit->judge_tasks.size()) {
+        judge_build(client_task, task_queue, execcpuset);
+        return;
+    }
+
     judge_task &task = submit->judge_tasks[client_task.id];
     judge_task_result result;
 
@@ -565,6 +1192,10 @@ void programming_judger::judge(const message::client_task &client_task, concurre
 
     auto end = chrono::system_clock::now();
 
+    // 编译失败时所有评测任务都不满足依赖条件，不再需要下载测试数据
+    if (task.check_script == "compile" && result.status != status::ACCEPTED)
+        submit->prefetch.cancel();
+
     scoped_lock guard(submit->mut);
     process(*this, task_queue, *submit, result, end - begin);
 }
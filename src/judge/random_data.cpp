@@ -0,0 +1,218 @@
+#include "judge/random_data.hpp"
+#include <glog/logging.h>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+#include "common/io_utils.hpp"
+#include "common/stl_utils.hpp"
+#include "common/utils.hpp"
+#include "config.hpp"
+
+namespace judge {
+using namespace std;
+
+filesystem::path random_data_spec::random_data_dir() const {
+    return cachedir / "random_data" / to_string(testcase_id);
+}
+
+random_data_slots::random_data_slots(const filesystem::path &dir) : dir(dir) {
+    filesystem::create_directories(dir);
+    filesystem::path index_file = dir / ".slots";
+    if (filesystem::exists(index_file)) {
+        string index = read_file_content(index_file);
+        states.resize(index.size(), slot_state::FREE);
+        for (size_t i = 0; i < index.size(); ++i) {
+            switch ((slot_state)index[i]) {
+                case slot_state::READY:
+                    states[i] = slot_state::READY;
+                    ready_slots.push_back(i);
+                    ++used;
+                    break;
+                case slot_state::FAILED:
+                    states[i] = slot_state::FAILED;
+                    failed_slots.push_back(i);
+                    ++used;
+                    break;
+                default:  // 上次生成到一半时进程退出，数据不完整，回收该编号
+                    filesystem::remove_all(slot_dir(i));
+                    free_slots.push_back(i);
+                    break;
+            }
+        }
+    } else {
+        // 没有索引文件时无法判断已有的数据是否完整，清空后重新生成
+        for (auto &subitem : filesystem::directory_iterator(dir))
+            if (subitem.is_directory())
+                filesystem::remove_all(subitem.path());
+    }
+    save();
+}
+
+int random_data_slots::claim() {
+    scoped_lock guard(mut);
+    if (used >= (size_t)MAX_RANDOM_DATA_NUM) return -1;
+
+    int slot;
+    if (!free_slots.empty()) {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    } else {
+        slot = states.size();
+        states.push_back(slot_state::FREE);
+    }
+    states[slot] = slot_state::GENERATING;
+    ++used, ++generating;
+    save();
+
+    // 回收的编号可能残留上一次生成的数据
+    filesystem::remove_all(slot_dir(slot));
+    filesystem::create_directories(slot_dir(slot));
+    return slot;
+}
+
+void random_data_slots::commit(int slot, bool success) {
+    {
+        scoped_lock guard(mut);
+        states[slot] = success ? slot_state::READY : slot_state::FAILED;
+        (success ? ready_slots : failed_slots).push_back(slot);
+        --generating;
+        save();
+    }
+    settled.notify_all();
+}
+
+void random_data_slots::release(int slot) {
+    {
+        scoped_lock guard(mut);
+        states[slot] = slot_state::FREE;
+        free_slots.push_back(slot);
+        --used, --generating;
+        save();
+    }
+    settled.notify_all();
+}
+
+int random_data_slots::pick(bool &failed) {
+    unique_lock lock(mut);
+    settled.wait(lock, [this] { return !ready_slots.empty() || !failed_slots.empty() || generating == 0; });
+    if (!ready_slots.empty()) {
+        failed = false;
+        return ready_slots[random(0, ready_slots.size() - 1)];
+    } else if (!failed_slots.empty()) {
+        failed = true;
+        return failed_slots[random(0, failed_slots.size() - 1)];
+    } else {
+        return -1;
+    }
+}
+
+filesystem::path random_data_slots::slot_dir(int slot) const {
+    return dir / to_string(slot);
+}
+
+void random_data_slots::save() {
+    string index(states.size(), (char)slot_state::FREE);
+    for (size_t i = 0; i < states.size(); ++i)
+        index[i] = (char)states[i];
+
+    // 先写临时文件再重命名，避免进程退出时留下不完整的索引文件
+    filesystem::path index_file = dir / ".slots";
+    filesystem::path temp_file = dir / ".slots.tmp";
+    {
+        ofstream fout(temp_file);
+        fout << index;
+    }
+    filesystem::rename(temp_file, index_file);
+}
+
+static mutex slots_mutex;
+// 键为题目的缓存文件夹，值为每组随机测试的编号索引
+static unordered_map<string, map<int, shared_ptr<random_data_slots>>> slots_index;
+
+shared_ptr<random_data_slots> get_random_data_slots(const filesystem::path &cachedir, int testcase_id) {
+    scoped_lock guard(slots_mutex);
+    auto &slots = slots_index[cachedir.string()][testcase_id];
+    if (!slots) slots = make_shared<random_data_slots>(cachedir / "random_data" / to_string(testcase_id));
+    return slots;
+}
+
+void invalidate_random_data_slots(const filesystem::path &cachedir) {
+    scoped_lock guard(slots_mutex);
+    slots_index.erase(cachedir.string());
+}
+
+int generate_random_data(const random_data_spec &spec, const filesystem::path &datadir, const string &execcpuset, bool background) {
+    auto run_script = spec.exec_mgr->get_run_script(spec.run_script);
+    run_script->fetch(execcpuset, CHROOT_DIR);
+
+    // 后台预生成时降低优先级，避免和评测任务抢占 CPU 时间
+    vector<string> priority;
+    if (background) priority = {"nice", "-n", "19"};
+
+    // random_generator.sh <random_case> <random_gen> <std_program> <timelimit> <chrootdir> <datadir> <run> <std_program run_args...>
+    return call_process(priority, EXEC_DIR / "random_generator.sh", "-n", execcpuset, spec.testcase_id, spec.random_path, spec.standard_path, spec.time_limit, CHROOT_DIR, datadir, run_script->get_run_path(), spec.run_args);
+}
+
+void random_data_pool::schedule(const random_data_spec &spec) {
+    {
+        scoped_lock guard(mut);
+        if (!scheduled.insert(spec.random_data_dir()).second) return;
+    }
+    specs.push(spec);
+}
+
+void random_data_pool::finish(const random_data_spec &spec) {
+    scoped_lock guard(mut);
+    scheduled.erase(spec.random_data_dir());
+}
+
+bool random_data_pool::run(const string &execcpuset) {
+    random_data_spec spec;
+    if (!specs.try_pop(spec)) return false;
+
+    try {
+        // 生成期间持有题目缓存文件夹的共享锁，verify_timeliness 需要等待生成结束才能清空文件夹，
+        // 因此获得锁之后再检查缓存文件夹是否已经更新
+        scoped_file_lock lock = lock_directory(spec.cachedir, true);
+
+        // 题目更新后缓存文件夹会被清空，之前编译的随机数据生成器和标准程序都已经失效
+        filesystem::path time_file = spec.cachedir / ".time";
+        if (!filesystem::exists(time_file) || judge::last_write_time(time_file) > spec.updated_at) {
+            finish(spec);
+            return true;
+        }
+
+        auto slots = get_random_data_slots(spec.cachedir, spec.testcase_id);
+        int number = slots->claim();
+        if (number < 0) {  // 已经生成满了，由评测任务随机复用
+            finish(spec);
+            return true;
+        }
+
+        filesystem::path datadir = slots->slot_dir(number);
+        elapsed_time random_time;
+        int ret;
+        try {
+            ret = generate_random_data(spec, datadir, execcpuset, true);
+        } catch (...) {
+            slots->release(number);
+            throw;
+        }
+        slots->commit(number, ret == E_SUCCESS);
+        if (ret != E_SUCCESS) {
+            // 评测任务选中该组数据时会返回 RANDOM_GEN_ERROR
+            LOG(WARNING) << "Unable to pre-generate random data case " << datadir << ", exit code: " << ret;
+            finish(spec);
+            return true;
+        }
+
+        LOG(INFO) << "Pre-generated random data case " << datadir << " in " << random_time.template duration<chrono::milliseconds>().count() << "ms";
+        specs.push(spec);  // 重新排队等待下一个空闲的 worker，生成满之后 claim 会返回 -1
+    } catch (exception &ex) {
+        LOG(ERROR) << "Unable to pre-generate random data for " << spec.random_data_dir() << ": " << ex.what();
+        finish(spec);
+    }
+    return true;
+}
+
+}  // namespace judge
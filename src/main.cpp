@@ -6,12 +6,15 @@
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <map>
 #include <regex>
 #include <set>
 #include <thread>
 #include "common/concurrent_queue.hpp"
 #include "common/messages.hpp"
+#include "common/numa.hpp"
 #include "common/python.hpp"
+#include "common/smt.hpp"
 #include "common/system.hpp"
 #include "common/utils.hpp"
 #include "config.hpp"
@@ -28,7 +31,8 @@
 using namespace std;
 
 judge::concurrent_queue<judge::message::client_task> testcase_queue;
-judge::concurrent_queue<judge::message::core_request> core_acq_queue;
+// 每个 NUMA 节点一个核心申请队列，键为节点编号
+map<int, judge::concurrent_queue<judge::message::core_request>> core_acq_queues;
 
 struct cpuset {
     string literal;
@@ -120,10 +124,12 @@ int main(int argc, char* argv[]) {
         ("enable-3", po::value<vector<string>>(), "run Matrix Judge System 3.0 submission fetcher, with configuration file path.")
         ("enable-2", po::value<vector<string>>(), "run Matrix Judge System 2.0 submission fetcher, with configuration file path.")
         ("cores", po::value<cpuset>()->required(), "set the cores the judge-system can make use of")
+        ("smt-policy", po::value<string>()->default_value("all"), "how to use hyperthread siblings in --cores: all (one worker per logical CPU), exclusive (one worker per physical core, siblings left idle) or shared (one worker per physical core, siblings only compile and compare)")
         ("exec-dir", po::value<string>(), "set the default predefined executables for falling back. You can either pass it from environ EXECDIR")
         ("script-dir", po::value<string>(), "set the directory with required scripts stored. You can either pass it from environ SCRIPTDIR")
         ("cache-dir", po::value<string>(), "set the directory to store cached test data, compiled spj, random test generator, compiled executables. You can either pass it from environ CACHEDIR")
         ("data-dir", po::value<string>(), "set the directory to store test data to be judged, for ramdisk to speed up IO performance of user program. You can either pass it from environ DATADIR")
+        ("keep-compressed-data", "keep compressed test data compressed in the cache directory and decompress it into the data directory only when a test case uses it, requires --data-dir. You can either pass it from environ KEEPCOMPRESSEDDATA")
         ("run-dir", po::value<string>(), "set the directory to run user programs, store compiled user program. You can either pass it from environ RUNDIR")
         ("chroot-dir", po::value<string>(), "set the chroot directory. You can either pass it from environ CHROOTDIR")
         ("script-mem-limit", po::value<unsigned>(), "set memory limit in KB for random data generator, scripts, default to 262144(256MB). You can either pass it from environ SCRIPTMEMLIMIT")
@@ -131,7 +137,13 @@ int main(int argc, char* argv[]) {
         ("script-file-limit", po::value<unsigned>(), "set file limit in KB for random data generator, scripts, default to 524288(512MB). You can either pass it from environ SCRIPTFILELIMIT")
         ("run-user", po::value<string>(), "set run user. You can either pass it from environ RUNUSER")
         ("run-group", po::value<string>(), "set run group. You can either pass it from environ RUNGROUP")
+        ("instruction-rate", po::value<string>(), "judge time limits by instructions retired instead of CPU time, with the number of instructions per second of this machine measured by exec/calibrate_instructions.sh. You can either pass it from environ INSTRUCTIONRATE")
+        ("runguard-supervisor", po::value<string>(), "forward every runguard run to the resident supervisor started by `runguard --daemon <socket>`, instead of initializing runguard for each run. You can either pass it from environ RUNGUARD_SUPERVISOR")
         ("cache-random-data", po::value<size_t>(), "set the maximum number of cached generated random data, default to 100. You can either pass it from environ CACHERANDOMDATA")
+        ("download-concurrency", po::value<unsigned>(), "set the maximum number of connections for downloading remote test data and source files, default to 8. You can either pass it from environ DOWNLOADCONCURRENCY")
+        ("download-retries", po::value<unsigned>(), "set how many times a failed download is retried, default to 2. You can either pass it from environ DOWNLOADRETRIES")
+        ("download-timeout", po::value<unsigned>(), "set the timeout in seconds for connecting or a stalled download, default to 30. You can either pass it from environ DOWNLOADTIMEOUT")
+        ("prefetch-threads", po::value<unsigned>(), "set the number of background threads that download the test data of a submission while it compiles, 0 to download test data only when a test case runs, default to 4. You can either pass it from environ PREFETCHTHREADS")
         ("debug", "turn on the debug mode to disable checking whether it is in privileged mode, and not to delete submission directory to check the validity of result files.")
         ("help", "display this help text")
         ("version", "display version of this application");
@@ -227,6 +239,12 @@ int main(int argc, char* argv[]) {
             << "Data directory " << judge::DATA_DIR << " does not exist";
     }
 
+    if (vm.count("keep-compressed-data") || getenv("KEEPCOMPRESSEDDATA")) {
+        judge::KEEP_COMPRESSED_DATA = true;
+        CHECK(judge::USE_DATA_DIR)
+            << "Keeping test data compressed requires a data directory to decompress it into";
+    }
+
     if (vm.count("run-dir")) {
         judge::RUN_DIR = filesystem::path(vm.at("run-dir").as<string>());
     } else if (getenv("RUNDIR")) {
@@ -274,6 +292,18 @@ int main(int argc, char* argv[]) {
         set_env("RUNGROUP", rungroup);
     }
 
+    // 评测脚本根据每秒指令数将时间限制换算成指令数限制
+    if (vm.count("instruction-rate")) {
+        string rate = vm["instruction-rate"].as<string>();
+        set_env("INSTRUCTIONRATE", rate);
+    }
+
+    // 评测脚本调用的 runguard 检测到该环境变量后将运行请求转发给常驻的 supervisor
+    if (vm.count("runguard-supervisor")) {
+        string socket = vm["runguard-supervisor"].as<string>();
+        set_env("RUNGUARD_SUPERVISOR", socket);
+    }
+
     // 让评测系统写入的数据只允许当前用户写入
     umask(0022);
 
@@ -283,6 +313,30 @@ int main(int argc, char* argv[]) {
         judge::MAX_RANDOM_DATA_NUM = boost::lexical_cast<unsigned>(getenv("CACHERANDOMDATA"));
     }
 
+    if (vm.count("download-concurrency")) {
+        judge::DOWNLOAD_CONCURRENCY = vm["download-concurrency"].as<unsigned>();
+    } else if (getenv("DOWNLOADCONCURRENCY")) {
+        judge::DOWNLOAD_CONCURRENCY = boost::lexical_cast<unsigned>(getenv("DOWNLOADCONCURRENCY"));
+    }
+
+    if (vm.count("download-retries")) {
+        judge::DOWNLOAD_RETRIES = vm["download-retries"].as<unsigned>();
+    } else if (getenv("DOWNLOADRETRIES")) {
+        judge::DOWNLOAD_RETRIES = boost::lexical_cast<unsigned>(getenv("DOWNLOADRETRIES"));
+    }
+
+    if (vm.count("download-timeout")) {
+        judge::DOWNLOAD_TIMEOUT = vm["download-timeout"].as<unsigned>();
+    } else if (getenv("DOWNLOADTIMEOUT")) {
+        judge::DOWNLOAD_TIMEOUT = boost::lexical_cast<unsigned>(getenv("DOWNLOADTIMEOUT"));
+    }
+
+    if (vm.count("prefetch-threads")) {
+        judge::PREFETCH_THREADS = vm["prefetch-threads"].as<unsigned>();
+    } else if (getenv("PREFETCHTHREADS")) {
+        judge::PREFETCH_THREADS = boost::lexical_cast<unsigned>(getenv("PREFETCHTHREADS"));
+    }
+
     if (vm.count("enable-sicily")) {
         auto sicily_servers = vm.at("enable-scicily").as<vector<string>>();
         for (auto& sicily_server : sicily_servers) {
@@ -385,11 +439,29 @@ int main(int argc, char* argv[]) {
 
     vector<thread> worker_threads;
 
-    // 我们为每个注册的 CPU 核心 都生成一个 worker
+    judge::smt_policy policy;
+    string policy_name = vm["smt-policy"].as<string>();
+    if (policy_name == "all") {
+        policy = judge::smt_policy::ALL;
+    } else if (policy_name == "exclusive") {
+        policy = judge::smt_policy::EXCLUSIVE;
+    } else if (policy_name == "shared") {
+        policy = judge::smt_policy::SHARED;
+    } else {
+        cerr << "Unrecognized smt policy " << policy_name << endl;
+        return EXIT_FAILURE;
+    }
+
+    // 我们为每个注册的 CPU 核心（或者每个物理核心，参见 --smt-policy）都生成一个 worker，
+    // 同一 NUMA 节点的 worker 分为一组，多核评测任务只在组内借用核心
     if (vm.count("cores")) {
         cpuset set = vm["cores"].as<cpuset>();
-        for (unsigned i : set.ids) {
-            worker_threads.push_back(move(judge::start_worker(i, testcase_queue, core_acq_queue)));
+        map<int, vector<size_t>> nodes;
+        for (size_t i : judge::select_worker_cores(set.ids, policy)) nodes[judge::numa_node_of_cpu(i)].push_back(i);
+        for (auto& [node, cores] : nodes) {
+            LOG(INFO) << "NUMA node " << node << ": " << cores.size() << " workers";
+            for (size_t i : cores)
+                worker_threads.push_back(move(judge::start_worker(i, testcase_queue, core_acq_queues[node], cores.size())));
         }
     }
 
@@ -137,16 +137,18 @@ void source_code::fetch(const string &cpuset, const fs::path &workdir, const fs:
     scoped_file_lock lock = lock_directory(compilepath, false);
     if (filesystem::exists(compiledpath)) return;
     fs::create_directories(compilepath);
+    vector<pair<asset *, fs::path>> files;
     for (auto &file : source_files) {
         assert_safe_path(file->name);
-        file->fetch(compilepath);
+        files.emplace_back(file.get(), compilepath);
         paths.push_back(file->name);
     }
 
     for (auto &file : assist_files) {
         assert_safe_path(file->name);
-        file->fetch(compilepath);
+        files.emplace_back(file.get(), compilepath);
     }
+    fetch_assets(files);
 
     if (paths.empty()) {
         // skip program that has no source files
@@ -158,6 +160,7 @@ void source_code::fetch(const string &cpuset, const fs::path &workdir, const fs:
 
     map<string, string> env;
     if (!entry_point.empty()) env["ENTRY_POINT"] = entry_point;
+    if (!sanitize.empty()) env["SANITIZE"] = sanitize;
 
     // compile.sh <compile script> <chrootdir> <workdir> <files...>
     if (auto ret = call_process_env(env, EXEC_DIR / "compile.sh", "-n", cpuset, /* compile script */ exec->get_run_path(), chrootdir, workdir, /* source files */ paths); ret != 0) {
@@ -1,51 +1,304 @@
 #include "runguard.hpp"
-#include <boost/lexical_cast.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
-#include <map>
 
 namespace judge {
 using namespace std;
 
-static map<string, string> read_metadata(const filesystem::path &metadata_file) {
-    map<string, string> mp;
-    ifstream fin(metadata_file);
-    string line;
-    while (getline(fin, line)) {
-        size_t end = 0;
-        while (end + 1 < line.length()) {
-            if (line[end] == ':' && line[end + 1] == ' ')
+// meta 文件只有几十行，超出缓冲区的部分（只可能是很长的 internal-error）被截断
+static const size_t METAFILE_BUFFER_SIZE = 8192;
+
+// 和 runguard/src/run_result.cpp 中的定义保持一致，二进制格式中保存的是下标
+static const string_view KILL_REASONS[] = {"", "wall-time", "cpu-time", "instructions", "memory",
+                                           "output-limit", "wrong-answer", "restricted-function", "terminated"};
+static const string_view TIME_RESULTS[] = {"", "soft-timelimit", "hard-timelimit"};
+
+// 和 runguard/include/run_result.hpp 中的 binary_meta 保持一致
+struct binary_meta {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+    uint32_t flags;
+    int32_t exitcode;
+    int32_t signal;
+    double wall_time, user_time, sys_time, cpu_time;
+    int64_t memory_bytes;
+    int64_t instructions;
+    int64_t stdout_bytes;
+    int64_t voluntary_context_switches;
+    int64_t involuntary_context_switches;
+    int64_t major_faults;
+    int64_t minor_faults;
+    int64_t read_bytes;
+    int64_t write_bytes;
+    int64_t peak_pids;
+    uint8_t time_result;
+    uint8_t compare_result;
+    uint8_t kill_reason;
+    uint8_t reserved;
+    uint32_t internal_error_length;
+    double sibling_busy;  // 版本 3 起
+};
+
+template <typename T>
+static void parse_integer(string_view text, T &value) {
+    T parsed;
+    auto [end, ec] = from_chars(text.data(), text.data() + text.size(), parsed);
+    if (ec == errc() && end == text.data() + text.size()) value = parsed;
+}
+
+/**
+ * @brief 解析浮点数，缓冲区以 \0 结尾，数字后面总是跟着换行符、逗号等非数字字符，因此可以直接使用 strtod
+ */
+static void parse_double(string_view text, double &value) {
+    char *end;
+    double parsed = strtod(text.data(), &end);
+    if (!text.empty() && end == text.data() + text.size()) value = parsed;
+}
+
+template <size_t N>
+static string_view lookup(const string_view (&table)[N], string_view value) {
+    for (auto &name : table)
+        if (name == value) return name;
+    return {};
+}
+
+static void assign_field(runguard_result &result, string_view key, string_view value) {
+    if (key == "cpu-time") parse_double(value, result.cpu_time);
+    else if (key == "sys-time") parse_double(value, result.sys_time);
+    else if (key == "user-time") parse_double(value, result.user_time);
+    else if (key == "wall-time") parse_double(value, result.wall_time);
+    else if (key == "exitcode") parse_integer(value, result.exitcode);
+    else if (key == "signal") parse_integer(value, result.signal);
+    else if (key == "memory-bytes") parse_integer(value, result.memory);
+    else if (key == "time-result") result.time_result = value;
+    else if (key == "instructions") parse_integer(value, result.instructions);
+    else if (key == "voluntary-context-switches") parse_integer(value, result.voluntary_context_switches);
+    else if (key == "involuntary-context-switches") parse_integer(value, result.involuntary_context_switches);
+    else if (key == "major-faults") parse_integer(value, result.major_faults);
+    else if (key == "minor-faults") parse_integer(value, result.minor_faults);
+    else if (key == "read-bytes") parse_integer(value, result.read_bytes);
+    else if (key == "write-bytes") parse_integer(value, result.write_bytes);
+    else if (key == "peak-pids") parse_integer(value, result.peak_pids);
+    else if (key == "sibling-busy") parse_double(value, result.sibling_busy);
+    else if (key == "kill-reason") result.kill_reason = lookup(KILL_REASONS, value);
+    else if (key == "internal-error") result.internal_error = value;
+}
+
+/**
+ * @brief 文本格式：每行一个 key: value
+ */
+static void parse_text(string_view data, runguard_result &result) {
+    while (!data.empty()) {
+        size_t end = data.find('\n');
+        string_view line = data.substr(0, end);
+        data.remove_prefix(end == string_view::npos ? data.size() : end + 1);
+
+        size_t colon = line.find(": ");
+        if (colon == string_view::npos) continue;
+        assign_field(result, line.substr(0, colon), line.substr(colon + 2));
+    }
+}
+
+/**
+ * @brief 读取 JSON 字符串并原地反转义，反转义后的字符串不会比原来长
+ * @param p 指向开头的引号，返回时指向结尾的引号之后
+ */
+static bool read_json_string(char *&p, char *end, string_view &value) {
+    char *begin = ++p, *out = p;
+    while (p < end) {
+        char c = *p++;
+        if (c == '"') {
+            value = string_view(begin, out - begin);
+            return true;
+        }
+        if (c != '\\') {
+            *out++ = c;
+            continue;
+        }
+        if (p == end) return false;
+        switch (c = *p++) {
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                unsigned code;
+                if (end - p < 4 || from_chars(p, p + 4, code, 16).ptr != p + 4) return false;
+                p += 4;
+                // 只处理基本多文种平面，编码为 UTF-8 后最多 3 个字节，不会超过转义序列的 6 个字节
+                if (code < 0x80) {
+                    *out++ = code;
+                } else if (code < 0x800) {
+                    *out++ = 0xC0 | (code >> 6);
+                    *out++ = 0x80 | (code & 0x3F);
+                } else {
+                    *out++ = 0xE0 | (code >> 12);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                }
                 break;
-            ++end;
+            }
+            default: *out++ = c; break;  // \" \\ \/
         }
-        if (end + 2 > line.length()) continue;
-        string key = line.substr(0, end);
-        string value = end + 2 == line.length() ? "" : line.substr(end + 2);
-        mp[key] = value;
     }
-    return mp;
+    return false;
 }
 
-template <typename T>
-void try_to_parse(const string &text, T &value) {
-    try {
-        value = boost::lexical_cast<T>(text);
-    } catch (boost::bad_lexical_cast &) {
-        // ignore exception
-    }
+/**
+ * @brief JSON 格式：runguard 写出的是只有一层的对象，值只有数字和字符串，遇到其他格式时停止解析
+ */
+static void parse_json(char *p, char *end, runguard_result &result) {
+    auto skip_spaces = [&] {
+        while (p < end && isspace((unsigned char)*p)) ++p;
+    };
+    auto expect = [&](char c) {
+        skip_spaces();
+        if (p == end || *p != c) return false;
+        ++p;
+        return true;
+    };
+
+    if (!expect('{')) return;
+    do {
+        string_view key, value;
+        skip_spaces();
+        if (p == end || *p != '"' || !read_json_string(p, end, key) || !expect(':')) return;
+        skip_spaces();
+        if (p < end && *p == '"') {
+            if (!read_json_string(p, end, value)) return;
+        } else {
+            char *begin = p;
+            while (p < end && *p != ',' && *p != '}' && !isspace((unsigned char)*p)) ++p;
+            value = string_view(begin, p - begin);
+        }
+        assign_field(result, key, value);
+    } while (expect(','));
+}
+
+/**
+ * @brief 二进制格式：定长的 binary_meta 后接 internal-error，新版本追加的字段根据 size 跳过，
+ * 旧版本缺少的字段保持默认值
+ */
+static void parse_binary(string_view data, runguard_result &result) {
+    // 版本 2 的定长部分到 internal_error_length 为止
+    const size_t MIN_SIZE = offsetof(binary_meta, internal_error_length) + sizeof(uint32_t);
+    binary_meta meta;
+    meta.sibling_busy = -1;
+    uint32_t fixed_size;
+    if (data.size() < MIN_SIZE) return;
+    memcpy(&fixed_size, data.data() + offsetof(binary_meta, size), sizeof(fixed_size));
+    if (fixed_size < MIN_SIZE || fixed_size > data.size()) return;
+    memcpy(&meta, data.data(), min<size_t>(fixed_size, sizeof(meta)));
+
+    result.exitcode = meta.exitcode;
+    result.signal = meta.signal;
+    result.wall_time = meta.wall_time;
+    result.user_time = meta.user_time;
+    result.sys_time = meta.sys_time;
+    result.cpu_time = meta.cpu_time;
+    if (meta.memory_bytes <= INT_MAX) result.memory = meta.memory_bytes;
+    result.instructions = meta.instructions;
+    result.voluntary_context_switches = meta.voluntary_context_switches;
+    result.involuntary_context_switches = meta.involuntary_context_switches;
+    result.major_faults = meta.major_faults;
+    result.minor_faults = meta.minor_faults;
+    result.read_bytes = meta.read_bytes;
+    result.write_bytes = meta.write_bytes;
+    result.peak_pids = meta.peak_pids;
+    result.sibling_busy = meta.sibling_busy;
+    if (meta.time_result < size(TIME_RESULTS)) result.time_result = TIME_RESULTS[meta.time_result];
+    if (meta.kill_reason < size(KILL_REASONS)) result.kill_reason = KILL_REASONS[meta.kill_reason];
+    result.internal_error = data.substr(fixed_size, meta.internal_error_length);
 }
 
 runguard_result read_runguard_result(const filesystem::path &metafile) {
-    auto metadata = read_metadata(metafile);
     runguard_result result;
-    if (metadata.count("cpu-time")) try_to_parse(metadata.at("cpu-time"), result.cpu_time);
-    if (metadata.count("sys-time")) try_to_parse(metadata.at("sys-time"), result.sys_time);
-    if (metadata.count("user-time")) try_to_parse(metadata.at("user-time"), result.user_time);
-    if (metadata.count("wall-time")) try_to_parse(metadata.at("wall-time"), result.wall_time);
-    if (metadata.count("exitcode")) try_to_parse(metadata.at("exitcode"), result.exitcode);
-    if (metadata.count("signal")) try_to_parse(metadata.at("signal"), result.signal);
-    if (metadata.count("memory-bytes")) try_to_parse(metadata.at("memory-bytes"), result.memory);
-    if (metadata.count("time-result")) try_to_parse(metadata.at("time-result"), result.time_result);
-    if (metadata.count("internal-error")) try_to_parse(metadata.at("internal-error"), result.internal_error);
+
+    // 评测每个测试点都要读取一次 meta 文件，直接读入栈上的缓冲区，不经过 ifstream 和 map
+    alignas(8) char buffer[METAFILE_BUFFER_SIZE];
+    int fd = open(metafile.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return result;
+    size_t length = 0;
+    while (length < sizeof(buffer) - 1) {
+        ssize_t n = read(fd, buffer + length, sizeof(buffer) - 1 - length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        length += n;
+    }
+    close(fd);
+    buffer[length] = '\0';
+
+    string_view data(buffer, length);
+    size_t first = data.find_first_not_of(" \t\r\n");
+    if (data.substr(0, 4) == "RGMT")
+        parse_binary(data, result);
+    else if (first != string_view::npos && data[first] == '{')
+        parse_json(buffer, buffer + length, result);
+    else
+        parse_text(data, result);
+    return result;
+}
+
+// 和 runguard/include/timeline.hpp 中的定义保持一致
+struct timeline_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t interval_us;
+    uint32_t sample_size;
+};
+
+struct timeline_sample {
+    uint32_t time_us, memory_kb, cpu_us, page_faults, major_faults, context_switches, read_kb, write_kb;
+};
+
+vector<runguard_timeline_point> read_runguard_timeline(const filesystem::path &timeline_file) {
+    vector<runguard_timeline_point> timeline;
+    ifstream fin(timeline_file, ios::binary);
+    timeline_header header;
+    if (!fin.read((char *)&header, sizeof(header)) || memcmp(header.magic, "RGTL", 4) != 0 ||
+        header.sample_size < sizeof(timeline_sample))
+        return timeline;
+
+    // 新版本的 runguard 可能在每个采样点后面追加字段，只读取认识的部分
+    vector<char> buffer(header.sample_size);
+    while (fin.read(buffer.data(), buffer.size())) {
+        timeline_sample sample;
+        memcpy(&sample, buffer.data(), sizeof(sample));
+        runguard_timeline_point point;
+        point.time = sample.time_us / 1e6;
+        point.memory = sample.memory_kb;
+        point.cpu_time = sample.cpu_us / 1e6;
+        point.page_faults = sample.page_faults;
+        point.major_faults = sample.major_faults;
+        point.context_switches = sample.context_switches;
+        point.read_bytes = sample.read_kb;
+        point.write_bytes = sample.write_kb;
+        timeline.push_back(point);
+    }
+    return timeline;
+}
+
+vector<runguard_timeline_point> downsample_timeline(const vector<runguard_timeline_point> &timeline, size_t max_points) {
+    if (timeline.size() <= max_points || max_points == 0) return timeline;
+
+    vector<runguard_timeline_point> result;
+    for (size_t i = 0; i < max_points; ++i) {
+        size_t begin = i * timeline.size() / max_points, end = (i + 1) * timeline.size() / max_points;
+        runguard_timeline_point point = timeline[end - 1];
+        for (size_t j = begin; j < end; ++j)
+            point.memory = max(point.memory, timeline[j].memory);
+        result.push_back(point);
+    }
     return result;
 }
 
@@ -27,6 +27,11 @@ void from_json(const json &j, judge_task::dependency_condition &value) {
         throw std::invalid_argument("Unrecognized dependency_condition " + str);
 }
 
+void from_json(const json &j, judge_task::dependency &value) {
+    j.at("task").get_to(value.task);
+    assign_optional(j, value.condition, "condition");
+}
+
 void from_json(const json &j, judge_task &value) {
     value.check_type = 0;
     j.at("check_script").get_to(value.check_script);
@@ -36,12 +41,15 @@ void from_json(const json &j, judge_task &value) {
     assign_optional(j, value.testcase_id, "testcase_id");
     j.at("depends_on").get_to(value.depends_on);
     assign_optional(j, value.depends_cond, "depends_cond");
+    assign_optional(j, value.dependencies, "dependencies");
     assign_optional(j, value.memory_limit, "memory_limit");
     j.at("time_limit").get_to(value.time_limit), value.time_limit /= 1000;
     assign_optional(j, value.file_limit, "file_limit");
     assign_optional(j, value.proc_limit, "proc_limit");
     assign_optional(j, value.run_args, "run_args");
     assign_optional(j, value.name, "name");
+    assign_optional(j, value.shards, "shards");
+    assign_optional(j, value.timeline_interval, "timeline_interval");
 }
 
 void from_json(const json &j, asset_uptr &asset) {
@@ -172,6 +172,9 @@ json 示例
                 ],
                 "run_times": 100
             }
+        },
+        "memory_check": {      //可选，内存测试方式，可选 valgrind（默认）、sanitizer
+            "c++": "sanitizer"
         }
     }
 }
@@ -406,8 +409,12 @@ static void from_json_programming(const json &j, configuration &server, programm
         testcase.score = grading.count("MemoryCheck") ? grading.at("MemoryCheck").get<int>() : 0;
         testcase.check_type = MEMORY_CHECK_TYPE;
         testcase.check_script = "standard";
-        testcase.run_script = "valgrind";
-        testcase.compare_script = "valgrind";
+        // 题目可以选择使用 sanitizer 进行内存检查，速度比 valgrind 快很多，但只支持 C/C++，其他语言仍使用 valgrind
+        string memory_check_mode = get_value_def(config, string("valgrind"), "memory_check", language);
+        bool sanitizable = submit.submission && (submit.submission->language == "c" || submit.submission->language == "cpp");
+        if (memory_check_mode != "sanitizer" || !sanitizable) memory_check_mode = "valgrind";
+        testcase.run_script = memory_check_mode;
+        testcase.compare_script = memory_check_mode;
         if (submit.submission)
             submit.submission->compile_command.push_back("-g");
         testcase.is_random = submit.judge_tasks.empty();
@@ -778,7 +785,8 @@ static bool summarize_static_check(boost::rational<int> &total_score, programmin
 }
 
 /**
- * 采用 valgrind 进行内存检测，用于发现内存泄露、访问越界等问题
+ * 采用 valgrind 或 sanitizer 进行内存检测，用于发现内存泄露、访问越界等问题
+ * sanitizer 的报告会被转换为 valgrind 的格式，因此两种方式的报告格式相同
  * 内存检测需要提交代码的可执行文件，并且基于标准测试或随机测试（优先选用标准测试），因此只有当标准测试或随机测试的条件满足时才能进行内存测试
  * 
  * 执行条件
@@ -1,5 +1,6 @@
 #include "worker.hpp"
 #include <Python.h>
+#include <atomic>
 #include <glog/logging.h>
 #include <boost/algorithm/string/join.hpp>
 #include <boost/exception/diagnostic_information.hpp>
@@ -7,6 +8,7 @@
 #include <functional>
 #include "common/defer.hpp"
 #include "common/exceptions.hpp"
+#include "common/numa.hpp"
 
 namespace judge {
 using namespace std;
@@ -31,6 +33,13 @@ void register_judge_server(unique_ptr<judge_server> &&judge_server) {
     judge_servers.insert({category, move(judge_server)});
 }
 
+// 正在等待评测任务的 worker 数，分片评测时用来估计空闲的核心数
+static atomic<size_t> idle_workers(0);
+
+size_t idle_worker_count() {
+    return idle_workers;
+}
+
 static vector<unique_ptr<monitor>> monitors;
 
 void register_monitor(unique_ptr<monitor> &&monitor) {
@@ -129,6 +138,25 @@ static bool fetch_submission(int worker_id, concurrent_queue<message::client_tas
     return fetch_submission_nolock(worker_id, task_queue);
 }
 
+/**
+ * @brief 在 worker 空闲时执行一个后台任务
+ * @return true 如果执行了后台任务
+ */
+static bool run_background_task(size_t core_id) {
+    bool success = false;
+    for (auto &[type, judger] : judgers) {
+        try {
+            if (judger->run_background_task(to_string(core_id))) {
+                success = true;
+                break;
+            }
+        } catch (exception &ex) {
+            LOG(WARNING) << "Background task of " << type << " failed: " << ex.what();
+        }
+    }
+    return success;
+}
+
 /**
  * @brief 评测客户端程序函数
  * 评测客户端负责从消息队列中获取评测服务端要求评测的数据点，
@@ -143,8 +171,12 @@ static bool fetch_submission(int worker_id, concurrent_queue<message::client_tas
  * 对于需要进行缓存的文件：
  *     CACHE_DIR
  */
-static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue) {
+static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue, size_t group_size) {
+    // worker 线程下载和拷贝的测试数据留在本节点的内存中，选手程序读取时不需要跨节点
+    prefer_numa_node(numa_node_of_cpu(core_id));
+
     call_monitor(core_id, [&](monitor &m) { m.worker_state_changed(core_id, worker_state::START, ""); });
+    ++idle_workers;
 
     while (true) {
         {
@@ -156,8 +188,11 @@ static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &
                     core_request.lock->count_down();
                 }
                 {
+                    // 当前核心被借给多核评测任务，等待期间不算空闲
+                    --idle_workers;
                     unique_lock lock(*core_request.mut);
                     core_request.cv->wait(lock);
+                    ++idle_workers;
                 }
             }
 
@@ -173,12 +208,17 @@ static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &
                         break;
                     }
 
-                    if (!fetch_submission(core_id, task_queue))
+                    // 拉取不到提交时才执行后台任务，后台任务不能影响提交的评测
+                    if (!fetch_submission(core_id, task_queue) && !run_background_task(core_id))
                         usleep(10 * 1000);  // 10ms，这里必须等待，不可以忙等，否则会挤占返回评测结果的执行权
                     continue;
                 }
             }
 
+            --idle_workers;
+            defer {
+                ++idle_workers;
+            };
             call_monitor(core_id, [&](monitor &m) { m.start_judge_task(core_id, client_task); });
             defer {
                 // 使用 defer 是希望即使评测崩溃也可以发送 end_judge_task 避免监控爆炸
@@ -189,9 +229,16 @@ static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &
             {
                 judger &j = get_judger_by_type(client_task.submit->sub_type);
                 vector<size_t> cpus = {core_id};
-                if (client_task.cores > 1 /* TODO: check if cores <= workers */) {
+                size_t cores = client_task.cores;
+                if (cores > group_size) {
+                    // 本节点的核心不够时不能等待其他节点的 worker，否则会永远等待
+                    LOG(WARNING) << "Judge task requires " << cores << " cores but NUMA node of core " << core_id
+                                 << " has only " << group_size << ", running on " << group_size << " cores";
+                    cores = group_size;
+                }
+                if (cores > 1) {
                     message::core_request request;
-                    boost::latch latch(client_task.cores - 1);
+                    boost::latch latch(cores - 1);
                     std::mutex write_lock, mut;
                     std::condition_variable cv;
                     request.core_ids = &cpus;
@@ -200,7 +247,7 @@ static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &
                     request.cv = &cv;
                     request.mut = &mut;
 
-                    for (size_t i = 1; i < client_task.cores; ++i)
+                    for (size_t i = 1; i < cores; ++i)
                         core_queue.push(request);
                     latch.wait();
                 }
@@ -212,18 +259,24 @@ static void worker_loop(size_t core_id, concurrent_queue<message::client_task> &
             call_monitor(core_id, [&](monitor &m) { m.worker_state_changed(core_id, worker_state::IDLE, ""); });
         }
 
-        scoped_lock guard(server_mutex);
-        for (auto &submit : finished_submissions)
-            call_monitor(core_id, [&](monitor &m) { m.end_submission(*submit); });
-        finished_submissions.clear();
+        vector<unique_ptr<submission>> finished;
+        {
+            scoped_lock guard(server_mutex);
+            for (auto &submit : finished_submissions)
+                call_monitor(core_id, [&](monitor &m) { m.end_submission(*submit); });
+            finished.swap(finished_submissions);
+        }
+        // 提交析构时要等待正在进行的测试数据预取，不能持有 server_mutex 阻塞其他 worker
+        finished.clear();
     }
 
+    --idle_workers;
     call_monitor(core_id, [&](monitor &m) { m.worker_state_changed(core_id, worker_state::STOPPED, ""); });
 }
 
-thread start_worker(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue) {
-    thread thd([core_id, &task_queue, &core_queue] {
-        worker_loop(core_id, task_queue, core_queue);
+thread start_worker(size_t core_id, concurrent_queue<message::client_task> &task_queue, concurrent_queue<message::core_request> &core_queue, size_t group_size) {
+    thread thd([core_id, &task_queue, &core_queue, group_size] {
+        worker_loop(core_id, task_queue, core_queue, group_size);
     });
 
     // 设置当前线程（客户端线程）的 CPU 亲和性，要求操作系统将 thd 线程放在指定的 cpuset 上运行
@@ -0,0 +1,38 @@
+#!/bin/bash
+#
+# 比较 runguard 不限制系统调用、ptrace 和 seccomp 三种模式运行系统调用密集程序的耗时，
+# 并检查调用受限系统调用的程序在 ptrace 和 seccomp 模式下都会得到 restricted-function: yes
+# 需要先编译 runguard 并执行 exec/create_cgroups.sh
+# 用法： sudo RUNUSER=domjudge-run $0 [迭代次数]
+
+set -e
+
+TESTDIR=$(cd "$(dirname "$0")" && pwd)
+RUNGUARD=${RUNGUARD:-$TESTDIR/../../runguard/bin/runguard}
+ITERATIONS=${1:-1000000}
+TMPDIR=$(mktemp -d)
+chmod 755 "$TMPDIR"  # 受控程序以 RUNUSER 运行
+trap 'rm -rf "$TMPDIR"' EXIT
+
+gcc -O2 -static -nostdlib -DITERATIONS=$ITERATIONS -o "$TMPDIR/heavy" "$TESTDIR/syscall_heavy.c"
+gcc -O2 -static -nostdlib -DITERATIONS=1 -DRESTRICTED -o "$TMPDIR/restricted" "$TESTDIR/syscall_heavy.c"
+
+meta() { grep "^$1: " "$TMPDIR/meta" | sed "s/$1: //"; }
+
+run() {
+    local mode=$1 prog=$2
+    "$RUNGUARD" $mode -u "${RUNUSER:-nobody}" -o /dev/null -M "$TMPDIR/meta" -- "$TMPDIR/$prog" > /dev/null
+}
+
+printf "%-12s %10s %10s %10s\n" mode wall-time user-time sys-time
+for mode in "" --ptrace --seccomp; do
+    run "$mode" heavy
+    [ "$(meta exitcode)" == "0" ] || { echo "${mode:-unrestricted}: exitcode $(meta exitcode)" >&2; exit 1; }
+    printf "%-12s %10s %10s %10s\n" "${mode:-unrestricted}" "$(meta wall-time)" "$(meta user-time)" "$(meta sys-time)"
+done
+
+for mode in --ptrace --seccomp; do
+    run "$mode" restricted || true
+    [ "$(meta restricted-function)" == "yes" ] || { echo "$mode: restricted system call not reported" >&2; exit 1; }
+done
+echo "restricted system calls are reported in both modes"
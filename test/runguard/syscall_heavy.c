@@ -0,0 +1,28 @@
+/*
+ * 系统调用密集的测试程序：逐字节写出 ITERATIONS 个字符。
+ * 不链接 libc，只使用 write 和 exit_group 两个系统调用，
+ * 这样 ptrace 和 seccomp 模式下的系统调用表都允许它运行。
+ * 只支持 x86_64：gcc -O2 -static -nostdlib -o syscall_heavy syscall_heavy.c
+ */
+#ifndef ITERATIONS
+#define ITERATIONS 1000000
+#endif
+
+static long syscall3(long nr, long a, long b, long c) {
+    long ret;
+    __asm__ volatile("syscall"
+                     : "=a"(ret)
+                     : "a"(nr), "D"(a), "S"(b), "d"(c)
+                     : "rcx", "r11", "memory");
+    return ret;
+}
+
+void _start(void) {
+    char c = 'x';
+    for (long i = 0; i < ITERATIONS; ++i)
+        syscall3(1, 1, (long)&c, 1);  // write
+#ifdef RESTRICTED
+    syscall3(39, 0, 0, 0);  // getpid，不在系统调用表中
+#endif
+    syscall3(231, 0, 0, 0);  // exit_group
+}
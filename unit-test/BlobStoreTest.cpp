@@ -0,0 +1,102 @@
+#include "blob_store.hpp"
+#include <fstream>
+#include "common/io_utils.hpp"
+#include "gtest/gtest.h"
+#include "test/http_server.hpp"
+
+using namespace std;
+using namespace std::filesystem;
+using namespace judge;
+
+static path blobdir("/tmp/blob_store_test/.blobs");
+static path problemdir("/tmp/blob_store_test/problem");
+
+class BlobStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        remove_all(blobdir.parent_path());
+    }
+
+    void TearDown() override {
+        remove_all(blobdir.parent_path());
+    }
+
+    test::http_server server;
+    downloader engine{download_options()};
+};
+
+TEST_F(BlobStoreTest, RevalidateTest) {
+    vector<blob_store::request> files;
+    for (int i = 0; i < 3; ++i) {
+        string name = "/" + to_string(i) + ".in";
+        server.set_file(name, to_string(i));
+        files.push_back({server.url(name), problemdir / "input" / (to_string(i) + ".in")});
+    }
+    blob_store(blobdir).fetch(engine, files);
+    EXPECT_EQ(server.responses(), 3u);
+
+    // 题目更新后缓存文件夹被清空，只有修改过的文件重新下载，URL 的记录保存在磁盘上
+    remove_all(problemdir);
+    server.set_file("/1.in", "updated");
+    blob_store(blobdir).fetch(engine, files);
+
+    EXPECT_EQ(server.requests(), 6u);
+    EXPECT_EQ(server.responses(), 4u);
+    EXPECT_EQ(read_file_content(problemdir / "input" / "0.in"), "0");
+    EXPECT_EQ(read_file_content(problemdir / "input" / "1.in"), "updated");
+    EXPECT_EQ(read_file_content(problemdir / "input" / "2.in"), "2");
+}
+
+TEST_F(BlobStoreTest, DeduplicateTest) {
+    server.set_file("/a/testlib.h", "#pragma once");
+    server.set_file("/b/testlib.h", "#pragma once");
+    blob_store store(blobdir);
+    store.fetch(engine, {{server.url("/a/testlib.h"), problemdir / "a" / "testlib.h", compression::NONE, true},
+                         {server.url("/b/testlib.h"), problemdir / "b" / "testlib.h", compression::NONE, true}});
+
+    // 两道题目的文件链接到同一个 blob
+    EXPECT_TRUE(equivalent(problemdir / "a" / "testlib.h", problemdir / "b" / "testlib.h"));
+    EXPECT_EQ(hard_link_count(problemdir / "a" / "testlib.h"), 3u);
+
+    blob_store::url_entry entry;
+    ASSERT_TRUE(store.lookup(server.url("/a/testlib.h"), entry));
+    EXPECT_EQ(entry.hash, sha256_file(problemdir / "a" / "testlib.h"));
+    EXPECT_EQ(entry.validators.etag, "\"1\"");
+    EXPECT_FALSE(store.lookup(server.url("/c/testlib.h"), entry));
+}
+
+TEST_F(BlobStoreTest, CopyTest) {
+    server.set_file("/testlib.h", "#pragma once");
+    blob_store store(blobdir);
+    store.fetch(engine, {{server.url("/testlib.h"), problemdir / "compile" / "testlib.h"}});
+
+    // 编译文件夹会被修改权限和写入，不能链接到共用的 blob
+    EXPECT_EQ(hard_link_count(problemdir / "compile" / "testlib.h"), 1u);
+    ofstream(problemdir / "compile" / "testlib.h") << "modified";
+    blob_store::url_entry entry;
+    ASSERT_TRUE(store.lookup(server.url("/testlib.h"), entry));
+    EXPECT_EQ(read_file_content(store.blob_path(entry.hash)), "#pragma once");
+}
+
+TEST_F(BlobStoreTest, CollectTest) {
+    server.set_file("/used.in", "used");
+    server.set_file("/unused.in", "unused");
+    blob_store store(blobdir);
+    store.fetch(engine, {{server.url("/used.in"), problemdir / "used.in", compression::NONE, true},
+                         {server.url("/unused.in"), problemdir / "unused.in", compression::NONE, true}});
+    remove(problemdir / "unused.in");
+
+    // 刚刚不再使用的文件在 grace 内保留
+    EXPECT_TRUE(store.collect(chrono::hours(1), chrono::hours(1)));
+    blob_store::url_entry entry;
+    EXPECT_TRUE(store.lookup(server.url("/unused.in"), entry));
+
+    // 距离上一次回收不足 interval 时跳过
+    EXPECT_FALSE(store.collect(chrono::hours(1), chrono::seconds(0)));
+
+    blob_store fresh(blobdir);
+    EXPECT_TRUE(fresh.collect(chrono::hours(1), chrono::seconds(0)));
+    EXPECT_FALSE(fresh.lookup(server.url("/unused.in"), entry));
+    ASSERT_TRUE(fresh.lookup(server.url("/used.in"), entry));
+    EXPECT_EQ(read_file_content(problemdir / "used.in"), "used");
+}
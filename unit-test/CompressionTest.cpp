@@ -0,0 +1,131 @@
+#include "common/compression.hpp"
+#include <archive.h>
+#include <archive_entry.h>
+#include <lzma.h>
+#include <zlib.h>
+#include <zstd.h>
+#include <fstream>
+#include "blob_store.hpp"
+#include "common/exceptions.hpp"
+#include "common/io_utils.hpp"
+#include "gtest/gtest.h"
+#include "test/http_server.hpp"
+
+using namespace std;
+using namespace std::filesystem;
+using namespace judge;
+
+static path compressiondir("/tmp/compression_test");
+
+static string compress(const string &data, compression type) {
+    string result;
+    if (type == compression::ZSTD) {
+        result.resize(ZSTD_compressBound(data.size()));
+        result.resize(ZSTD_compress(result.data(), result.size(), data.data(), data.size(), 3));
+    } else if (type == compression::GZIP) {
+        z_stream stream = {};
+        deflateInit2(&stream, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);  // 15 + 16: gzip 头
+        result.resize(deflateBound(&stream, data.size()));
+        stream.next_in = (Bytef *)data.data();
+        stream.avail_in = data.size();
+        stream.next_out = (Bytef *)result.data();
+        stream.avail_out = result.size();
+        deflate(&stream, Z_FINISH);
+        result.resize(stream.total_out);
+        deflateEnd(&stream);
+    } else if (type == compression::XZ) {
+        result.resize(lzma_stream_buffer_bound(data.size()));
+        size_t size = 0;
+        lzma_easy_buffer_encode(6, LZMA_CHECK_CRC64, nullptr, (const uint8_t *)data.data(), data.size(), (uint8_t *)result.data(), &size, result.size());
+        result.resize(size);
+    }
+    return result;
+}
+
+static void write_file(const path &file, const string &content) {
+    create_directories(file.parent_path());
+    ofstream(file, ios::binary) << content;
+}
+
+/**
+ * @brief 创建 zstd 压缩的 tar 数据包
+ */
+static void write_archive(const path &file, const vector<pair<string, string>> &entries) {
+    create_directories(file.parent_path());
+    struct archive *a = archive_write_new();
+    archive_write_add_filter_zstd(a);
+    archive_write_set_format_pax_restricted(a);
+    archive_write_open_filename(a, file.c_str());
+    for (auto &[name, content] : entries) {
+        struct archive_entry *entry = archive_entry_new();
+        archive_entry_set_pathname(entry, name.c_str());
+        archive_entry_set_size(entry, content.size());
+        archive_entry_set_filetype(entry, AE_IFREG);
+        archive_entry_set_perm(entry, 0644);
+        archive_write_header(a, entry);
+        archive_write_data(a, content.data(), content.size());
+        archive_entry_free(entry);
+    }
+    archive_write_close(a);
+    archive_write_free(a);
+}
+
+class CompressionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        remove_all(compressiondir);
+        for (int i = 0; i < 100000; ++i) data += to_string(i) + "\n";
+    }
+
+    void TearDown() override {
+        remove_all(compressiondir);
+    }
+
+    string data;
+};
+
+TEST_F(CompressionTest, DecompressFileTest) {
+    for (compression type : {compression::ZSTD, compression::GZIP, compression::XZ}) {
+        path file = compressiondir / ("testdata.in" + compression_suffix(type));
+        EXPECT_EQ(compression_of(file.string()), type);
+        // 拼接的两个压缩流解压后也是拼接的内容
+        write_file(file, compress(data, type) + compress("end", type));
+        decompress_file(file, compressiondir / "testdata.in", type);
+        EXPECT_EQ(read_file_content(compressiondir / "testdata.in"), data + "end");
+    }
+}
+
+TEST_F(CompressionTest, TruncatedTest) {
+    for (compression type : {compression::ZSTD, compression::GZIP, compression::XZ}) {
+        string compressed = compress(data, type);
+        write_file(compressiondir / "testdata.in.part", compressed.substr(0, compressed.size() / 2));
+        EXPECT_THROW(decompress_file(compressiondir / "testdata.in.part", compressiondir / "testdata.in", type), judge_exception);
+    }
+}
+
+TEST_F(CompressionTest, ExtractArchiveTest) {
+    EXPECT_TRUE(is_archive("http://localhost/data.tar.zst?token=1"));
+    write_archive(compressiondir / "data.tar.zst", {{"1.in", "1"}, {"sub/2.in", data}});
+    extract_archive(compressiondir / "data.tar.zst", compressiondir / "input");
+    EXPECT_EQ(read_file_content(compressiondir / "input" / "1.in"), "1");
+    EXPECT_EQ(read_file_content(compressiondir / "input" / "sub" / "2.in"), data);
+
+    write_archive(compressiondir / "unsafe.tar.zst", {{"../escaped.in", "1"}});
+    EXPECT_THROW(extract_archive(compressiondir / "unsafe.tar.zst", compressiondir / "input"), judge_exception);
+    EXPECT_FALSE(exists(compressiondir / "escaped.in"));
+}
+
+TEST_F(CompressionTest, StreamingDownloadTest) {
+    test::http_server server;
+    server.set_file("/testdata.in.zst", compress(data, compression::ZSTD));
+    server.set_file("/broken.in.xz", compress(data, compression::ZSTD));
+    downloader engine{download_options()};
+    blob_store store(compressiondir / ".blobs");
+
+    store.fetch(engine, {{server.url("/testdata.in.zst"), compressiondir / "input" / "testdata.in", compression::ZSTD}});
+    EXPECT_EQ(read_file_content(compressiondir / "input" / "testdata.in"), data);
+
+    // 压缩数据损坏时不重试
+    EXPECT_THROW(store.fetch(engine, {{server.url("/broken.in.xz"), compressiondir / "input" / "broken.in", compression::XZ}}), network_error);
+    EXPECT_EQ(server.requests(), 2u);
+}
@@ -0,0 +1,111 @@
+#include "downloader.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "common/exceptions.hpp"
+#include "common/io_utils.hpp"
+#include "gtest/gtest.h"
+#include "test/http_server.hpp"
+
+using namespace std;
+using namespace std::filesystem;
+using namespace judge;
+
+static path downloaddir("/tmp/downloader_test");
+
+class DownloaderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        remove_all(downloaddir);
+    }
+
+    void TearDown() override {
+        remove_all(downloaddir);
+    }
+
+    test::http_server server;
+};
+
+TEST_F(DownloaderTest, ParallelDownloadTest) {
+    download_options options;
+    options.concurrency = 4;
+    downloader engine(options);
+
+    vector<pair<string, path>> files;
+    for (int i = 0; i < 40; ++i) {
+        string name = "/" + to_string(i) + ".in";
+        server.set_file(name, string(i * 1000, 'a' + i % 26));
+        files.emplace_back(server.url(name), downloaddir / "input" / (to_string(i) + ".in"));
+    }
+    engine.download_all(files);
+
+    for (int i = 0; i < 40; ++i)
+        EXPECT_EQ(read_file_content(downloaddir / "input" / (to_string(i) + ".in")), string(i * 1000, 'a' + i % 26));
+    EXPECT_EQ(server.requests(), 40u);
+    // 40 个文件复用了至多 4 个 keep-alive 连接
+    EXPECT_LE(server.connections(), 4u);
+}
+
+TEST_F(DownloaderTest, RetryTest) {
+    download_options options;
+    options.retries = 2;
+    downloader engine(options);
+
+    server.set_file("/testdata.in", "1");
+    server.fail_next("/testdata.in", 2);
+    engine.download(server.url("/testdata.in"), downloaddir / "testdata.in").get();
+
+    EXPECT_EQ(read_file_content(downloaddir / "testdata.in"), "1");
+    EXPECT_EQ(server.requests(), 3u);
+}
+
+TEST_F(DownloaderTest, NotFoundTest) {
+    download_options options;
+    options.retries = 2;
+    downloader engine(options);
+
+    server.set_file("/testdata.in", "1");
+    vector<pair<string, path>> files = {
+        {server.url("/testdata.in"), downloaddir / "testdata.in"},
+        {server.url("/missing.out"), downloaddir / "testdata.out"}};
+    EXPECT_THROW(engine.download_all(files), judge_exception);
+
+    // 404 不会重试，其余的文件照常下载完成
+    EXPECT_EQ(server.requests(), 2u);
+    EXPECT_EQ(read_file_content(downloaddir / "testdata.in"), "1");
+}
+
+TEST_F(DownloaderTest, TimeoutTest) {
+    download_options options;
+    options.retries = 0;
+    options.timeout = 1;
+    downloader engine(options);
+
+    server.stall("/testdata.in");
+    auto begin = chrono::steady_clock::now();
+    EXPECT_THROW(engine.download(server.url("/testdata.in"), downloaddir / "testdata.in").get(), judge_exception);
+    EXPECT_LT(chrono::steady_clock::now() - begin, chrono::seconds(5));
+}
+
+TEST_F(DownloaderTest, CancelTest) {
+    download_options options;
+    options.concurrency = 1;
+    options.timeout = 30;
+    downloader engine(options);
+
+    server.stall("/testdata.in");
+    server.set_file("/testdata.out", "1");
+    atomic<bool> cancelled = false;
+    auto begin = chrono::steady_clock::now();
+    auto input = engine.download(server.url("/testdata.in"), downloaddir / "testdata.in", {}, compression::NONE, &cancelled);
+    // 唯一的连接被停滞的下载占用，这个下载一直在排队
+    auto output = engine.download(server.url("/testdata.out"), downloaddir / "testdata.out", {}, compression::NONE, &cancelled);
+    this_thread::sleep_for(chrono::milliseconds(200));
+    cancelled = true;
+
+    // 不必等到传输停滞超时
+    EXPECT_THROW(input.get(), judge_exception);
+    EXPECT_THROW(output.get(), judge_exception);
+    EXPECT_LT(chrono::steady_clock::now() - begin, chrono::seconds(5));
+    EXPECT_EQ(server.requests(), 1u);
+}
@@ -1,4 +1,6 @@
 #include "env.hpp"
+#include <glog/logging.h>
+#include "common/utils.hpp"
 #include "gtest/gtest.h"
 #include "judge/programming.hpp"
 #include "test/mock_judge_server.hpp"
@@ -96,6 +98,11 @@ protected:
     static void TearDownTestCase() {
     }
 
+    /**
+     * @brief 内存测试使用的 run script 和 compare script，valgrind 或 sanitizer
+     */
+    string mode = "valgrind";
+
     void prepare_only_memory_check(programming_submission &prog, executable_manager &exec_mgr, const string &source) {
         prog.category = "mock";
         prog.prob_id = "1234";
@@ -130,8 +137,8 @@ protected:
             testcase.depends_on = 0;  // 依赖编译任务
             testcase.depends_cond = judge_task::dependency_condition::ACCEPTED;
             testcase.check_script = "standard";
-            testcase.run_script = "valgrind";
-            testcase.compare_script = "valgrind";
+            testcase.run_script = mode;
+            testcase.compare_script = mode;
             testcase.time_limit = 5;
             testcase.memory_limit = 524288;
             testcase.file_limit = 524288;
@@ -186,8 +193,8 @@ protected:
             testcase.depends_on = 1;  // 依赖标准测试
             testcase.depends_cond = judge_task::dependency_condition::ACCEPTED;
             testcase.check_script = "standard";
-            testcase.run_script = "valgrind";
-            testcase.compare_script = "valgrind";
+            testcase.run_script = mode;
+            testcase.compare_script = mode;
             testcase.time_limit = 5;
             testcase.memory_limit = 524288;
             testcase.file_limit = 524288;
@@ -240,8 +247,8 @@ protected:
             testcase.depends_on = 1;  // 依赖标准测试
             testcase.depends_cond = judge_task::dependency_condition::ACCEPTED;
             testcase.check_script = "standard";
-            testcase.run_script = "valgrind";
-            testcase.compare_script = "valgrind";
+            testcase.run_script = mode;
+            testcase.compare_script = mode;
             testcase.time_limit = 5;
             testcase.memory_limit = 524288;
             testcase.file_limit = 524288;
@@ -328,3 +335,85 @@ TEST_F(MemoryCheckerTest, DependsOnRandomTimeLimitExceededTest) {
 TEST_F(MemoryCheckerTest, DependsOnRandomWrongAnswerTest) {
     TEST_TASK(STANDARD_WA, prepare_with_random, status::WRONG_ANSWER, status::DEPENDENCY_NOT_SATISFIED, true);
 }
+
+class SanitizerMemoryCheckerTest : public MemoryCheckerTest {
+protected:
+    SanitizerMemoryCheckerTest() {
+        mode = "sanitizer";
+    }
+};
+
+TEST_F(SanitizerMemoryCheckerTest, MemoryOnlyAcceptedTest) {
+    TEST_TASK(STANDARD_AC, prepare_only_memory_check, status::ACCEPTED, status::ACCEPTED, false);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, MemoryOnlyOneLeakTest) {
+    TEST_TASK(STANDARD_ONELEAK, prepare_only_memory_check, status::WRONG_ANSWER, status::WRONG_ANSWER, false);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, MemoryOnlyMultiLeaksTest) {
+    TEST_TASK(STANDARD_MULTILEAKS, prepare_only_memory_check, status::WRONG_ANSWER, status::WRONG_ANSWER, false);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, MemoryOnlyTimeLimitExceededTest) {
+    TEST_TASK(STANDARD_TLE, prepare_only_memory_check, status::TIME_LIMIT_EXCEEDED, status::TIME_LIMIT_EXCEEDED, false);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, DependsOnStandardAcceptedTest) {
+    TEST_TASK(STANDARD_AC, prepare_with_standard, status::ACCEPTED, status::ACCEPTED, true);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, DependsOnStandardOneLeakTest) {
+    TEST_TASK(STANDARD_ONELEAK, prepare_with_standard, status::ACCEPTED, status::WRONG_ANSWER, true);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, DependsOnStandardMultiLeaksTest) {
+    TEST_TASK(STANDARD_MULTILEAKS, prepare_with_standard, status::ACCEPTED, status::WRONG_ANSWER, true);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, DependsOnRandomAcceptedTest) {
+    TEST_TASK(STANDARD_AC, prepare_with_random, status::ACCEPTED, status::ACCEPTED, true);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, DependsOnRandomOneLeakTest) {
+    TEST_TASK(STANDARD_ONELEAK, prepare_with_random, status::ACCEPTED, status::WRONG_ANSWER, true);
+}
+
+TEST_F(SanitizerMemoryCheckerTest, DependsOnRandomMultiLeaksTest) {
+    TEST_TASK(STANDARD_MULTILEAKS, prepare_with_random, status::ACCEPTED, status::WRONG_ANSWER, true);
+}
+
+/**
+ * 比较 valgrind 和 sanitizer 两种内存检查方式评测上面的内存测例的总耗时，
+ * 超时的测例耗时取决于时间限制，不参与比较。
+ * 运行方式：--gtest_filter='*Benchmark*' --gtest_also_run_disabled_tests
+ */
+TEST_F(MemoryCheckerTest, DISABLED_MemoryCheckModeBenchmark) {
+    using prepare_func = function<void(programming_submission &, executable_manager &, const string &)>;
+    const prepare_func funcs[] = {
+        [this](auto &prog, auto &exec_mgr, auto &source) { prepare_only_memory_check(prog, exec_mgr, source); },
+        [this](auto &prog, auto &exec_mgr, auto &source) { prepare_with_standard(prog, exec_mgr, source); },
+        [this](auto &prog, auto &exec_mgr, auto &source) { prepare_with_random(prog, exec_mgr, source); }};
+    const char *sources[] = {STANDARD_AC, STANDARD_ONELEAK, STANDARD_MULTILEAKS};
+
+    for (const char *m : {"valgrind", "sanitizer"}) {
+        mode = m;
+        elapsed_time wall_time;
+        for (auto func : funcs) {
+            for (auto source : sources) {
+                concurrent_queue<message::client_task> task_queue;
+                local_executable_manager exec_mgr(cachedir, execdir);
+                judge::server::mock::configuration mock_judge_server;
+                programming_submission prog;
+                prog.judge_server = &mock_judge_server;
+                func(prog, exec_mgr, source);
+                programming_judger judger;
+                push_submission(judger, task_queue, prog);
+                worker_loop(judger, task_queue);
+            }
+        }
+        auto ms = wall_time.template duration<chrono::milliseconds>().count();
+        LOG(INFO) << "Memory check mode " << mode << " took " << ms << "ms";
+        RecordProperty(mode + "_wall_time_ms", (int)ms);
+    }
+}
@@ -137,7 +137,7 @@ protected:
     } while (0)
 
 TEST_F(RandomCheckerTest, RandomCETest) {
-    TEST_TASK(RANDOM_CE, STANDARD_AC, STANDARD_AC, status::EXECUTABLE_COMPILATION_ERROR, status::DEPENDENCY_NOT_SATISFIED);
+    TEST_TASK(RANDOM_CE, STANDARD_AC, STANDARD_AC, status::ACCEPTED, status::EXECUTABLE_COMPILATION_ERROR);
 }
 
 TEST_F(RandomCheckerTest, RandomRETest) {
@@ -149,11 +149,11 @@ TEST_F(RandomCheckerTest, RandomTLTest) {
 }
 
 TEST_F(RandomCheckerTest, RandomCTLTest) {
-    TEST_TASK(RANDOM_CTL, STANDARD_AC, STANDARD_AC, status::EXECUTABLE_COMPILATION_ERROR, status::DEPENDENCY_NOT_SATISFIED);
+    TEST_TASK(RANDOM_CTL, STANDARD_AC, STANDARD_AC, status::ACCEPTED, status::EXECUTABLE_COMPILATION_ERROR);
 }
 
 TEST_F(RandomCheckerTest, StandardCETest) {
-    TEST_TASK(RANDOM_AC, STANDARD_CE, STANDARD_AC, status::EXECUTABLE_COMPILATION_ERROR, status::DEPENDENCY_NOT_SATISFIED);
+    TEST_TASK(RANDOM_AC, STANDARD_CE, STANDARD_AC, status::ACCEPTED, status::EXECUTABLE_COMPILATION_ERROR);
 }
 
 TEST_F(RandomCheckerTest, StandardRETest) {
@@ -165,7 +165,7 @@ TEST_F(RandomCheckerTest, StandardTLTest) {
 }
 
 TEST_F(RandomCheckerTest, StandardCTLTest) {
-    TEST_TASK(RANDOM_AC, STANDARD_CTL, STANDARD_AC, status::EXECUTABLE_COMPILATION_ERROR, status::DEPENDENCY_NOT_SATISFIED);
+    TEST_TASK(RANDOM_AC, STANDARD_CTL, STANDARD_AC, status::ACCEPTED, status::EXECUTABLE_COMPILATION_ERROR);
 }
 
 TEST_F(RandomCheckerTest, SubmissionCETest) {
@@ -1,6 +1,10 @@
 #include "env.hpp"
+#include <nlohmann/json.hpp>
+#include "config.hpp"
 #include "gtest/gtest.h"
 #include "judge/programming.hpp"
+#include "runguard.hpp"
+#include "test/http_server.hpp"
 #include "test/mock_judge_server.hpp"
 #include "test/worker.hpp"
 
@@ -158,6 +162,67 @@ int main () {
     EXPECT_EQ(prog.results[2].status, status::PRESENTATION_ERROR);
 }
 
+TEST_F(StandardCheckerTest, StreamingWrongAnswerTest) {
+    concurrent_queue<message::client_task> task_queue;
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, R"(#include <iostream>
+int main () {
+    int a;
+    std::cin >> a;
+    while (true) std::cout << a + 1 << std::endl;
+    return 0;
+})");
+    programming_judger judger;
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    // 第一行输出就和标准输出不同，选手程序会被立即结束，而不是运行到超时
+    EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[1].status, status::WRONG_ANSWER);
+    EXPECT_EQ(prog.results[2].status, status::WRONG_ANSWER);
+    EXPECT_LT(prog.results[1].run_time, prog.judge_tasks[1].time_limit);
+    EXPECT_LT(prog.results[2].run_time, prog.judge_tasks[2].time_limit);
+}
+
+TEST_F(StandardCheckerTest, TimelineTest) {
+    concurrent_queue<message::client_task> task_queue;
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, R"(#include <iostream>
+#include <vector>
+int main() {
+    int a;
+    std::cin >> a;
+    std::vector<int> v(1 << 22);
+    for (int round = 0; round < 50; ++round)
+        for (size_t i = 0; i < v.size(); ++i) v[i] += i * a;
+    std::cout << a + (v[1] - v[1]);
+    return 0;
+})");
+    prog.judge_tasks[1].timeline_interval = prog.judge_tasks[2].timeline_interval = 1;
+    programming_judger judger;
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    EXPECT_EQ(prog.results[1].status, status::ACCEPTED);
+    for (size_t i = 1; i <= 2; ++i) {
+        auto report = nlohmann::json::parse(prog.results[i].report);
+        ASSERT_TRUE(report.contains("timeline"));
+        auto &memory = report["timeline"]["memory"];
+        ASSERT_FALSE(memory.empty());
+        EXPECT_LE(memory.size(), 50u);
+        // 选手程序申请了 16MB 内存，降采样后仍然保留内存峰值
+        EXPECT_GE(*max_element(memory.begin(), memory.end()), 16384);
+    }
+}
+
 TEST_F(StandardCheckerTest, CompilationErrorTest) {
     concurrent_queue<message::client_task> task_queue;
     local_executable_manager exec_mgr(cachedir, execdir);
@@ -200,6 +265,11 @@ int main () {
     EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
     EXPECT_EQ(prog.results[1].status, status::TIME_LIMIT_EXCEEDED);
     EXPECT_EQ(prog.results[2].status, status::TIME_LIMIT_EXCEEDED);
+
+    // meta 文件记录了 runguard 结束选手程序的原因
+    auto metadata = read_runguard_result(prog.results[1].run_dir / "program.meta");
+    EXPECT_TRUE(metadata.kill_reason == "cpu-time" || metadata.kill_reason == "wall-time");
+    EXPECT_GE(metadata.involuntary_context_switches, 0);
 }
 
 TEST_F(StandardCheckerTest, MemoryLimitExceededTest) {
@@ -226,6 +296,32 @@ int main () {
     EXPECT_EQ(prog.results[2].status, status::MEMORY_LIMIT_EXCEEDED);
 }
 
+TEST_F(StandardCheckerTest, OutputLimitExceededTest) {
+    concurrent_queue<message::client_task> task_queue;
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, R"(#include <cstdio>
+int main () {
+    while (true) puts("0123456789");
+})");
+    programming_judger judger;
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[1].status, status::OUTPUT_LIMIT_EXCEEDED);
+    EXPECT_EQ(prog.results[2].status, status::OUTPUT_LIMIT_EXCEEDED);
+
+    // 输出在内存中捕获，恰好截断在文件大小限制处，超过时立即结束选手程序
+    auto metadata = read_runguard_result(prog.results[1].run_dir / "program.meta");
+    EXPECT_EQ(metadata.kill_reason, "output-limit");
+    EXPECT_EQ(file_size(prog.results[1].run_dir / "run" / "testdata.out"), (uintmax_t)prog.judge_tasks[1].file_limit * 1024);
+    EXPECT_LT(prog.results[1].run_time, prog.judge_tasks[1].time_limit);
+}
+
 TEST_F(StandardCheckerTest, FloatingPointErrorTest) {
     concurrent_queue<message::client_task> task_queue;
     local_executable_manager exec_mgr(cachedir, execdir);
@@ -313,3 +409,83 @@ int main() {
     EXPECT_EQ(prog.results[1].status, status::ACCEPTED);
     EXPECT_EQ(prog.results[2].status, status::ACCEPTED);
 }
+
+TEST_F(StandardCheckerTest, MultipleDependenciesTest) {
+    concurrent_queue<message::client_task> task_queue;
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, R"(#include <iostream>
+int main() {
+    int a;
+    std::cin >> a;
+    std::cout << 1;
+    return 0;
+})");
+
+    {  // 同时依赖两组标准测试的标准测试
+        judge_task testcase = prog.judge_tasks[1];
+        testcase.dependencies.push_back({2, judge_task::dependency_condition::ACCEPTED});
+        prog.judge_tasks.push_back(testcase);
+    }
+    programming_judger judger;
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[1].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[2].status, status::WRONG_ANSWER);
+    EXPECT_EQ(prog.results[3].status, status::DEPENDENCY_NOT_SATISFIED);
+}
+
+TEST_F(StandardCheckerTest, CircularDependencyTest) {
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, "int main() { return 0; }");
+    prog.judge_tasks[1].dependencies.push_back({2, judge_task::dependency_condition::ACCEPTED});
+    prog.judge_tasks[2].dependencies.push_back({1, judge_task::dependency_condition::ACCEPTED});
+    programming_judger judger;
+
+    EXPECT_FALSE(judger.verify(prog));
+}
+
+TEST_F(StandardCheckerTest, PrefetchTest) {
+    concurrent_queue<message::client_task> task_queue;
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, R"(#include <iostream>
+int main() {
+    int a;
+    std::cin >> a;
+    std::cout << a;
+    return 0;
+})");
+
+    // 测试数据从远程下载，编译期间由 distribute 预取
+    test::http_server server;
+    prog.prob_id = "1235";
+    remove_all(CACHE_DIR / prog.category / prog.prob_id);
+    for (size_t i = 0; i < prog.test_data.size(); ++i) {
+        string number = to_string(i + 1);
+        server.set_file("/" + number + ".in", number);
+        server.set_file("/" + number + ".out", number);
+        prog.test_data[i].inputs[0] = make_unique<remote_asset>("testdata.in", server.url("/" + number + ".in"));
+        prog.test_data[i].outputs[0] = make_unique<remote_asset>("testdata.out", server.url("/" + number + ".out"));
+    }
+    programming_judger judger;
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[1].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[2].status, status::ACCEPTED);
+    // 预取和评测使用同一组测试数据时只下载一次
+    EXPECT_EQ(server.requests(), 4u);
+}
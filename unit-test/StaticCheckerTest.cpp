@@ -126,3 +126,35 @@ int main(void) {
     EXPECT_EQ(prog.results[1].score, boost::rational<int>(9, 10));
     EXPECT_EQ(prog.results[1].status, status::PARTIAL_CORRECT);
 }
+
+TEST_F(StaticCheckerTest, CachedResultTest) {
+    const string source = R"(#include <iostream>
+using namespace std;
+int main(void) {
+  return 0;
+  int abcd = 0;
+  cout << abcd << endl;
+})";
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_judger judger;
+
+    // 同一份代码评测两次，第二次评测直接使用缓存的 oclint 结果
+    for (int round = 0; round < 2; ++round) {
+        concurrent_queue<message::client_task> task_queue;
+        programming_submission prog;
+        prog.judge_server = &mock_judge_server;
+        prepare(prog, exec_mgr, source);
+        prog.sub_id = "1234" + to_string(round);
+
+        push_submission(judger, task_queue, prog);
+        worker_loop(judger, task_queue);
+
+        EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+        EXPECT_EQ(prog.results[1].score, boost::rational<int>(9, 10));
+        EXPECT_EQ(prog.results[1].status, status::PARTIAL_CORRECT);
+        if (round > 0) {
+            EXPECT_NE(prog.results[1].error_log.find("Reusing cached oclint result"), string::npos);
+        }
+    }
+}
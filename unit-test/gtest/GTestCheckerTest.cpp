@@ -147,6 +147,59 @@ TEST_F(GTestCheckerTest, PassTest) {
     EXPECT_EQ(0, report["error_cases"].get<int>());
 }
 
+TEST_F(GTestCheckerTest, ShardedFailureTest) {
+    concurrent_queue<message::client_task> task_queue;
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, code_files / "failure");
+    prog.judge_tasks[1].shards = 3;
+    programming_judger judger;
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    EXPECT_EQ(prog.gtest_shards.size(), 3u);
+    EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[1].status, status::PARTIAL_CORRECT);
+
+    // 合并后的报告和不拆分时相同
+    EXPECT_NO_THROW(json::parse(prog.results[1].report));
+    json report = json::parse(prog.results[1].report);
+    CHECK_NORMAL_KEY(report);
+    EXPECT_EQ(1, report["pass_cases"].get<int>());
+    EXPECT_EQ(19, report["total_cases"].get<int>());
+    EXPECT_EQ(1, report["disabled_cases"].get<int>());
+    EXPECT_EQ(18, report["error_cases"].get<int>());
+}
+
+TEST_F(GTestCheckerTest, ShardedPassTest) {
+    concurrent_queue<message::client_task> task_queue;
+    local_executable_manager exec_mgr(cachedir, execdir);
+    judge::server::mock::configuration mock_judge_server;
+    programming_submission prog;
+    prog.judge_server = &mock_judge_server;
+    prepare(prog, exec_mgr, code_files / "pass");
+    prog.judge_tasks[1].shards = 4;
+    programming_judger judger;
+
+    push_submission(judger, task_queue, prog);
+    worker_loop(judger, task_queue);
+
+    EXPECT_EQ(prog.gtest_shards.size(), 4u);
+    EXPECT_EQ(prog.results[0].status, status::ACCEPTED);
+    EXPECT_EQ(prog.results[1].status, status::ACCEPTED);
+
+    EXPECT_NO_THROW(json::parse(prog.results[1].report));
+    json report = json::parse(prog.results[1].report);
+    CHECK_NORMAL_KEY(report);
+    EXPECT_EQ(10, report["pass_cases"].get<int>());
+    EXPECT_EQ(10, report["total_cases"].get<int>());
+    EXPECT_EQ(9, report["disabled_cases"].get<int>());
+    EXPECT_EQ(0, report["error_cases"].get<int>());
+}
+
 TEST_F(GTestCheckerTest, PassTestWithDisabledTests) {
     concurrent_queue<message::client_task> task_queue;
     local_executable_manager exec_mgr(cachedir, execdir);
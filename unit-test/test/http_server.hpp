@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 测试用的本地 HTTP 服务器，代替测试数据的文件服务器
+ * 用法：
+ * 1. http_server server; server.set_file("/1.in", "1");
+ * 2. 从 server.url("/1.in") 下载
+ * 3. 通过 connections()、requests()、responses() 检查连接复用、重试和条件请求
+ */
+namespace judge::test {
+
+struct http_server {
+    /**
+     * @brief 在 127.0.0.1 的随机端口上监听，支持 HTTP/1.1 keep-alive
+     */
+    http_server();
+
+    ~http_server();
+
+    std::string url(const std::string &path) const;
+
+    /**
+     * @brief 设置文件内容，每次设置都会生成新的 ETag
+     * 请求带有和当前 ETag 相同的 If-None-Match 时返回 304
+     */
+    void set_file(const std::string &path, const std::string &content);
+
+    /**
+     * @brief 接下来对 path 的 times 次请求返回 status
+     */
+    void fail_next(const std::string &path, int times, int status = 503);
+
+    /**
+     * @brief 对 path 的请求永远不返回，用于测试超时
+     */
+    void stall(const std::string &path);
+
+    /**
+     * @brief 已经接受的 TCP 连接数
+     */
+    size_t connections() const;
+
+    /**
+     * @brief 已经收到的请求数
+     */
+    size_t requests() const;
+
+    /**
+     * @brief 返回了文件内容的请求数（200 响应）
+     */
+    size_t responses() const;
+
+private:
+    void accept_loop();
+
+    void serve(int fd);
+
+    int listen_fd = -1;
+    int port = 0;
+
+    std::mutex mutex;
+    std::map<std::string, std::pair<std::string, std::string>> files;  // 文件内容和 ETag
+    size_t version = 0;
+    std::map<std::string, std::pair<int, int>> failures;  // 剩余的失败次数和返回的状态码
+    std::map<std::string, bool> stalled;
+    std::vector<int> client_fds;
+    std::vector<std::thread> clients;
+
+    std::atomic<size_t> accepted = 0, received = 0, served = 0;
+    std::atomic<bool> stopping = false;
+    std::thread acceptor;
+};
+
+}  // namespace judge::test
@@ -0,0 +1,145 @@
+#include "test/http_server.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <stdexcept>
+
+namespace judge::test {
+using namespace std;
+
+http_server::http_server() {
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) throw runtime_error("unable to create socket");
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listen_fd, (sockaddr *)&addr, len) != 0 || listen(listen_fd, 64) != 0 ||
+        getsockname(listen_fd, (sockaddr *)&addr, &len) != 0)
+        throw runtime_error("unable to listen on loopback");
+    port = ntohs(addr.sin_port);
+    acceptor = thread(&http_server::accept_loop, this);
+}
+
+http_server::~http_server() {
+    stopping = true;
+    shutdown(listen_fd, SHUT_RDWR);
+    acceptor.join();
+    close(listen_fd);
+    {
+        lock_guard<std::mutex> guard(mutex);
+        for (int fd : client_fds) shutdown(fd, SHUT_RDWR);
+    }
+    for (auto &client : clients) client.join();
+    for (int fd : client_fds) close(fd);
+}
+
+string http_server::url(const string &path) const {
+    return "http://127.0.0.1:" + to_string(port) + path;
+}
+
+void http_server::set_file(const string &path, const string &content) {
+    lock_guard<std::mutex> guard(mutex);
+    files[path] = {content, "\"" + to_string(++version) + "\""};
+}
+
+void http_server::fail_next(const string &path, int times, int status) {
+    lock_guard<std::mutex> guard(mutex);
+    failures[path] = {times, status};
+}
+
+void http_server::stall(const string &path) {
+    lock_guard<std::mutex> guard(mutex);
+    stalled[path] = true;
+}
+
+size_t http_server::connections() const {
+    return accepted;
+}
+
+size_t http_server::requests() const {
+    return received;
+}
+
+size_t http_server::responses() const {
+    return served;
+}
+
+void http_server::accept_loop() {
+    while (!stopping) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        ++accepted;
+        lock_guard<std::mutex> guard(mutex);
+        client_fds.push_back(fd);
+        clients.emplace_back(&http_server::serve, this, fd);
+    }
+}
+
+void http_server::serve(int fd) {
+    string buffer;
+    char chunk[4096];
+    while (!stopping) {
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == string::npos) {
+            ssize_t n = read(fd, chunk, sizeof(chunk));
+            if (n <= 0) return;
+            buffer.append(chunk, n);
+        }
+        string request = buffer.substr(0, end);
+        buffer.erase(0, end + 4);
+        ++received;
+
+        // 请求行形如 GET /path HTTP/1.1
+        size_t begin = request.find(' ') + 1;
+        string path = request.substr(begin, request.find(' ', begin) - begin);
+
+        // curl 发送的请求头大小写固定
+        string if_none_match;
+        if (size_t header = request.find("\r\nIf-None-Match: "); header != string::npos) {
+            header += 17;
+            if_none_match = request.substr(header, request.find("\r\n", header) - header);
+        }
+
+        int status = 200;
+        string body, etag;
+        {
+            lock_guard<std::mutex> guard(mutex);
+            if (stalled.count(path)) {
+                status = 0;
+            } else if (auto it = failures.find(path); it != failures.end() && it->second.first > 0) {
+                --it->second.first;
+                status = it->second.second;
+            } else if (auto file = files.find(path); file != files.end()) {
+                etag = file->second.second;
+                if (if_none_match == etag)
+                    status = 304;
+                else
+                    body = file->second.first;
+            } else {
+                status = 404;
+            }
+        }
+        if (status == 0) {
+            while (!stopping) this_thread::sleep_for(chrono::milliseconds(10));
+            return;
+        }
+
+        if (status == 200) ++served;
+
+        string reason = status == 200 ? " OK" : status == 304 ? " Not Modified" : " Error";
+        string response = "HTTP/1.1 " + to_string(status) + reason + "\r\n" +
+                          (etag.empty() ? "" : "ETag: " + etag + "\r\n") +
+                          "Content-Length: " + to_string(body.size()) + "\r\n" +
+                          "Connection: keep-alive\r\n\r\n" + body;
+        for (size_t offset = 0; offset < response.size();) {
+            ssize_t n = write(fd, response.data() + offset, response.size() - offset);
+            if (n <= 0) return;
+            offset += n;
+        }
+    }
+}
+
+}  // namespace judge::test